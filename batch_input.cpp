@@ -0,0 +1,223 @@
+#include "batch_input.h"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <map>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+bool IsPng(const std::string& fileName) {
+    return fileName.find(".png") != std::string::npos;
+}
+
+// true for the file extensions of heightmap exports
+bool IsHeightmapExtension(const fs::path& file) {
+    std::string extension = file.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    return extension == ".png" || extension == ".raw" || extension == ".r16" || extension == ".r32";
+}
+
+// base name of a heightmap export like "TerrainHeight.r16", empty for other files
+std::string HeightmapBaseName(const fs::path& file) {
+    if (!IsHeightmapExtension(file)) {
+        return std::string();
+    }
+    std::string fileName = file.filename().string();
+    size_t pos = fileName.find("Height");
+    if (pos == std::string::npos) {
+        return std::string();
+    }
+    // "Terrain Height.png" belongs to Terrain, like "Terrain Color.png"
+    while (pos > 0 && (fileName[pos - 1] == ' ' || fileName[pos - 1] == '_')) {
+        --pos;
+    }
+    return fileName.substr(0, pos);
+}
+
+// base name of a mesh export like "TerrainMesh.glb", empty for other files
+std::string MeshBaseName(const fs::path& file) {
+    if (file.extension() != ".glb") {
+        return std::string();
+    }
+    std::string fileName = file.filename().string();
+    size_t pos = fileName.find("Mesh");
+    return pos == std::string::npos ? std::string() : fileName.substr(0, pos);
+}
+
+// split a manifest line into whitespace separated fields, double quotes group fields with spaces
+std::vector<std::string> SplitFields(const std::string& line) {
+    std::vector<std::string> fields;
+    size_t i = 0;
+    while (i < line.size()) {
+        while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i]))) {
+            ++i;
+        }
+        if (i == line.size() || line[i] == '#') {
+            break;
+        }
+        std::string field;
+        if (line[i] == '"') {
+            size_t end = line.find('"', i + 1);
+            if (end == std::string::npos) {
+                end = line.size();
+            }
+            field = line.substr(i + 1, end - i - 1);
+            i = end + 1;
+        } else {
+            while (i < line.size() && !std::isspace(static_cast<unsigned char>(line[i]))) {
+                field += line[i++];
+            }
+        }
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+} // namespace
+
+bool IsHeightmapFile(const std::string& baseName, const std::string& fileName) {
+    size_t pos = fileName.find(baseName);
+    return pos != std::string::npos && fileName.find("Height", pos + baseName.size()) != std::string::npos
+        && IsHeightmapExtension(fileName);
+}
+
+bool IsExportFile(const std::string& baseName, const std::string& fileName) {
+    return fileName.find(baseName) != std::string::npos
+        && (IsPng(fileName) || fileName.find("Mesh") != std::string::npos || IsHeightmapFile(baseName, fileName));
+}
+
+bool FindExport(const std::string& baseName, const std::string& inputFolder, const std::string& outputFolder,
+    ConversionJob& job, std::string& err) {
+    std::error_code ec;
+    if (!fs::is_directory(inputFolder, ec)) {
+        err = "Input folder does not exist: " + inputFolder;
+        return false;
+    }
+    job.baseName = baseName;
+    job.outputFolder = outputFolder;
+    for (const auto& entry : fs::directory_iterator(inputFolder, ec)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        const std::string fileName = entry.path().filename().string();
+        if (!IsExportFile(baseName, fileName)) {
+            continue;
+        }
+        if (IsHeightmapFile(baseName, fileName)) {
+            // a png heightmap is preferred over raw exports of the same terrain
+            if (job.heightmapFile.empty() || IsPng(fileName)) {
+                job.heightmapFile = entry.path().string();
+            }
+        } else if (IsPng(fileName)) {
+            job.texFiles.push_back(entry.path().string());
+        } else {
+            job.meshFile = entry.path().string();
+        }
+    }
+    // directory order is unspecified
+    std::sort(job.texFiles.begin(), job.texFiles.end());
+    return true;
+}
+
+bool FindExportsInTree(const std::string& root, const std::string& outputFolder, bool heightmaps,
+    std::vector<ConversionJob>& jobs, std::string& err) {
+    std::error_code ec;
+    if (!fs::is_directory(root, ec)) {
+        err = "Batch folder does not exist: " + root;
+        return false;
+    }
+    // one pass over the tree, files grouped by folder
+    std::map<fs::path, std::vector<fs::path>> folders;
+    for (auto it = fs::recursive_directory_iterator(root, fs::directory_options::skip_permission_denied, ec);
+         it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (ec) {
+            err = "Cannot scan " + root + ": " + ec.message();
+            return false;
+        }
+        if (it->is_regular_file()) {
+            folders[it->path().parent_path()].push_back(it->path());
+        }
+    }
+    for (auto& [folder, files] : folders) {
+        std::sort(files.begin(), files.end());
+        size_t first = jobs.size();
+        for (const fs::path& file : files) {
+            std::string baseName = heightmaps ? HeightmapBaseName(file) : MeshBaseName(file);
+            // a terrain can have several heightmap files, e.g. a png and a raw export
+            bool known = heightmaps && std::any_of(jobs.begin() + first, jobs.end(),
+                [&baseName](const ConversionJob& job) { return job.baseName == baseName; });
+            if (baseName.empty() || known) {
+                continue;
+            }
+            ConversionJob job;
+            job.baseName = baseName;
+            if (!heightmaps) {
+                job.meshFile = file.string();
+            }
+            job.outputFolder = folder.string();
+            if (!outputFolder.empty()) {
+                fs::path target = fs::path(outputFolder) / fs::relative(folder, root, ec);
+                fs::create_directories(target, ec);
+                job.outputFolder = target.lexically_normal().string();
+            }
+            jobs.push_back(job);
+        }
+        for (const fs::path& file : files) {
+            const std::string fileName = file.filename().string();
+            bool heightmap = !HeightmapBaseName(file).empty();
+            if (!IsPng(fileName) && !heightmap) {
+                continue;
+            }
+            ConversionJob* owner = nullptr;
+            for (size_t i = first; i < jobs.size(); ++i) {
+                if (fileName.find(jobs[i].baseName) != std::string::npos
+                    && (!owner || jobs[i].baseName.size() > owner->baseName.size())) {
+                    owner = &jobs[i];
+                }
+            }
+            if (!owner) {
+                continue;
+            }
+            if (!heightmap) {
+                owner->texFiles.push_back(file.string());
+            } else if (owner->heightmapFile.empty() || IsPng(fileName)) {
+                owner->heightmapFile = file.string();
+            }
+        }
+    }
+    return true;
+}
+
+bool ReadManifest(const std::string& manifestPath, const std::string& outputFolder, std::vector<ConversionJob>& jobs,
+    std::string& err) {
+    std::ifstream in(manifestPath);
+    if (!in) {
+        err = "Cannot open manifest " + manifestPath;
+        return false;
+    }
+    fs::path base = fs::path(manifestPath).parent_path();
+    std::string line;
+    for (size_t lineNumber = 1; std::getline(in, line); ++lineNumber) {
+        std::vector<std::string> fields = SplitFields(line);
+        if (fields.empty()) {
+            continue;
+        }
+        if (fields.size() < 2 || fields.size() > 3) {
+            err = manifestPath + ":" + std::to_string(lineNumber) + ": expected BaseName InputFolder [OutputFolder]";
+            return false;
+        }
+        std::string inputFolder = (base / fields[1]).string();
+        std::string target = fields.size() == 3 ? (base / fields[2]).string()
+            : outputFolder.empty() ? inputFolder : outputFolder;
+        ConversionJob job;
+        if (!FindExport(fields[0], inputFolder, target, job, err)) {
+            err = manifestPath + ":" + std::to_string(lineNumber) + ": " + err;
+            return false;
+        }
+        jobs.push_back(job);
+    }
+    return true;
+}
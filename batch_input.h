@@ -0,0 +1,38 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// one terrain export to convert: its mesh or heightmap and maps, and the folder <baseName>.glb is written to
+struct ConversionJob {
+    std::string baseName;
+    std::string meshFile;
+    std::string heightmapFile;
+    std::vector<std::string> texFiles;
+    std::string outputFolder;
+};
+
+// true for a heightmap export of baseName: the name contains baseName followed by "Height",
+// the file is a .png, .raw, .r16 or .r32
+bool IsHeightmapFile(const std::string& baseName, const std::string& fileName);
+
+// true for the files of baseName that FindExport picks up: maps (.png), the mesh (name contains "Mesh")
+// and the heightmap
+bool IsExportFile(const std::string& baseName, const std::string& fileName);
+
+// find mesh, heightmap and maps of baseName in inputFolder with one directory scan. A file belongs to baseName if
+// its name contains it; the mesh also contains "Mesh", the maps are .png files other than the heightmap
+bool FindExport(const std::string& baseName, const std::string& inputFolder, const std::string& outputFolder,
+    ConversionJob& job, std::string& err);
+
+// find all exports below root with one recursive scan. Every <BaseName>Mesh*.glb is a terrain, or with
+// heightmaps every <BaseName>Height* heightmap file. The maps and heightmaps in its folder go to the longest
+// base name they contain. Without outputFolder the glb files are written next to the exports, otherwise to
+// the same relative folder below outputFolder, which is created if needed
+bool FindExportsInTree(const std::string& root, const std::string& outputFolder, bool heightmaps,
+    std::vector<ConversionJob>& jobs, std::string& err);
+
+// read a manifest with one terrain per line: BaseName InputFolder [OutputFolder]. Fields with spaces are
+// quoted, # starts a comment. Relative folders are relative to the manifest, the output folder defaults to
+// outputFolder if given, otherwise to the input folder
+bool ReadManifest(const std::string& manifestPath, const std::string& outputFolder, std::vector<ConversionJob>& jobs,
+    std::string& err);
@@ -0,0 +1,351 @@
+#include "bc_encoder.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BC_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// interpolation weights of 4 bit BC7 indices, in 1/64
+const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// writes a 128 bit block from least significant bit up
+class BitWriter {
+public:
+    explicit BitWriter(uint8_t* out) : out(out) { std::memset(out, 0, 16); }
+    void write(uint32_t value, int bits) {
+        for (int i = 0; i < bits; ++i, ++position) {
+            if (value & (1u << i)) {
+                out[position >> 3] |= static_cast<uint8_t>(1u << (position & 7));
+            }
+        }
+    }
+
+private:
+    uint8_t* out;
+    int position = 0;
+};
+
+// BC7 mode 6 endpoints: 7 bits per channel plus one shared p bit per endpoint
+struct Bc7Endpoints {
+    int color[2][4];
+    int pbit[2];
+};
+
+// best 7 bit + p bit representation of a float endpoint
+void QuantizeEndpoint(const float value[4], int color[4], int& pbit) {
+    float bestError = 1e30f;
+    for (int p = 0; p < 2; ++p) {
+        int candidate[4];
+        float error = 0.0f;
+        for (int c = 0; c < 4; ++c) {
+            float v = std::min(std::max(value[c], 0.0f), 255.0f);
+            candidate[c] = std::min(std::max(static_cast<int>(std::lround((v - p) * 0.5f)), 0), 127);
+            float d = static_cast<float>(candidate[c] * 2 + p) - v;
+            error += d * d;
+        }
+        if (error < bestError) {
+            bestError = error;
+            pbit = p;
+            std::memcpy(color, candidate, sizeof(candidate));
+        }
+    }
+}
+
+// the 16 colors a mode 6 block can produce, stored per channel for the index search
+struct Bc7Palette {
+    alignas(16) float channel[4][16];
+
+    explicit Bc7Palette(const Bc7Endpoints& e) {
+        for (int c = 0; c < 4; ++c) {
+            int e0 = e.color[0][c] * 2 + e.pbit[0];
+            int e1 = e.color[1][c] * 2 + e.pbit[1];
+            for (int i = 0; i < 16; ++i) {
+                channel[c][i] = static_cast<float>(((64 - BC7_WEIGHTS[i]) * e0 + BC7_WEIGHTS[i] * e1 + 32) >> 6);
+            }
+        }
+    }
+};
+
+// nearest palette entry for every pixel, returns the summed squared error
+float AssignIndices(const Bc7Palette& palette, const float pixels[4][16], int indices[16]) {
+    float total = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+#ifdef BC_USE_SSE2
+        __m128 distance[4];
+        for (int j = 0; j < 4; ++j) {
+            __m128 sum = _mm_setzero_ps();
+            for (int c = 0; c < 4; ++c) {
+                __m128 d = _mm_sub_ps(_mm_load_ps(&palette.channel[c][j * 4]), _mm_set1_ps(pixels[c][i]));
+                sum = _mm_add_ps(sum, _mm_mul_ps(d, d));
+            }
+            distance[j] = sum;
+        }
+        __m128 best = _mm_min_ps(_mm_min_ps(distance[0], distance[1]), _mm_min_ps(distance[2], distance[3]));
+        best = _mm_min_ps(best, _mm_shuffle_ps(best, best, _MM_SHUFFLE(1, 0, 3, 2)));
+        best = _mm_min_ps(best, _mm_shuffle_ps(best, best, _MM_SHUFFLE(2, 3, 0, 1)));
+        for (int j = 0; j < 4; ++j) {
+            int mask = _mm_movemask_ps(_mm_cmpeq_ps(distance[j], best));
+            if (mask != 0) {
+                int lane = (mask & 1) ? 0 : (mask & 2) ? 1 : (mask & 4) ? 2 : 3;
+                indices[i] = j * 4 + lane;
+                break;
+            }
+        }
+        total += _mm_cvtss_f32(best);
+#else
+        float best = 1e30f;
+        for (int j = 0; j < 16; ++j) {
+            float sum = 0.0f;
+            for (int c = 0; c < 4; ++c) {
+                float d = palette.channel[c][j] - pixels[c][i];
+                sum += d * d;
+            }
+            if (sum < best) {
+                best = sum;
+                indices[i] = j;
+            }
+        }
+        total += best;
+#endif
+    }
+    return total;
+}
+
+// endpoints along the principal axis of the block colors
+void InitialEndpoints(const float pixels[4][16], float e0[4], float e1[4]) {
+    float mean[4] = { 0, 0, 0, 0 };
+    for (int c = 0; c < 4; ++c) {
+        for (int i = 0; i < 16; ++i) {
+            mean[c] += pixels[c][i];
+        }
+        mean[c] /= 16.0f;
+    }
+    float covariance[4][4] = {};
+    for (int i = 0; i < 16; ++i) {
+        for (int a = 0; a < 4; ++a) {
+            for (int b = a; b < 4; ++b) {
+                covariance[a][b] += (pixels[a][i] - mean[a]) * (pixels[b][i] - mean[b]);
+            }
+        }
+    }
+    for (int a = 0; a < 4; ++a) {
+        for (int b = 0; b < a; ++b) {
+            covariance[a][b] = covariance[b][a];
+        }
+    }
+    // power iteration, starting from the channel with the largest variance
+    float axis[4] = { 0, 0, 0, 0 };
+    int largest = 0;
+    for (int c = 1; c < 4; ++c) {
+        if (covariance[c][c] > covariance[largest][largest]) {
+            largest = c;
+        }
+    }
+    axis[largest] = 1.0f;
+    for (int iteration = 0; iteration < 8; ++iteration) {
+        float next[4] = { 0, 0, 0, 0 };
+        for (int a = 0; a < 4; ++a) {
+            for (int b = 0; b < 4; ++b) {
+                next[a] += covariance[a][b] * axis[b];
+            }
+        }
+        float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+        if (length < 1e-6f) {
+            break;
+        }
+        for (int c = 0; c < 4; ++c) {
+            axis[c] = next[c] / length;
+        }
+    }
+    float tMin = 0.0f, tMax = 0.0f;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0.0f;
+        for (int c = 0; c < 4; ++c) {
+            t += (pixels[c][i] - mean[c]) * axis[c];
+        }
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    for (int c = 0; c < 4; ++c) {
+        e0[c] = mean[c] + tMin * axis[c];
+        e1[c] = mean[c] + tMax * axis[c];
+    }
+}
+
+// least squares endpoints for fixed indices, false if the indices do not span a line
+bool FitEndpoints(const float pixels[4][16], const int indices[16], float e0[4], float e1[4]) {
+    float a = 0, b = 0, c = 0;
+    float d0[4] = { 0, 0, 0, 0 }, d1[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 16; ++i) {
+        float w = BC7_WEIGHTS[indices[i]] / 64.0f;
+        a += (1 - w) * (1 - w);
+        b += (1 - w) * w;
+        c += w * w;
+        for (int ch = 0; ch < 4; ++ch) {
+            d0[ch] += (1 - w) * pixels[ch][i];
+            d1[ch] += w * pixels[ch][i];
+        }
+    }
+    float det = a * c - b * b;
+    if (std::fabs(det) < 1e-6f) {
+        return false;
+    }
+    for (int ch = 0; ch < 4; ++ch) {
+        e0[ch] = (c * d0[ch] - b * d1[ch]) / det;
+        e1[ch] = (a * d1[ch] - b * d0[ch]) / det;
+    }
+    return true;
+}
+
+// 3 bit BC4 index of every value, by rounding its position between min and max
+void Bc4Levels(const uint8_t values[16], int minValue, int maxValue, int levels[16]) {
+    float scale = 7.0f / static_cast<float>(maxValue - minValue);
+#ifdef BC_USE_SSE2
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values));
+    __m128i zero = _mm_setzero_si128();
+    __m128i low = _mm_unpacklo_epi8(bytes, zero);
+    __m128i high = _mm_unpackhi_epi8(bytes, zero);
+    __m128i words[4] = { _mm_unpacklo_epi16(low, zero), _mm_unpackhi_epi16(low, zero),
+        _mm_unpacklo_epi16(high, zero), _mm_unpackhi_epi16(high, zero) };
+    __m128 offset = _mm_set1_ps(static_cast<float>(minValue));
+    __m128 factor = _mm_set1_ps(scale);
+    __m128 half = _mm_set1_ps(0.5f);
+    for (int j = 0; j < 4; ++j) {
+        __m128 t = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(words[j]), offset), factor), half);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&levels[j * 4]), _mm_cvttps_epi32(t));
+    }
+#else
+    for (int i = 0; i < 16; ++i) {
+        levels[i] = static_cast<int>((values[i] - minValue) * scale + 0.5f);
+    }
+#endif
+}
+
+} // namespace
+
+size_t BcBlockSize(BcFormat format) {
+    return format == BcFormat::BC4 ? 8 : 16;
+}
+
+void EncodeBC4Block(const uint8_t rgba[64], int channel, uint8_t out[8]) {
+    alignas(16) uint8_t values[16];
+    int minValue = 255, maxValue = 0;
+    for (int i = 0; i < 16; ++i) {
+        values[i] = rgba[i * 4 + channel];
+        minValue = std::min(minValue, static_cast<int>(values[i]));
+        maxValue = std::max(maxValue, static_cast<int>(values[i]));
+    }
+    // red0 > red1 selects the mode with 6 interpolated values
+    out[0] = static_cast<uint8_t>(maxValue);
+    out[1] = static_cast<uint8_t>(minValue);
+    uint64_t bits = 0;
+    if (maxValue > minValue) {
+        int levels[16];
+        Bc4Levels(values, minValue, maxValue, levels);
+        for (int i = 0; i < 16; ++i) {
+            // level 7 is red0 (index 0), level 0 is red1 (index 1), level k in between is index 8 - k
+            int level = levels[i];
+            uint64_t index = level == 7 ? 0 : level == 0 ? 1 : static_cast<uint64_t>(8 - level);
+            bits |= index << (3 * i);
+        }
+    }
+    for (int i = 0; i < 6; ++i) {
+        out[2 + i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+}
+
+void EncodeBC5Block(const uint8_t rgba[64], uint8_t out[16]) {
+    EncodeBC4Block(rgba, 0, out);
+    EncodeBC4Block(rgba, 1, out + 8);
+}
+
+// BC7 mode 6: one subset, rgba endpoints, 4 bit indices. Endpoints from the principal axis,
+// refined by least squares fits of the chosen indices
+void EncodeBC7Block(const uint8_t rgba[64], uint8_t out[16]) {
+    float pixels[4][16];
+    for (int i = 0; i < 16; ++i) {
+        for (int c = 0; c < 4; ++c) {
+            pixels[c][i] = rgba[i * 4 + c];
+        }
+    }
+    float e0[4], e1[4];
+    InitialEndpoints(pixels, e0, e1);
+    Bc7Endpoints best;
+    QuantizeEndpoint(e0, best.color[0], best.pbit[0]);
+    QuantizeEndpoint(e1, best.color[1], best.pbit[1]);
+    int bestIndices[16];
+    float bestError = AssignIndices(Bc7Palette(best), pixels, bestIndices);
+
+    for (int iteration = 0; iteration < 2 && bestError > 0.0f; ++iteration) {
+        if (!FitEndpoints(pixels, bestIndices, e0, e1)) {
+            break;
+        }
+        Bc7Endpoints candidate;
+        QuantizeEndpoint(e0, candidate.color[0], candidate.pbit[0]);
+        QuantizeEndpoint(e1, candidate.color[1], candidate.pbit[1]);
+        int indices[16];
+        float error = AssignIndices(Bc7Palette(candidate), pixels, indices);
+        if (error >= bestError) {
+            break;
+        }
+        best = candidate;
+        bestError = error;
+        std::memcpy(bestIndices, indices, sizeof(indices));
+    }
+
+    // the first index is stored with 3 bits, so its top bit has to be 0
+    if (bestIndices[0] >= 8) {
+        std::swap(best.color[0], best.color[1]);
+        std::swap(best.pbit[0], best.pbit[1]);
+        for (int& index : bestIndices) {
+            index = 15 - index;
+        }
+    }
+    BitWriter writer(out);
+    writer.write(1u << 6, 7); // mode 6
+    for (int c = 0; c < 4; ++c) {
+        writer.write(best.color[0][c], 7);
+        writer.write(best.color[1][c], 7);
+    }
+    writer.write(best.pbit[0], 1);
+    writer.write(best.pbit[1], 1);
+    writer.write(bestIndices[0], 3);
+    for (int i = 1; i < 16; ++i) {
+        writer.write(bestIndices[i], 4);
+    }
+}
+
+std::vector<uint8_t> CompressImage(const uint8_t* rgba, int width, int height, BcFormat format, ThreadPool& pool) {
+    const size_t blocksX = (static_cast<size_t>(width) + 3) / 4;
+    const size_t blocksY = (static_cast<size_t>(height) + 3) / 4;
+    const size_t blockSize = BcBlockSize(format);
+    const size_t rowsPerTask = 16;
+    std::vector<uint8_t> compressed(blocksX * blocksY * blockSize);
+    pool.parallelFor((blocksY + rowsPerTask - 1) / rowsPerTask, [&](size_t task) {
+        size_t lastRow = std::min(blocksY, (task + 1) * rowsPerTask);
+        for (size_t by = task * rowsPerTask; by < lastRow; ++by) {
+            for (size_t bx = 0; bx < blocksX; ++bx) {
+                uint8_t block[64];
+                for (size_t y = 0; y < 4; ++y) {
+                    size_t sy = std::min(by * 4 + y, static_cast<size_t>(height) - 1);
+                    for (size_t x = 0; x < 4; ++x) {
+                        size_t sx = std::min(bx * 4 + x, static_cast<size_t>(width) - 1);
+                        std::memcpy(&block[(y * 4 + x) * 4], &rgba[(sy * width + sx) * 4], 4);
+                    }
+                }
+                uint8_t* out = &compressed[(by * blocksX + bx) * blockSize];
+                switch (format) {
+                case BcFormat::BC4: EncodeBC4Block(block, 0, out); break;
+                case BcFormat::BC5: EncodeBC5Block(block, out); break;
+                case BcFormat::BC7: EncodeBC7Block(block, out); break;
+                }
+            }
+        }
+    });
+    return compressed;
+}
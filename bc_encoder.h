@@ -0,0 +1,23 @@
+#pragma once
+#include "thread_pool.h"
+#include <cstdint>
+#include <vector>
+
+// block compressed GPU formats, every format encodes 4x4 pixel blocks
+enum class BcFormat {
+    BC4, // one channel, 8 bytes per block
+    BC5, // two channels, 16 bytes per block
+    BC7  // rgba, 16 bytes per block
+};
+
+size_t BcBlockSize(BcFormat format);
+
+// Encoders for one block, input is 16 rgba pixels row major.
+// BC4 takes the given channel, BC5 red and green
+void EncodeBC4Block(const uint8_t rgba[64], int channel, uint8_t out[8]);
+void EncodeBC5Block(const uint8_t rgba[64], uint8_t out[16]);
+void EncodeBC7Block(const uint8_t rgba[64], uint8_t out[16]);
+
+// compress a whole rgba image, rows of blocks are encoded in parallel on the pool.
+// Blocks crossing the right or bottom border repeat the last column / row
+std::vector<uint8_t> CompressImage(const uint8_t* rgba, int width, int height, BcFormat format, ThreadPool& pool);
@@ -0,0 +1,278 @@
+#include "tiny_gltf.h"
+#include "gltf_json.h"
+#include "synthetic_export.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Synthetic exports and benchmark runs of the converter, works offline on generated data only.
+//   generate: write one synthetic export
+//   run:      generate exports of every size (once, they are kept in the work folder), convert each of them
+//             with every configuration in its own converter process and report wall time, throughput,
+//             peak memory and the stage timings of the converter's --stats report
+
+namespace fs = std::filesystem;
+
+// converter options of a benchmark configuration
+struct BenchmarkConfig {
+    const char* name;
+    const char* arguments;
+};
+
+const BenchmarkConfig CONFIGS[] = {
+    { "default", "" },
+    { "reencode", "--reencode" },
+    { "ktx2", "--ktx2" },
+    { "orm-ktx2", "--ktx2 --orm" },
+    { "tiles", "--tiles 4 --max-error 0.5 --quantize --optimize-mesh" },
+};
+
+const char* const DEFAULT_SIZES = "512,1024,2048,4096,8192";
+const char* const DEFAULT_CONFIGS = "default,reencode,ktx2,tiles";
+// written after an export is complete, generation is skipped if it is present
+const char* const COMPLETE_MARKER = "synthetic.complete";
+
+void usage() {
+    std::cout << "Usage: WorldCreatorBenchmark generate <OutputFolder> [--size S] [--grid N] [--seed X] [--name BaseName]" << std::endl;
+    std::cout << "       WorldCreatorBenchmark run --converter <WorldCreatorToGLTF> [--work DIR] [--sizes 512,1024,...]" << std::endl;
+    std::cout << "                                 [--configs default,reencode,ktx2,orm-ktx2,tiles] [--jobs N] [--report FILE]" << std::endl;
+    std::cout << "  generate writes <BaseName>Mesh.glb and the five maps, S x S pixels, mesh grid N x N (default S/4+1)" << std::endl;
+    std::cout << "  run converts an export of every size with every configuration (defaults: " << DEFAULT_SIZES
+              << " / " << DEFAULT_CONFIGS << ")" << std::endl;
+}
+
+std::vector<std::string> SplitList(const std::string& text) {
+    std::vector<std::string> items;
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+bool ParseNumber(const std::string& text, size_t& value) {
+    char* end = nullptr;
+    unsigned long long v = std::strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str() || *end != '\0' || v == 0) {
+        return false;
+    }
+    value = static_cast<size_t>(v);
+    return true;
+}
+
+std::string Quote(const std::string& text) {
+    return "\"" + text + "\"";
+}
+
+double Number(const tinygltf::Value& object, const char* key) {
+    return object.Has(key) ? object.Get(key).GetNumberAsDouble() : 0.0;
+}
+
+int generate(const std::vector<std::string>& args) {
+    // the output folder comes first, an option in its place means it was left out
+    if (args.empty() || args[0].rfind("--", 0) == 0) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    SyntheticOptions options;
+    std::string folder = args[0];
+    for (size_t i = 1; i < args.size(); ++i) {
+        size_t value = 0;
+        bool hasValue = i + 1 < args.size();
+        if (args[i] == "--size" && hasValue && ParseNumber(args[i + 1], value)) {
+            options.textureSize = value;
+        } else if (args[i] == "--grid" && hasValue && ParseNumber(args[i + 1], value)) {
+            options.gridSize = value;
+        } else if (args[i] == "--seed" && hasValue && ParseNumber(args[i + 1], value)) {
+            options.seed = static_cast<uint32_t>(value);
+        } else if (args[i] == "--name" && hasValue) {
+            options.baseName = args[i + 1];
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+        ++i;
+    }
+    ThreadPool pool;
+    std::string err;
+    if (!WriteSyntheticExport(folder, options, pool, err)) {
+        std::cerr << err << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "Wrote synthetic export " << options.baseName << " to " << folder << std::endl;
+    return 0;
+}
+
+int run(const std::vector<std::string>& args) {
+    std::string converter;
+    std::string work = "benchmark";
+    std::string report;
+    std::vector<std::string> sizeList = SplitList(DEFAULT_SIZES);
+    std::vector<std::string> configList = SplitList(DEFAULT_CONFIGS);
+    size_t jobs = 0;
+    for (size_t i = 0; i + 1 < args.size(); i += 2) {
+        if (args[i] == "--converter") {
+            converter = args[i + 1];
+        } else if (args[i] == "--work") {
+            work = args[i + 1];
+        } else if (args[i] == "--report") {
+            report = args[i + 1];
+        } else if (args[i] == "--sizes") {
+            sizeList = SplitList(args[i + 1]);
+        } else if (args[i] == "--configs") {
+            configList = SplitList(args[i + 1]);
+        } else if (args[i] == "--jobs") {
+            if (!ParseNumber(args[i + 1], jobs)) {
+                usage();
+                return EXIT_FAILURE;
+            }
+        } else {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+    if (converter.empty() || args.size() % 2 != 0) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    std::vector<size_t> sizes;
+    for (const auto& item : sizeList) {
+        size_t size;
+        if (!ParseNumber(item, size)) {
+            std::cerr << "Invalid size " << item << std::endl;
+            return EXIT_FAILURE;
+        }
+        sizes.push_back(size);
+    }
+    std::vector<const BenchmarkConfig*> configs;
+    for (const auto& name : configList) {
+        auto found = std::find_if(std::begin(CONFIGS), std::end(CONFIGS), [&](const BenchmarkConfig& c) { return name == c.name; });
+        if (found == std::end(CONFIGS)) {
+            std::cerr << "Unknown configuration " << name << std::endl;
+            return EXIT_FAILURE;
+        }
+        configs.push_back(&*found);
+    }
+
+    ThreadPool pool(jobs);
+    JsonWriter w;
+    w.beginObject();
+    w.key("threads");
+    w.value(pool.size());
+    w.key("runs");
+    w.beginArray();
+    int failures = 0;
+    std::cout << std::fixed;
+    for (size_t size : sizes) {
+        fs::path folder = fs::path(work) / std::to_string(size);
+        if (!fs::exists(folder / COMPLETE_MARKER)) {
+            std::cout << "Generating " << size << " x " << size << " export in " << folder.string() << std::endl;
+            SyntheticOptions options;
+            options.textureSize = size;
+            std::string err;
+            auto start = std::chrono::steady_clock::now();
+            if (!WriteSyntheticExport(folder.string(), options, pool, err)) {
+                std::cerr << err << std::endl;
+                return EXIT_FAILURE;
+            }
+            std::ofstream(folder / COMPLETE_MARKER) << "size " << size << std::endl;
+            std::cout << "  " << std::setprecision(1)
+                      << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s" << std::endl;
+        }
+        for (const BenchmarkConfig* config : configs) {
+            fs::path output = folder / (std::string("out-") + config->name);
+            fs::path stats = folder / (std::string(config->name) + ".json");
+            fs::path log = folder / (std::string(config->name) + ".log");
+            fs::create_directories(output);
+            fs::remove(stats);
+            std::string command = Quote(converter) + " --jobs " + std::to_string(pool.size()) + " --stats " + Quote(stats.string())
+                + " " + config->arguments + " Terrain " + Quote(folder.string()) + " " + Quote(output.string())
+                + " > " + Quote(log.string()) + " 2>&1";
+#if defined(_WIN64)
+            command = "\"" + command + "\""; // cmd.exe strips the outer quotes
+#endif
+            auto start = std::chrono::steady_clock::now();
+            int status = std::system(command.c_str());
+            double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            std::ifstream statsFile(stats);
+            std::string json((std::istreambuf_iterator<char>(statsFile)), std::istreambuf_iterator<char>());
+            tinygltf::Value stageReport;
+            std::string err;
+            if (status != 0 || json.empty() || !ParseJson(json.data(), json.size(), stageReport, err)) {
+                std::cerr << size << " " << config->name << ": conversion failed, see " << log.string() << std::endl;
+                ++failures;
+                continue;
+            }
+            const tinygltf::Value& bytes = stageReport.Get("bytes");
+            double inputMB = Number(bytes, "inputRead") / 1e6;
+            double outputMB = Number(bytes, "outputWritten") / 1e6;
+            double peakMB = Number(stageReport, "peakRssBytes") / 1e6;
+            std::cout << std::setprecision(2) << std::left << std::setw(6) << size << std::setw(10) << config->name << std::right
+                      << std::setw(9) << wall << " s" << std::setw(10) << inputMB / wall << " MB/s" << std::setw(10) << inputMB
+                      << " MB in" << std::setw(10) << outputMB << " MB out" << std::setw(10) << peakMB << " MB peak" << std::endl;
+            const tinygltf::Value& stages = stageReport.Get("stages");
+            for (size_t i = 0; i < stages.ArrayLen(); ++i) {
+                const tinygltf::Value& stage = stages.Get(static_cast<int>(i));
+                std::cout << "    " << std::left << std::setw(20) << stage.Get("name").Get<std::string>() << std::right
+                          << std::setprecision(3) << std::setw(10) << Number(stage, "seconds") << " s" << std::endl;
+            }
+
+            w.beginObject();
+            w.key("size");
+            w.value(size);
+            w.key("config");
+            w.value(config->name);
+            w.key("arguments");
+            w.value(config->arguments);
+            w.key("wallSeconds");
+            w.value(wall);
+            w.key("inputMBPerSecond");
+            w.value(inputMB / wall);
+            w.key("stats");
+            w.raw(json.substr(0, json.find_last_not_of(" \r\n") + 1));
+            w.endObject();
+        }
+    }
+    w.endArray();
+    w.endObject();
+    if (!report.empty()) {
+        fs::path reportPath(report);
+        if (reportPath.has_parent_path()) {
+            fs::create_directories(reportPath.parent_path());
+        }
+        std::ofstream out(reportPath);
+        out << w.str() << std::endl;
+        std::cout << "Report written to " << report << std::endl;
+    }
+    return failures == 0 ? 0 : EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if (args.empty()) {
+        usage();
+        return EXIT_FAILURE;
+    }
+    std::string command = args[0];
+    args.erase(args.begin());
+    if (command == "generate") {
+        return generate(args);
+    }
+    if (command == "run") {
+        return run(args);
+    }
+    usage();
+    return EXIT_FAILURE;
+}
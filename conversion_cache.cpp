@@ -0,0 +1,365 @@
+#include "conversion_cache.h"
+#include "conversion_stats.h"
+#include <atomic>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+namespace {
+
+const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t Rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t Read64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t Read32(const unsigned char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t XxhRound(uint64_t acc, uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = Rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+inline uint64_t XxhMergeRound(uint64_t acc, uint64_t value) {
+    acc ^= XxhRound(0, value);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+// entry file layout: magic, key, payload size, payload, hash of the payload
+const char ENTRY_MAGIC[4] = { 'W', 'C', 'C', '1' };
+const size_t ENTRY_HEADER = 4 + 8 + 8;
+
+// AttributeView fields and tightly packed data, 4 byte aligned
+void PutAttribute(ByteWriter& out, const AttributeView& view) {
+    out.put<uint64_t>(view.count);
+    out.put<uint64_t>(view.elementSize);
+    out.put<int32_t>(view.componentType);
+    out.put<int32_t>(view.type);
+    out.put<uint32_t>(static_cast<uint32_t>(view.min.size()));
+    for (double v : view.min) {
+        out.put(v);
+    }
+    out.put<uint32_t>(static_cast<uint32_t>(view.max.size()));
+    for (double v : view.max) {
+        out.put(v);
+    }
+    out.align4();
+    if (view.byteStride == view.elementSize) {
+        out.putBytes(view.data, view.byteLength());
+    } else {
+        for (size_t i = 0; i < view.count; ++i) {
+            out.putBytes(view.data + i * view.byteStride, view.elementSize);
+        }
+    }
+}
+
+bool GetDoubles(ByteReader& in, std::vector<double>& values) {
+    uint32_t count;
+    if (!in.get(count) || count > 16) {
+        return false;
+    }
+    values.resize(count);
+    for (double& v : values) {
+        if (!in.get(v)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool GetAttribute(ByteReader& in, const std::shared_ptr<const std::vector<unsigned char>>& entry, AttributeView& view) {
+    uint64_t count, elementSize;
+    int32_t componentType, type;
+    if (!in.get(count) || !in.get(elementSize) || !in.get(componentType) || !in.get(type)
+        || !GetDoubles(in, view.min) || !GetDoubles(in, view.max) || !in.align4()) {
+        return false;
+    }
+    view.count = static_cast<size_t>(count);
+    view.elementSize = static_cast<size_t>(elementSize);
+    view.byteStride = view.elementSize;
+    view.componentType = componentType;
+    view.type = type;
+    view.data = in.skip(view.byteLength());
+    view.owner = entry;
+    return view.data != nullptr || view.count == 0;
+}
+
+} // namespace
+
+uint64_t Hash64(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* end = p + size;
+    uint64_t h;
+    if (size >= 32) {
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+        const unsigned char* limit = end - 32;
+        do {
+            v1 = XxhRound(v1, Read64(p));
+            v2 = XxhRound(v2, Read64(p + 8));
+            v3 = XxhRound(v3, Read64(p + 16));
+            v4 = XxhRound(v4, Read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = Rotl64(v1, 1) + Rotl64(v2, 7) + Rotl64(v3, 12) + Rotl64(v4, 18);
+        h = XxhMergeRound(h, v1);
+        h = XxhMergeRound(h, v2);
+        h = XxhMergeRound(h, v3);
+        h = XxhMergeRound(h, v4);
+    } else {
+        h = seed + PRIME64_5;
+    }
+    h += static_cast<uint64_t>(size);
+    for (; p + 8 <= end; p += 8) {
+        h ^= XxhRound(0, Read64(p));
+        h = Rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<uint64_t>(Read32(p)) * PRIME64_1;
+        h = Rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= *p * PRIME64_5;
+        h = Rotl64(h, 11) * PRIME64_1;
+    }
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+void ByteWriter::putBytes(const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    buffer.insert(buffer.end(), p, p + size);
+}
+
+void ByteWriter::putString(const std::string& text) {
+    put<uint64_t>(text.size());
+    putBytes(text.data(), text.size());
+}
+
+void ByteWriter::align4() {
+    buffer.resize((buffer.size() + 3) & ~size_t(3), 0);
+}
+
+bool ByteReader::getBytes(void* data, size_t size) {
+    const unsigned char* p = skip(size);
+    if (!p) {
+        return false;
+    }
+    std::memcpy(data, p, size);
+    return true;
+}
+
+bool ByteReader::getString(std::string& text) {
+    uint64_t size;
+    const unsigned char* p;
+    if (!get(size) || !(p = skip(static_cast<size_t>(size)))) {
+        return false;
+    }
+    text.assign(reinterpret_cast<const char*>(p), static_cast<size_t>(size));
+    return true;
+}
+
+const unsigned char* ByteReader::skip(size_t size) {
+    if (size > static_cast<size_t>(end - pos)) {
+        pos = end;
+        return nullptr;
+    }
+    const unsigned char* p = pos;
+    pos += size;
+    return p;
+}
+
+bool ByteReader::align4() {
+    size_t offset = static_cast<size_t>(pos - begin);
+    return skip(((offset + 3) & ~size_t(3)) - offset) != nullptr;
+}
+
+ConversionCache::ConversionCache(const std::string& folder, bool keepInMemory) : folder(folder), keepInMemory(keepInMemory) {
+    if (!folder.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(folder, ec);
+    }
+}
+
+std::string ConversionCache::entryPath(uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.wcc", static_cast<unsigned long long>(key));
+    return (std::filesystem::path(folder) / name).string();
+}
+
+std::shared_ptr<const std::vector<unsigned char>> ConversionCache::load(uint64_t key) const {
+    if (keepInMemory) {
+        std::lock_guard<std::mutex> lock(memoryMutex);
+        auto found = memory.find(key);
+        if (found != memory.end()) {
+            found->second.used = true;
+            return found->second.data;
+        }
+    }
+    if (folder.empty()) {
+        return nullptr;
+    }
+    auto data = loadFile(key);
+    if (data) {
+        keep(key, data);
+    }
+    return data;
+}
+
+void ConversionCache::keep(uint64_t key, std::shared_ptr<const std::vector<unsigned char>> data) const {
+    if (keepInMemory) {
+        std::lock_guard<std::mutex> lock(memoryMutex);
+        memory[key] = { std::move(data), true };
+    }
+}
+
+void ConversionCache::trimMemory() {
+    std::lock_guard<std::mutex> lock(memoryMutex);
+    for (auto it = memory.begin(); it != memory.end();) {
+        if (it->second.used) {
+            it->second.used = false;
+            ++it;
+        } else {
+            it = memory.erase(it);
+        }
+    }
+}
+
+std::shared_ptr<const std::vector<unsigned char>> ConversionCache::loadFile(uint64_t key) const {
+    std::ifstream in(entryPath(key), std::ios::binary);
+    if (!in) {
+        return nullptr;
+    }
+    char magic[4];
+    uint64_t storedKey = 0, size = 0, hash = 0;
+    in.read(magic, 4);
+    in.read(reinterpret_cast<char*>(&storedKey), 8);
+    in.read(reinterpret_cast<char*>(&size), 8);
+    if (!in || std::memcmp(magic, ENTRY_MAGIC, 4) != 0 || storedKey != key) {
+        return nullptr;
+    }
+    auto data = std::make_shared<std::vector<unsigned char>>();
+    std::error_code ec;
+    if (size + ENTRY_HEADER + 8 != std::filesystem::file_size(entryPath(key), ec)) {
+        return nullptr;
+    }
+    data->resize(static_cast<size_t>(size));
+    in.read(reinterpret_cast<char*>(data->data()), static_cast<std::streamsize>(size));
+    in.read(reinterpret_cast<char*>(&hash), 8);
+    if (!in || hash != Hash64(data->data(), data->size())) {
+        return nullptr;
+    }
+    Stats().addBytes(ByteCounter::CacheRead, data->size());
+    return data;
+}
+
+void ConversionCache::store(uint64_t key, std::vector<unsigned char>&& entry) const {
+    auto shared = std::make_shared<const std::vector<unsigned char>>(std::move(entry));
+    keep(key, shared);
+    if (folder.empty()) {
+        return;
+    }
+    const std::vector<unsigned char>& data = *shared;
+    // unique temporary name, conversions of a batch may store the same entry at the same time
+    static std::atomic<uint64_t> counter{ 0 };
+    std::string path = entryPath(key);
+    std::string temp = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id()))
+        + "." + std::to_string(counter++) + ".tmp";
+    {
+        std::ofstream out(temp, std::ios::binary);
+        uint64_t size = data.size();
+        uint64_t hash = Hash64(data.data(), data.size());
+        out.write(ENTRY_MAGIC, 4);
+        out.write(reinterpret_cast<const char*>(&key), 8);
+        out.write(reinterpret_cast<const char*>(&size), 8);
+        out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+        out.write(reinterpret_cast<const char*>(&hash), 8);
+        if (!out) {
+            out.close();
+            std::remove(temp.c_str());
+            return;
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp, path, ec);
+    if (ec) {
+        std::filesystem::remove(temp, ec);
+        return;
+    }
+    Stats().addBytes(ByteCounter::CacheWritten, data.size());
+}
+
+std::vector<unsigned char> SerializeTiles(const std::vector<TerrainTile>& tiles) {
+    ByteWriter out;
+    out.put<uint64_t>(tiles.size());
+    for (const TerrainTile& tile : tiles) {
+        out.put<uint64_t>(tile.x);
+        out.put<uint64_t>(tile.y);
+        out.put<uint64_t>(tile.lods.size());
+        for (const auto& parts : tile.lods) {
+            out.put<uint64_t>(parts.size());
+            for (const MeshPart& part : parts) {
+                PutAttribute(out, part.positions);
+                PutAttribute(out, part.normals);
+                PutAttribute(out, part.texCoords);
+                PutAttribute(out, part.indices);
+            }
+        }
+    }
+    return std::move(out.bytes());
+}
+
+bool DeserializeTiles(const std::shared_ptr<const std::vector<unsigned char>>& entry, std::vector<TerrainTile>& tiles) {
+    ByteReader in(entry->data(), entry->size());
+    uint64_t tileCount;
+    if (!in.get(tileCount) || tileCount > entry->size()) {
+        return false;
+    }
+    tiles.resize(static_cast<size_t>(tileCount));
+    for (TerrainTile& tile : tiles) {
+        uint64_t x, y, lodCount;
+        if (!in.get(x) || !in.get(y) || !in.get(lodCount) || lodCount > entry->size()) {
+            return false;
+        }
+        tile.x = static_cast<size_t>(x);
+        tile.y = static_cast<size_t>(y);
+        tile.lods.resize(static_cast<size_t>(lodCount));
+        for (auto& parts : tile.lods) {
+            uint64_t partCount;
+            if (!in.get(partCount) || partCount > entry->size()) {
+                return false;
+            }
+            parts.resize(static_cast<size_t>(partCount));
+            for (MeshPart& part : parts) {
+                if (!GetAttribute(in, entry, part.positions) || !GetAttribute(in, entry, part.normals)
+                    || !GetAttribute(in, entry, part.texCoords) || !GetAttribute(in, entry, part.indices)) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "terrain_tiles.h"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// part of every cache key, increase it when an encoder or mesh stage produces different output
+const uint64_t CACHE_VERSION = 2;
+
+// 64 bit xxHash (XXH64) of size bytes
+uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0);
+
+// cache key chained from the contents of the input files and the conversion options that affect a result
+class CacheKey {
+public:
+    explicit CacheKey(const std::string& kind) { add(kind); }
+    CacheKey& add(uint64_t number) { return addBytes(&number, sizeof(number)); }
+    CacheKey& add(const std::string& text) { add(text.size()); return addBytes(text.data(), text.size()); }
+    CacheKey& addFloat(float number) { return addBytes(&number, sizeof(number)); }
+    CacheKey& addBytes(const void* data, size_t size) { hash = Hash64(data, size, hash); return *this; }
+    uint64_t value() const { return hash; }
+
+private:
+    uint64_t hash = 0;
+};
+
+// append fields of a cache entry to a byte buffer
+class ByteWriter {
+public:
+    template <typename T>
+    void put(const T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "plain values only");
+        putBytes(&value, sizeof(T));
+    }
+    void putBytes(const void* data, size_t size);
+    void putString(const std::string& text);
+    // zero bytes up to a multiple of 4, so attribute data can be used in place
+    void align4();
+    std::vector<unsigned char>& bytes() { return buffer; }
+
+private:
+    std::vector<unsigned char> buffer;
+};
+
+// read back what ByteWriter wrote, every read fails once the data is exhausted
+class ByteReader {
+public:
+    ByteReader(const unsigned char* data, size_t size) : pos(data), begin(data), end(data + size) {}
+    template <typename T>
+    bool get(T& value) {
+        static_assert(std::is_trivially_copyable<T>::value, "plain values only");
+        return getBytes(&value, sizeof(T));
+    }
+    bool getBytes(void* data, size_t size);
+    bool getString(std::string& text);
+    // pointer to size bytes in place, nullptr if there are not enough
+    const unsigned char* skip(size_t size);
+    bool align4();
+
+private:
+    const unsigned char* pos;
+    const unsigned char* begin;
+    const unsigned char* end;
+};
+
+// Conversion results keyed by CacheKey, so unchanged maps and meshes are not processed again.
+// Entries are kept in a folder and, for watch mode, in memory. Entries are written to a temporary file and
+// renamed, so concurrent conversions never see partial entries. A cache that cannot be read or written only
+// costs the conversion time, it never fails a conversion
+class ConversionCache {
+public:
+    // empty folder: memory only
+    ConversionCache(const std::string& folder, bool keepInMemory);
+
+    // entry for key, nullptr if there is none or it is damaged
+    std::shared_ptr<const std::vector<unsigned char>> load(uint64_t key) const;
+    void store(uint64_t key, std::vector<unsigned char>&& data) const;
+
+    // drop memory entries that were not loaded or stored since the last call
+    void trimMemory();
+
+private:
+    struct MemoryEntry {
+        std::shared_ptr<const std::vector<unsigned char>> data;
+        bool used = true;
+    };
+    std::string entryPath(uint64_t key) const;
+    std::shared_ptr<const std::vector<unsigned char>> loadFile(uint64_t key) const;
+    void keep(uint64_t key, std::shared_ptr<const std::vector<unsigned char>> data) const;
+
+    std::string folder;
+    bool keepInMemory;
+    mutable std::mutex memoryMutex;
+    mutable std::unordered_map<uint64_t, MemoryEntry> memory;
+};
+
+// tiles with all level meshes as a cache entry. A mesh without tiling is one tile with one level
+std::vector<unsigned char> SerializeTiles(const std::vector<TerrainTile>& tiles);
+
+// tiles read back from an entry, attribute views point into entry and keep it alive
+bool DeserializeTiles(const std::shared_ptr<const std::vector<unsigned char>>& entry, std::vector<TerrainTile>& tiles);
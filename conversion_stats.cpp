@@ -0,0 +1,179 @@
+#include "conversion_stats.h"
+#include "gltf_json.h"
+#include <algorithm>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+
+#if defined(_WIN64)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+const char* COUNTER_NAMES[] = { "inputRead", "outputWritten", "cacheRead", "cacheWritten" };
+
+} // namespace
+
+ConversionStats::ConversionStats() : start(std::chrono::steady_clock::now()) {
+}
+
+void ConversionStats::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    start = std::chrono::steady_clock::now();
+    stageOrder.clear();
+    stages.clear();
+    files.clear();
+    terrains.clear();
+    std::fill(std::begin(bytes), std::end(bytes), 0);
+}
+
+void ConversionStats::addStage(const char* stage, double seconds, const std::string& file) {
+    if (!enabled) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = stages.find(stage);
+    if (found == stages.end()) {
+        stageOrder.push_back(stage);
+        found = stages.emplace(stage, Stage()).first;
+    }
+    found->second.count++;
+    found->second.seconds += seconds;
+    found->second.maxSeconds = std::max(found->second.maxSeconds, seconds);
+    if (!file.empty()) {
+        files.push_back({ file, stage, seconds });
+    }
+}
+
+void ConversionStats::addBytes(ByteCounter counter, uint64_t count) {
+    if (!enabled) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    bytes[static_cast<size_t>(counter)] += count;
+}
+
+void ConversionStats::addTerrain(const std::string& name, bool ok, double seconds, uint64_t inputBytes, uint64_t outputBytes) {
+    if (!enabled) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    terrains.push_back({ name, ok, seconds, inputBytes, outputBytes });
+}
+
+std::string ConversionStats::json(size_t threads) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    JsonWriter w;
+    w.beginObject();
+    w.key("version");
+    w.value(1);
+    w.key("threads");
+    w.value(threads);
+    w.key("wallSeconds");
+    w.value(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    w.key("peakRssBytes");
+    w.value(static_cast<size_t>(PeakResidentBytes()));
+    w.key("bytes");
+    w.beginObject();
+    for (size_t i = 0; i < static_cast<size_t>(ByteCounter::Count); ++i) {
+        w.key(COUNTER_NAMES[i]);
+        w.value(static_cast<size_t>(bytes[i]));
+    }
+    w.endObject();
+    w.key("stages");
+    w.beginArray();
+    for (const auto& name : stageOrder) {
+        const Stage& stage = stages.at(name);
+        w.beginObject();
+        w.key("name");
+        w.value(name);
+        w.key("count");
+        w.value(stage.count);
+        w.key("seconds");
+        w.value(stage.seconds);
+        w.key("maxSeconds");
+        w.value(stage.maxSeconds);
+        w.endObject();
+    }
+    w.endArray();
+    w.key("textures");
+    w.beginArray();
+    for (const auto& timing : files) {
+        w.beginObject();
+        w.key("file");
+        w.value(timing.file);
+        w.key("stage");
+        w.value(timing.stage);
+        w.key("seconds");
+        w.value(timing.seconds);
+        w.endObject();
+    }
+    w.endArray();
+    w.key("terrains");
+    w.beginArray();
+    for (const auto& terrain : terrains) {
+        w.beginObject();
+        w.key("name");
+        w.value(terrain.name);
+        w.key("ok");
+        w.value(terrain.ok);
+        w.key("seconds");
+        w.value(terrain.seconds);
+        w.key("inputBytes");
+        w.value(static_cast<size_t>(terrain.inputBytes));
+        w.key("outputBytes");
+        w.value(static_cast<size_t>(terrain.outputBytes));
+        w.endObject();
+    }
+    w.endArray();
+    w.endObject();
+    return w.str();
+}
+
+std::string ConversionStats::summary() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "Stage                    count   seconds       max" << std::endl;
+    for (const auto& name : stageOrder) {
+        const Stage& stage = stages.at(name);
+        out << std::left << std::setw(24) << name << std::right << std::setw(6) << stage.count
+            << std::setw(10) << stage.seconds << std::setw(10) << stage.maxSeconds << std::endl;
+    }
+    const double MB = 1e6;
+    out << std::setprecision(1) << "Read " << bytes[0] / MB << " MB, wrote " << bytes[1] / MB << " MB, cache read "
+        << bytes[2] / MB << " MB, cache written " << bytes[3] / MB << " MB, peak memory "
+        << PeakResidentBytes() / MB << " MB" << std::endl;
+    return out.str();
+}
+
+ConversionStats& Stats() {
+    static ConversionStats stats;
+    return stats;
+}
+
+uint64_t PeakResidentBytes() {
+#if defined(_WIN64)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return static_cast<uint64_t>(usage.ru_maxrss); // bytes
+#else
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#endif
+}
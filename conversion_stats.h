@@ -0,0 +1,99 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// byte counters of ConversionStats
+enum class ByteCounter {
+    InputRead,     // export files of converted terrains
+    OutputWritten, // glb files
+    CacheRead,
+    CacheWritten,
+    Count
+};
+
+// Timings and byte counts of all conversions of this process, collected from every thread.
+// Stage times add up the time of all threads, so a parallel stage can take longer than the wall time.
+// Nothing is collected until collection is enabled, so processes that never report pay nothing
+class ConversionStats {
+public:
+    ConversionStats();
+
+    // start or stop collecting, off by default
+    void setEnabled(bool enable) { enabled = enable; }
+    bool isEnabled() const { return enabled; }
+    // drop everything collected so far and restart the wall time, e.g. after a report
+    void reset();
+
+    // file is set for per texture stages like decode or encode
+    void addStage(const char* stage, double seconds, const std::string& file);
+    void addBytes(ByteCounter counter, uint64_t bytes);
+    void addTerrain(const std::string& name, bool ok, double seconds, uint64_t inputBytes, uint64_t outputBytes);
+
+    // report with stages, textures, terrains, byte counters and peak memory
+    std::string json(size_t threads) const;
+    // human readable summary, one line per stage
+    std::string summary() const;
+
+private:
+    struct Stage {
+        size_t count = 0;
+        double seconds = 0.0;
+        double maxSeconds = 0.0;
+    };
+    struct FileTiming {
+        std::string file;
+        const char* stage;
+        double seconds;
+    };
+    struct Terrain {
+        std::string name;
+        bool ok;
+        double seconds;
+        uint64_t inputBytes;
+        uint64_t outputBytes;
+    };
+
+    std::atomic<bool> enabled{ false };
+    mutable std::mutex mutex;
+    std::chrono::steady_clock::time_point start;
+    std::vector<std::string> stageOrder; // stages in order of their first timing
+    std::map<std::string, Stage> stages;
+    std::vector<FileTiming> files;
+    std::vector<Terrain> terrains;
+    uint64_t bytes[static_cast<size_t>(ByteCounter::Count)] = {};
+};
+
+// stats of this process
+ConversionStats& Stats();
+
+// adds the time from construction to destruction to a stage of Stats(), if it collects
+class ScopedTimer {
+public:
+    explicit ScopedTimer(const char* stage, const std::string& file = std::string())
+        : stage(Stats().isEnabled() ? stage : nullptr), file(this->stage ? file : std::string()),
+          start(this->stage ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point()) {}
+    ~ScopedTimer() { stop(); }
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    // end the timing before the scope ends
+    void stop() {
+        if (stage) {
+            Stats().addStage(stage, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), file);
+            stage = nullptr;
+        }
+    }
+
+private:
+    const char* stage;
+    std::string file;
+    std::chrono::steady_clock::time_point start;
+};
+
+// largest resident set size of the process so far in bytes, 0 if the platform does not report it
+uint64_t PeakResidentBytes();
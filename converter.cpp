@@ -0,0 +1,1275 @@
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "tiny_gltf.h"
+#include "converter.h"
+#include "thread_pool.h"
+#include "glb_writer.h"
+#include "gltf_validate.h"
+#include "mesh_input.h"
+#include "heightmap_input.h"
+#include "mesh_quantize.h"
+#include "mesh_optimize.h"
+#include "terrain_tiles.h"
+#include "ktx2_writer.h"
+#include "png_writer.h"
+#include "texture_kernels.h"
+#include "conversion_cache.h"
+#include "conversion_stats.h"
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <future>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+// progress message to the log callback of the options, only formatted when someone listens
+#define Progress(log, x)\
+{\
+    if (log) {\
+        std::ostringstream progress; progress << x; \
+        (log)(progress.str()); \
+    }\
+}
+
+namespace {
+
+// bytes of an input while it is converted. owner keeps mapped or read data alive, it is empty for caller memory
+struct InputData {
+    std::string name;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    std::shared_ptr<const void> owner;
+};
+
+// name of an input in messages and for the material slot
+const std::string& InputName(const ConvertInput& input) {
+    return input.name.empty() ? input.path : input.name;
+}
+
+// true if the input has a file, bytes or a reader
+bool HasInput(const ConvertInput& input) {
+    return !InputName(input).empty() || input.data || input.read;
+}
+
+// borrow, read or map the bytes of an input
+bool ReadInput(const ConvertInput& input, InputData& bytes, std::string& err) {
+    ScopedTimer timer("input read", InputName(input));
+    bytes.name = InputName(input);
+    if (input.data) {
+        bytes.data = input.data;
+        bytes.size = input.size;
+        return true;
+    }
+    if (input.read) {
+        auto buffer = std::make_shared<std::vector<unsigned char>>();
+        if (!input.read(*buffer, err)) {
+            err = "Cannot read " + bytes.name + ": " + err;
+            return false;
+        }
+        bytes.data = buffer->data();
+        bytes.size = buffer->size();
+        bytes.owner = std::move(buffer);
+        return true;
+    }
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(input.path, err)) {
+        return false;
+    }
+    bytes.data = file->data();
+    bytes.size = file->size();
+    bytes.owner = std::move(file);
+    return true;
+}
+
+// Function to decode a texture using stb_image. desiredChannels 0 keeps the channels of the png,
+// channels is always set to the channel count of the returned data
+unsigned char* LoadTextureData(const InputData& input, int& width, int& height, int& channels, int desiredChannels,
+    std::string& err) {
+    ScopedTimer timer("png decode", input.name);
+    unsigned char* data = nullptr;
+    if (input.size <= INT_MAX) {
+        data = stbi_load_from_memory(input.data, static_cast<int>(input.size), &width, &height, &channels, desiredChannels);
+    }
+    if (!data) {
+        err = "Failed to load texture: " + input.name;
+        return nullptr;
+    }
+    if (desiredChannels != 0) {
+        channels = desiredChannels;
+    }
+    return data;
+}
+
+// Function to read size and channel count from the IHDR chunk of a png file without decoding it.
+// Returns false if the file is not a png, or not 8 bits per channel
+bool ReadPngHeader(const InputData& input, int& width, int& height, int& channels) {
+    // signature (8), IHDR length (4), chunk type (4), width (4), height (4), bit depth (1), color type (1)
+    if (input.size < 26) {
+        return false;
+    }
+    const unsigned char* header = input.data;
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    if (std::memcmp(header, signature, 8) != 0 || std::memcmp(header + 12, "IHDR", 4) != 0) {
+        return false;
+    }
+    auto readBigEndian = [](const unsigned char* p) {
+        return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+    };
+    width = static_cast<int>(readBigEndian(header + 16));
+    height = static_cast<int>(readBigEndian(header + 20));
+    int bitDepth = header[24];
+    int colorType = header[25];
+    if (bitDepth != 8) {
+        return false;
+    }
+    switch (colorType) {
+    case 0: channels = 1; break; // grayscale
+    case 2: channels = 3; break; // rgb
+    case 3: channels = 3; break; // palette, expanded to rgb by decoders
+    case 4: channels = 2; break; // grayscale + alpha
+    case 6: channels = 4; break; // rgba
+    default: return false;
+    }
+    return width > 0 && height > 0;
+}
+
+// texture extension for block compressed KTX2 images. KHR_texture_basisu only allows Basis Universal payloads
+const char* const KTX2_TEXTURE_EXTENSION = "WC_texture_ktx2";
+
+// integer vertex attributes, required by every quantized mesh
+const char* const QUANTIZATION_EXTENSION = "KHR_mesh_quantization";
+
+// image that finished its decode / merge / encode job and waits to be added to the model
+struct EncodedImage {
+    tinygltf::Image image;
+    std::shared_ptr<const std::vector<unsigned char>> data; // encoded png or ktx2 file, shared by variants of the same size
+    std::string mimeType = "image/png";
+    InputData passthrough; // if set, data is null and the source png is copied to the glb unchanged
+    size_t byteLength = 0;
+    bool uniform = false; // constant map without image, the material uses uniformValue instead
+    std::array<uint8_t, 4> uniformValue = { 255, 255, 255, 255 };
+    ConvertStatus status = ConvertStatus::Ok; // failed jobs set status and error, the conversion returns them
+    std::string error;
+};
+
+// result of a texture job that failed
+EncodedImage FailedImage(ConvertStatus status, const std::string& error) {
+    EncodedImage encoded;
+    encoded.status = status;
+    encoded.error = error;
+    return encoded;
+}
+
+// material slot a texture job is bound to
+enum class TextureSlot {
+    BaseColor,
+    Normal,
+    Occlusion,
+    MetallicRoughness,
+    OcclusionRoughnessMetallic // occlusion packed into the red channel of the metallicRoughness texture
+};
+
+// how textures are stored in the glb
+struct TextureSettings {
+    bool passthrough = true; // embed 8 bit source pngs without decoding them
+    bool ktx2 = false; // block compressed KTX2 instead of png
+    bool orm = false; // occlusion in the red channel of the metallicRoughness texture
+    std::vector<size_t> maxSizes = { 0 }; // texture size limit of every output variant, 0: exported size
+    PngLevel pngLevel = PngLevel::Default; // speed / size of png encoding
+    ConvertLog log; // progress messages, from the pool threads
+};
+
+// running texture job, jobs are started in a fixed order and collected in the same order
+struct TextureJob {
+    TextureSlot slot;
+    std::future<std::vector<EncodedImage>> result; // one image per variant
+    std::vector<EncodedImage> variants; // result, once the job is finished
+};
+
+// result of a texture job that failed, in place of the images of all variants
+std::vector<EncodedImage> FailedImages(ConvertStatus status, const std::string& error) {
+    return { FailedImage(status, error) };
+}
+
+// encode raw image data to png, bands of rows are compressed in parallel on the pool.
+// Does not touch the model, so it is safe to call from worker threads
+EncodedImage EncodeImage(const tinygltf::Image& image, const unsigned char* data, PngLevel level, ThreadPool& pool) {
+    ScopedTimer timer("png encode");
+    EncodedImage encoded;
+    encoded.image = image;
+    auto png = std::make_shared<std::vector<unsigned char>>(EncodePng(data, image.width, image.height, image.component, level, pool));
+    if (png->empty()) {
+        return FailedImage(ConvertStatus::TextureError, "Failed to write PNG image to buffer");
+    }
+    encoded.data = std::move(png);
+    encoded.byteLength = encoded.data->size();
+    return encoded;
+}
+
+// plan the image in the glb binary chunk and create BufferView for an image.
+// Image bytes are streamed to the output file when the glb is written
+void handleImage(tinygltf::Model& model, GlbWriter& writer, EncodedImage& encoded) {
+    tinygltf::Image& image = encoded.image;
+
+    GlbWriter::SegmentWriter imageWriter;
+    if (encoded.passthrough.data) {
+        // source png is copied from the input during write
+        imageWriter = SpanSegment(encoded.passthrough.data, encoded.byteLength, encoded.passthrough.owner);
+    } else {
+        imageWriter = SpanSegment(encoded.data->data(), encoded.byteLength, encoded.data);
+    }
+    // Add the buffer view to the model, no specific target
+    // Set the buffer view for the image
+    image.bufferView = writer.addBufferView(model, encoded.byteLength, 0, std::move(imageWriter));
+    image.mimeType = encoded.mimeType;
+}
+
+// block compression of a material slot: BC7 for color data, two channel BC5 for normals, BC4 for occlusion
+void Ktx2Settings(TextureSlot slot, BcFormat& format, MipFilter& filter) {
+    format = BcFormat::BC7;
+    filter = MipFilter::Linear;
+    switch (slot) {
+    case TextureSlot::BaseColor: format = BcFormat::BC7; filter = MipFilter::Srgb; break;
+    case TextureSlot::Normal: format = BcFormat::BC5; filter = MipFilter::Normal; break;
+    case TextureSlot::Occlusion: format = BcFormat::BC4; filter = MipFilter::Linear; break;
+    case TextureSlot::MetallicRoughness:
+    case TextureSlot::OcclusionRoughnessMetallic: format = BcFormat::BC7; filter = MipFilter::Linear; break;
+    }
+}
+
+// compress rgba image data to a KTX2 file with full mip chain.
+// Blocks are compressed in parallel on the pool, safe to call from a pool task
+EncodedImage EncodeImageKtx2(const tinygltf::Image& image, const unsigned char* data, TextureSlot slot, ThreadPool& pool) {
+    ScopedTimer timer("ktx2 encode");
+    BcFormat format;
+    MipFilter filter;
+    Ktx2Settings(slot, format, filter);
+    EncodedImage encoded;
+    encoded.image = image;
+    encoded.data = std::make_shared<std::vector<unsigned char>>(EncodeKtx2(data, image.width, image.height, format, filter, pool));
+    encoded.mimeType = "image/ktx2";
+    encoded.byteLength = encoded.data->size();
+    return encoded;
+}
+
+// tolerance in 8 bit steps up to which a map counts as constant
+const int UNIFORM_TOLERANCE = 2;
+
+// Embedded pngs are only decoded to look for a constant map if they compress better than this. Constant exports
+// compress 300:1 to 1000:1, maps with any detail stay below 100:1
+const size_t CONSTANT_MAP_RATIO = 200;
+
+// png embedded as it is, copied from the input when the glb is written
+EncodedImage PassthroughImage(const InputData& input, int width, int height, int channels, const ConvertLog& log) {
+    EncodedImage encoded;
+    encoded.image.width = width;
+    encoded.image.height = height;
+    encoded.image.component = channels;
+    encoded.image.bits = 8;
+    encoded.image.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+    encoded.passthrough = input;
+    encoded.byteLength = input.size;
+    Progress(log, "Embedding png unchanged: " << input.name);
+    return encoded;
+}
+
+// Check decoded map data for a constant value. Color and metallic roughness become material factors,
+// flat normal maps and white occlusion maps are dropped: the result has uniform set and no image.
+// Other constant maps are reduced to a single pixel. Returns false if the map has detail
+bool CollapseUniformMap(const unsigned char* data, int width, int height, int channels, TextureSlot slot,
+    const TextureSettings& settings, ThreadPool& pool, EncodedImage& encoded) {
+    uint8_t value[4];
+    {
+        ScopedTimer timer("uniform check");
+        if (!IsNearUniform(data, static_cast<size_t>(width) * height, channels, UNIFORM_TOLERANCE, value)) {
+            return false;
+        }
+    }
+    if (channels < 3) {
+        // grayscale (+ alpha) expands to rgb (+ alpha)
+        value[3] = channels == 2 ? value[1] : 255;
+        value[1] = value[2] = value[0];
+    }
+    bool flatNormal = std::abs(value[0] - 128) <= UNIFORM_TOLERANCE && std::abs(value[1] - 128) <= UNIFORM_TOLERANCE
+        && value[2] >= 255 - UNIFORM_TOLERANCE;
+    bool whiteOcclusion = value[0] >= 255 - UNIFORM_TOLERANCE;
+    if (slot == TextureSlot::BaseColor || slot == TextureSlot::MetallicRoughness
+        || (slot == TextureSlot::Normal && flatNormal) || (slot == TextureSlot::Occlusion && whiteOcclusion)) {
+        encoded.uniform = true;
+        std::copy(value, value + 4, encoded.uniformValue.begin());
+        return true;
+    }
+    int pixelChannels = settings.ktx2 ? 4 : channels;
+    tinygltf::Image image{};
+    image.width = 1;
+    image.height = 1;
+    image.component = pixelChannels;
+    image.bits = 8;
+    image.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+    encoded = settings.ktx2 ? EncodeImageKtx2(image, value, slot, pool) : EncodeImage(image, value, settings.pngLevel, pool);
+    return true;
+}
+
+// number of times a map is halved until width and height fit into maxSize, 0: no limit
+int Halvings(int width, int height, size_t maxSize) {
+    int halvings = 0;
+    while (maxSize > 0 && static_cast<size_t>(std::max(width, height)) > maxSize) {
+        width = std::max(1, width / 2);
+        height = std::max(1, height / 2);
+        ++halvings;
+    }
+    return halvings;
+}
+
+// Encode decoded map data for every variant in settings.maxSizes. Each smaller size is halved from the next
+// larger one, with the filter of the mip chain, so the map is decoded once. Sizes shared by several variants
+// are encoded once, different sizes in parallel. passthrough is the source png, embedded unchanged where
+// the map keeps its size. Returns one image per variant
+std::vector<EncodedImage> EncodeSizes(const tinygltf::Image& image, const unsigned char* data, TextureSlot slot,
+    const TextureSettings& settings, ThreadPool& pool, const InputData* passthrough) {
+    std::vector<int> halvings;
+    for (size_t maxSize : settings.maxSizes) {
+        halvings.push_back(Halvings(image.width, image.height, maxSize));
+    }
+    std::vector<int> levels = halvings;
+    std::sort(levels.begin(), levels.end());
+    levels.erase(std::unique(levels.begin(), levels.end()), levels.end());
+
+    // level 0 is the decoded map
+    BcFormat format;
+    MipFilter filter;
+    Ktx2Settings(slot, format, filter);
+    std::vector<tinygltf::Image> levelImages = { image };
+    std::vector<std::vector<uint8_t>> levelData(1);
+    if (levels.back() > 0) {
+        ScopedTimer timer("downsample");
+        for (int level = 1; level <= levels.back(); ++level) {
+            const tinygltf::Image& previous = levelImages.back();
+            const unsigned char* pixels = level == 1 ? data : levelData.back().data();
+            tinygltf::Image next = previous;
+            levelData.push_back(Downsample(pixels, previous.width, previous.height, previous.component, filter, pool,
+                next.width, next.height));
+            levelImages.push_back(next);
+        }
+        Progress(settings.log, "Downscaled map from " << image.width << " x " << image.height << " to " << levelImages.back().width
+            << " x " << levelImages.back().height);
+    }
+
+    std::vector<EncodedImage> encodedLevels(levels.size());
+    pool.parallelFor(levels.size(), [&](size_t i) {
+        int level = levels[i];
+        const unsigned char* pixels = level == 0 ? data : levelData[level].data();
+        if (level == 0 && passthrough) {
+            encodedLevels[i] = PassthroughImage(*passthrough, image.width, image.height, image.component, settings.log);
+        } else if (settings.ktx2) {
+            encodedLevels[i] = EncodeImageKtx2(levelImages[level], pixels, slot, pool);
+        } else {
+            encodedLevels[i] = EncodeImage(levelImages[level], pixels, settings.pngLevel, pool);
+        }
+    });
+    std::vector<EncodedImage> encoded;
+    for (int level : halvings) {
+        encoded.push_back(encodedLevels[std::lower_bound(levels.begin(), levels.end(), level) - levels.begin()]);
+    }
+    return encoded;
+}
+
+// Function to encode a png map for embedding, one image per variant.
+// 8 bit pngs are embedded as they are if passthrough is enabled and they keep their size, everything else is
+// decoded and encoded again. Constant maps are collapsed to material factors or a single pixel
+std::vector<EncodedImage> EncodeTexture(const InputData& input, TextureSlot slot, const TextureSettings& settings, ThreadPool& pool) {
+    int width, height, channels;
+    bool passthrough = settings.passthrough && !settings.ktx2 && ReadPngHeader(input, width, height, channels);
+    bool downscaled = passthrough && std::any_of(settings.maxSizes.begin(), settings.maxSizes.end(), [&](size_t maxSize) {
+        return Halvings(width, height, maxSize) > 0;
+    });
+    // a png that compresses worse than CONSTANT_MAP_RATIO:1 has too much detail to be constant, it is not decoded at all
+    if (passthrough && !downscaled && input.size * CONSTANT_MAP_RATIO > static_cast<size_t>(width) * height * channels) {
+        return std::vector<EncodedImage>(settings.maxSizes.size(), PassthroughImage(input, width, height, channels, settings.log));
+    }
+    // block compression always works on rgba
+    std::string err;
+    unsigned char* data = LoadTextureData(input, width, height, channels, settings.ktx2 ? 4 : 0, err);
+    if (!data) {
+        return FailedImages(ConvertStatus::TextureError, err);
+    }
+
+    EncodedImage encoded;
+    if (CollapseUniformMap(data, width, height, channels, slot, settings, pool, encoded)) {
+        Progress(settings.log, "Constant map, not embedded at full size: " << input.name);
+        stbi_image_free(data);
+        return std::vector<EncodedImage>(settings.maxSizes.size(), encoded);
+    }
+
+    // Create a tinygltf::Image
+    tinygltf::Image image{};
+    image.width = width;
+    image.height = height;
+    image.component = channels;
+    image.bits = 8;
+    image.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+
+    // do not set uri, as we are embedding the image
+    //image.uri = filePath;
+    std::vector<EncodedImage> variants = EncodeSizes(image, data, slot, settings, pool, passthrough ? &input : nullptr);
+    stbi_image_free(data);
+    return variants;
+}
+
+// Function to create a tinygltf texture from an encoded image.
+// KTX2 images are only referenced through the WC_texture_ktx2 extension, there is no png fallback
+tinygltf::Texture CreateTinyGltfTexture(tinygltf::Model& model, GlbWriter& writer, EncodedImage& encoded) {
+    handleImage(model, writer, encoded);
+
+    // Add the image to the model
+    model.images.push_back(encoded.image);
+    int imageIndex = static_cast<int>(model.images.size() - 1);
+
+    // Create a tinygltf::Texture
+    tinygltf::Texture texture{};
+    if (encoded.mimeType == "image/ktx2") {
+        tinygltf::Value::Object ktx2;
+        ktx2["source"] = tinygltf::Value(imageIndex);
+        texture.extensions[KTX2_TEXTURE_EXTENSION] = tinygltf::Value(std::move(ktx2));
+        if (std::find(model.extensionsUsed.begin(), model.extensionsUsed.end(), KTX2_TEXTURE_EXTENSION) == model.extensionsUsed.end()) {
+            model.extensionsUsed.push_back(KTX2_TEXTURE_EXTENSION);
+            model.extensionsRequired.push_back(KTX2_TEXTURE_EXTENSION);
+        }
+    } else {
+        texture.source = imageIndex;
+    }
+    model.textures.push_back(texture);
+
+    return texture;
+}
+
+// Function to load a grayscale map that is merged with others, all merged maps must have the same size.
+// width and height are set by the first map (0) and checked for the others. Returns nullptr with err set on failure
+unsigned char* LoadMergedMap(const InputData& input, int& width, int& height, std::string& err) {
+    int mapWidth, mapHeight, channels;
+    unsigned char* data = LoadTextureData(input, mapWidth, mapHeight, channels, 1, err);
+    if (!data) {
+        return nullptr;
+    }
+    if (width == 0) {
+        width = mapWidth;
+        height = mapHeight;
+    } else if (width != mapWidth || height != mapHeight) {
+        err = "Metalness, roughness and occlusion textures must have the same dimensions.";
+        stbi_image_free(data);
+        return nullptr;
+    }
+    return data;
+}
+
+// Function to merge roughness and metalness maps into a single metallicRoughness map
+// we copy from the roughness map into the green channel of the combined map,
+// and from the metalness map into the blue channel of the combined map.
+// Red is the occlusion map if occlusion is set (ORM packing), otherwise 255, alpha is 255.
+// If all maps are constant (WorldCreator 2025.1 exports metalness 0 and roughness 1) and occlusion is white,
+// nothing is merged and the result only carries the factors. Returns one image per variant
+std::vector<EncodedImage> EncodeMetallicRoughness(const InputData& metalness, const InputData& roughness, const InputData* occlusion,
+    const TextureSettings& settings, ThreadPool& pool) {
+    // every map is decoded once, as grayscale
+    int width = 0, height = 0;
+    std::string err;
+    unsigned char* metalnessData = LoadMergedMap(metalness, width, height, err);
+    unsigned char* roughnessData = metalnessData ? LoadMergedMap(roughness, width, height, err) : nullptr;
+    unsigned char* occlusionData = roughnessData && occlusion ? LoadMergedMap(*occlusion, width, height, err) : nullptr;
+    if (!roughnessData || (occlusion && !occlusionData)) {
+        stbi_image_free(roughnessData);
+        stbi_image_free(metalnessData);
+        return FailedImages(ConvertStatus::TextureError, err);
+    }
+
+    size_t pixelCount = static_cast<size_t>(width) * height;
+    uint8_t metalnessValue[4], roughnessValue[4], occlusionValue[4];
+    if (IsNearUniform(metalnessData, pixelCount, 1, UNIFORM_TOLERANCE, metalnessValue)
+        && IsNearUniform(roughnessData, pixelCount, 1, UNIFORM_TOLERANCE, roughnessValue)
+        && (!occlusionData || (IsNearUniform(occlusionData, pixelCount, 1, UNIFORM_TOLERANCE, occlusionValue) && occlusionValue[0] >= 255 - UNIFORM_TOLERANCE))) {
+        Progress(settings.log, "Constant metalness and roughness, using material factors");
+        stbi_image_free(occlusionData);
+        stbi_image_free(roughnessData);
+        stbi_image_free(metalnessData);
+        EncodedImage encoded;
+        encoded.uniform = true;
+        encoded.uniformValue = { 255, roughnessValue[0], metalnessValue[0], 255 };
+        return std::vector<EncodedImage>(settings.maxSizes.size(), encoded);
+    }
+
+    std::vector<unsigned char> metallicRoughnessData(pixelCount * 4);
+    {
+        ScopedTimer timer("merge maps");
+        InterleaveChannels(occlusionData, roughnessData, metalnessData, pixelCount, metallicRoughnessData.data());
+    }
+    stbi_image_free(occlusionData);
+    stbi_image_free(roughnessData);
+    stbi_image_free(metalnessData);
+
+    // fill texture info
+    tinygltf::Image metallicRoughnessImage;
+    metallicRoughnessImage.width = width;
+    metallicRoughnessImage.height = height;
+    metallicRoughnessImage.component = 4;
+    metallicRoughnessImage.bits = 8;
+    metallicRoughnessImage.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
+    return EncodeSizes(metallicRoughnessImage, metallicRoughnessData.data(), TextureSlot::MetallicRoughness, settings, pool, nullptr);
+}
+
+// encoded images of all variants as a cache entry. Passthrough images only store their size, the png is the input file
+std::vector<unsigned char> SerializeImages(const std::vector<EncodedImage>& variants) {
+    ByteWriter out;
+    out.put<uint64_t>(variants.size());
+    for (const EncodedImage& encoded : variants) {
+        out.put<int32_t>(encoded.image.width);
+        out.put<int32_t>(encoded.image.height);
+        out.put<int32_t>(encoded.image.component);
+        out.put<int32_t>(encoded.image.bits);
+        out.put<int32_t>(encoded.image.pixel_type);
+        out.putString(encoded.mimeType);
+        out.put<uint8_t>(encoded.passthrough.data ? 1 : 0);
+        out.put<uint64_t>(encoded.byteLength);
+        out.put<uint8_t>(encoded.uniform ? 1 : 0);
+        out.put(encoded.uniformValue);
+        if (encoded.data) {
+            out.putBytes(encoded.data->data(), encoded.data->size());
+        }
+    }
+    return std::move(out.bytes());
+}
+
+// images read back from a cache entry, input is the png of passthrough images
+bool DeserializeImages(const std::vector<unsigned char>& entry, const InputData& input, std::vector<EncodedImage>& variants) {
+    ByteReader in(entry.data(), entry.size());
+    uint64_t count;
+    if (!in.get(count)) {
+        return false;
+    }
+    variants.resize(static_cast<size_t>(count));
+    for (EncodedImage& encoded : variants) {
+        int32_t width, height, component, bits, pixelType;
+        uint8_t passthrough, uniform;
+        uint64_t byteLength;
+        if (!in.get(width) || !in.get(height) || !in.get(component) || !in.get(bits) || !in.get(pixelType)
+            || !in.getString(encoded.mimeType) || !in.get(passthrough) || !in.get(byteLength) || !in.get(uniform)
+            || !in.get(encoded.uniformValue)) {
+            return false;
+        }
+        encoded.image.width = width;
+        encoded.image.height = height;
+        encoded.image.component = component;
+        encoded.image.bits = bits;
+        encoded.image.pixel_type = pixelType;
+        encoded.byteLength = static_cast<size_t>(byteLength);
+        encoded.uniform = uniform != 0;
+        if (passthrough) {
+            encoded.passthrough = input;
+            continue;
+        }
+        const unsigned char* data = in.skip(encoded.byteLength);
+        if (!data) {
+            return false;
+        }
+        encoded.data = std::make_shared<std::vector<unsigned char>>(data, data + encoded.byteLength);
+    }
+    return true;
+}
+
+// Run encode, or reuse its result if the cache has it for the same input contents, slot and settings.
+// inputs[0] is the map that is embedded unchanged in passthrough mode. Failed results are not cached
+template <typename F>
+std::vector<EncodedImage> CachedTexture(const ConversionCache* cache, const std::vector<InputData>& inputs, TextureSlot slot,
+    const TextureSettings& settings, F encode) {
+    ScopedTimer timer("texture", inputs[0].name);
+    if (!cache) {
+        return encode();
+    }
+    CacheKey key("image");
+    key.add(CACHE_VERSION).add(static_cast<uint64_t>(slot)).add(settings.passthrough).add(settings.ktx2).add(settings.orm)
+        .add(static_cast<uint64_t>(settings.pngLevel));
+    for (size_t maxSize : settings.maxSizes) {
+        key.add(maxSize);
+    }
+    {
+        ScopedTimer hashTimer("cache hash");
+        for (const auto& input : inputs) {
+            key.addBytes(input.data, input.size);
+        }
+    }
+    std::vector<EncodedImage> variants;
+    auto entry = cache->load(key.value());
+    if (entry && DeserializeImages(*entry, inputs[0], variants)) {
+        Progress(settings.log, "Reusing cached texture: " << inputs[0].name);
+        return variants;
+    }
+    variants = encode();
+    if (std::all_of(variants.begin(), variants.end(), [](const EncodedImage& encoded) { return encoded.status == ConvertStatus::Ok; })) {
+        cache->store(key.value(), SerializeImages(variants));
+    }
+    return variants;
+}
+
+// Function to start reading, decoding and encoding of all PBR textures on the thread pool.
+// Jobs are created in the same order the textures end up in the glb.
+// With ktx2, textures are block compressed with mip maps instead of being embedded as png.
+// With orm, the occlusion map is packed into the red channel of the metallicRoughness texture.
+// With a cache, maps whose contents did not change since an earlier run are not processed again.
+// Returns false without starting any job if the roughness or metalness map is missing
+bool StartTextureJobs(ThreadPool& pool, const std::vector<ConvertInput>& maps, const TextureSettings& settings,
+    const ConversionCache* cache, std::vector<TextureJob>& jobs, std::string& err) {
+    const ConvertInput* metalnessMap = nullptr;
+    const ConvertInput* roughnessMap = nullptr;
+    const ConvertInput* occlusionMap = nullptr;
+    std::vector<std::pair<TextureSlot, const ConvertInput*>> slots;
+    for (const auto& map : maps) {
+        const std::string& name = InputName(map);
+        if (name.find("Roughness") != std::string::npos) {
+            roughnessMap = &map;
+        } else if (name.find("Metalness") != std::string::npos) {
+            metalnessMap = &map;
+        } else if (name.find("Color") != std::string::npos) {
+            slots.push_back({ TextureSlot::BaseColor, &map });
+        } else if (name.find("Normal") != std::string::npos) {
+            slots.push_back({ TextureSlot::Normal, &map });
+        } else if (name.find("AmbientOcclusion") != std::string::npos) {
+            if (settings.orm) {
+                occlusionMap = &map;
+            } else {
+                slots.push_back({ TextureSlot::Occlusion, &map });
+            }
+        }
+    }
+    if (!roughnessMap || !metalnessMap) {
+        err = "Roughness or Metalness map not found";
+        return false;
+    }
+    for (const auto& slotMap : slots) {
+        TextureSlot slot = slotMap.first;
+        ConvertInput map = *slotMap.second;
+        jobs.push_back({ slot, pool.submit([map, slot, settings, cache, &pool]() {
+            InputData input;
+            std::string err;
+            if (!ReadInput(map, input, err)) {
+                return FailedImages(ConvertStatus::ReadError, err);
+            }
+            return CachedTexture(cache, { input }, slot, settings, [&]() {
+                return EncodeTexture(input, slot, settings, pool);
+            });
+        }), {} });
+    }
+    // merged metallic/rough texture is always last
+    std::vector<ConvertInput> mergedMaps = { *metalnessMap, *roughnessMap };
+    if (occlusionMap) {
+        mergedMaps.push_back(*occlusionMap);
+    }
+    TextureSlot mergedSlot = occlusionMap ? TextureSlot::OcclusionRoughnessMetallic : TextureSlot::MetallicRoughness;
+    jobs.push_back({ mergedSlot, pool.submit([mergedMaps, mergedSlot, settings, cache, &pool]() {
+        std::vector<InputData> inputs(mergedMaps.size());
+        std::string err;
+        for (size_t i = 0; i < mergedMaps.size(); ++i) {
+            if (!ReadInput(mergedMaps[i], inputs[i], err)) {
+                return FailedImages(ConvertStatus::ReadError, err);
+            }
+        }
+        return CachedTexture(cache, inputs, mergedSlot, settings, [&]() {
+            return EncodeMetallicRoughness(inputs[0], inputs[1], inputs.size() > 2 ? &inputs[2] : nullptr, settings, pool);
+        });
+    }), {} });
+    return true;
+}
+
+// material factors that replace a constant map
+void SetUniformFactors(tinygltf::Material& material, TextureSlot slot, const std::array<uint8_t, 4>& value) {
+    tinygltf::PbrMetallicRoughness& pbr = material.pbrMetallicRoughness;
+    switch (slot) {
+    case TextureSlot::BaseColor:
+        // the color map is sRGB encoded, factors are linear
+        pbr.baseColorFactor = { SrgbToLinear(value[0] / 255.0f), SrgbToLinear(value[1] / 255.0f),
+            SrgbToLinear(value[2] / 255.0f), value[3] / 255.0 };
+        break;
+    case TextureSlot::Normal:
+    case TextureSlot::Occlusion:
+        // flat normals and full occlusion are the defaults without texture
+        break;
+    case TextureSlot::MetallicRoughness:
+    case TextureSlot::OcclusionRoughnessMetallic:
+        pbr.roughnessFactor = value[1] / 255.0;
+        pbr.metallicFactor = value[2] / 255.0;
+        break;
+    }
+}
+
+// Wait for all texture jobs and keep their results in the jobs.
+// All jobs are finished when it returns, the status of the first failed one is returned
+ConvertStatus FinishTextureJobs(std::vector<TextureJob>& jobs, std::string& err) {
+    ConvertStatus status = ConvertStatus::Ok;
+    for (auto& job : jobs) {
+        job.variants = job.result.get();
+        for (const EncodedImage& encoded : job.variants) {
+            if (status == ConvertStatus::Ok && encoded.status != ConvertStatus::Ok) {
+                status = encoded.status;
+                err = encoded.error;
+            }
+        }
+    }
+    return status;
+}
+
+// Function to add the PBR textures of one variant to tinygltf material.
+// Textures are added in job order, so buffer layout does not depend on which job finished first
+void AddTexturesToMaterial(tinygltf::Model& model, GlbWriter& writer, const std::vector<TextureJob>& jobs, size_t variant) {
+    assert(model.materials.size() == 1);
+    tinygltf::Material& material = model.materials[0];
+    tinygltf::PbrMetallicRoughness& pbr = material.pbrMetallicRoughness;
+
+    for (const auto& job : jobs) {
+        EncodedImage encoded = job.variants[variant];
+        if (encoded.uniform) {
+            SetUniformFactors(material, job.slot, encoded.uniformValue);
+            continue;
+        }
+        tinygltf::Texture texture = CreateTinyGltfTexture(model, writer, encoded);
+        int textureIndex = static_cast<int>(model.textures.size() - 1);
+        switch (job.slot) {
+        case TextureSlot::BaseColor:
+            pbr.baseColorTexture.index = textureIndex;
+            break;
+        case TextureSlot::Normal:
+            material.normalTexture.index = textureIndex;
+            break;
+        case TextureSlot::Occlusion:
+            material.occlusionTexture.index = textureIndex;
+            break;
+        case TextureSlot::MetallicRoughness:
+            pbr.roughnessFactor = 1.0;
+            pbr.metallicRoughnessTexture.index = textureIndex;
+            break;
+        case TextureSlot::OcclusionRoughnessMetallic:
+            pbr.roughnessFactor = 1.0;
+            pbr.metallicRoughnessTexture.index = textureIndex;
+            material.occlusionTexture.index = textureIndex;
+            break;
+        }
+    }
+}
+
+// segment writer that streams a (possibly interleaved) attribute tightly packed to the glb
+GlbWriter::SegmentWriter AttributeSegment(const AttributeView& view) {
+    return [view](std::ostream& out) {
+        if (view.byteStride == view.elementSize) {
+            out.write(reinterpret_cast<const char*>(view.data), view.byteLength());
+            return static_cast<bool>(out);
+        }
+        // gather interleaved elements in blocks
+        std::vector<unsigned char> block;
+        const size_t elementsPerBlock = 64 * 1024;
+        for (size_t first = 0; first < view.count; first += elementsPerBlock) {
+            size_t n = std::min(elementsPerBlock, view.count - first);
+            block.resize(n * view.elementSize);
+            for (size_t i = 0; i < n; ++i) {
+                std::memcpy(block.data() + i * view.elementSize, view.data + (first + i) * view.byteStride, view.elementSize);
+            }
+            out.write(reinterpret_cast<const char*>(block.data()), block.size());
+        }
+        return static_cast<bool>(out);
+    };
+}
+
+// add bufferView and accessor for a float vertex attribute that is streamed unchanged, returns the accessor index
+int AddVertexAttribute(tinygltf::Model& m, GlbWriter& writer, const AttributeView& view, int type) {
+    tinygltf::Accessor accessor;
+    accessor.bufferView = writer.addBufferView(m, view.byteLength(), TINYGLTF_TARGET_ARRAY_BUFFER, AttributeSegment(view));
+    accessor.byteOffset = 0;
+    accessor.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+    accessor.count = view.count;
+    accessor.type = type;
+    accessor.maxValues = view.max;
+    accessor.minValues = view.min;
+    m.accessors.push_back(accessor);
+    return static_cast<int>(m.accessors.size() - 1);
+}
+
+// add bufferView and accessor for a vertex attribute that is quantized while it is written, returns the accessor index
+int AddQuantizedAttribute(tinygltf::Model& m, GlbWriter& writer, const QuantizedAttribute& q, int type) {
+    tinygltf::Accessor accessor;
+    accessor.bufferView = writer.addBufferView(m, q.byteLength(), TINYGLTF_TARGET_ARRAY_BUFFER, QuantizedSegment(q));
+    if (q.outputStride != q.elementSize) {
+        // vertex attributes have to start on 4 byte boundaries
+        m.bufferViews[accessor.bufferView].byteStride = q.outputStride;
+    }
+    accessor.byteOffset = 0;
+    accessor.componentType = q.componentType;
+    accessor.normalized = true;
+    accessor.count = q.source.count;
+    accessor.type = type;
+    accessor.maxValues = q.max;
+    accessor.minValues = q.min;
+    m.accessors.push_back(accessor);
+    return static_cast<int>(m.accessors.size() - 1);
+}
+
+// add buffer views and accessors of one mesh part, data is streamed in this order: positions, indices, normals, texcoords.
+// With quantize, positions are stored relative to the bounding box of the whole node
+tinygltf::Primitive AddPrimitive(tinygltf::Model& m, GlbWriter& writer, const MeshPart& part, bool quantize,
+    const std::vector<double>& boxMin, const std::vector<double>& boxMax, const ConvertLog& log) {
+    tinygltf::Primitive primitive;
+    if (quantize) {
+        QuantizedAttribute quantizedPositions = QuantizePositions(part.positions, boxMin, boxMax);
+        primitive.attributes["POSITION"] = AddQuantizedAttribute(m, writer, quantizedPositions, TINYGLTF_TYPE_VEC3);
+    } else {
+        primitive.attributes["POSITION"] = AddVertexAttribute(m, writer, part.positions, TINYGLTF_TYPE_VEC3);
+    }
+
+    const AttributeView& indices = part.indices;
+    tinygltf::Accessor indicesAccessor;
+    indicesAccessor.bufferView = writer.addBufferView(m, indices.byteLength(), TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER, AttributeSegment(indices));
+    indicesAccessor.byteOffset = 0;
+    indicesAccessor.componentType = indices.componentType;
+    indicesAccessor.count = indices.count;
+    indicesAccessor.type = TINYGLTF_TYPE_SCALAR;
+    // do NOT write min/max for index buffer
+    m.accessors.push_back(indicesAccessor);
+    primitive.indices = static_cast<int>(m.accessors.size() - 1);
+
+    if (quantize) {
+        primitive.attributes["NORMAL"] = AddQuantizedAttribute(m, writer, QuantizeNormals(part.normals), TINYGLTF_TYPE_VEC3);
+        QuantizedAttribute quantizedTexCoords;
+        if (QuantizeTexCoords(part.texCoords, quantizedTexCoords)) {
+            primitive.attributes["TEXCOORD_0"] = AddQuantizedAttribute(m, writer, quantizedTexCoords, TINYGLTF_TYPE_VEC2);
+        } else {
+            Progress(log, "Texture coordinates outside [0,1], keeping them as float");
+            primitive.attributes["TEXCOORD_0"] = AddVertexAttribute(m, writer, part.texCoords, TINYGLTF_TYPE_VEC2);
+        }
+    } else {
+        primitive.attributes["NORMAL"] = AddVertexAttribute(m, writer, part.normals, TINYGLTF_TYPE_VEC3);
+        primitive.attributes["TEXCOORD_0"] = AddVertexAttribute(m, writer, part.texCoords, TINYGLTF_TYPE_VEC2);
+    }
+    primitive.mode = TINYGLTF_MODE_TRIANGLES;
+    primitive.material = 0;
+    return primitive;
+}
+
+// add a node with one mesh, one primitive per mesh part. Returns the node index.
+// With quantize, all parts share the node transform, so quantized positions use one bounding box for all of them
+int AddMeshNode(tinygltf::Model& m, GlbWriter& writer, const std::vector<MeshPart>& parts, bool quantize, const std::string& name,
+    const ConvertLog& log) {
+    tinygltf::Mesh mesh;
+    tinygltf::Node node;
+
+    std::vector<double> boxMin, boxMax;
+    for (const auto& part : parts) {
+        Progress(log, " mesh part vertices: " << part.positions.count << " indices: " << part.indices.count);
+        if (quantize) {
+            std::vector<double> partMin, partMax;
+            ComputeBounds(part.positions, partMin, partMax);
+            if (boxMin.empty()) {
+                boxMin = partMin;
+                boxMax = partMax;
+            }
+            for (size_t c = 0; c < 3; ++c) {
+                boxMin[c] = std::min(boxMin[c], partMin[c]);
+                boxMax[c] = std::max(boxMax[c], partMax[c]);
+            }
+        }
+    }
+    if (quantize) {
+        PositionTransform(boxMin, boxMax, node.translation, node.scale);
+        // tiles share the extension, and ktx2 textures may have been added to the lists before
+        if (std::find(m.extensionsRequired.begin(), m.extensionsRequired.end(), QUANTIZATION_EXTENSION) == m.extensionsRequired.end()) {
+            m.extensionsUsed.push_back(QUANTIZATION_EXTENSION);
+            m.extensionsRequired.push_back(QUANTIZATION_EXTENSION);
+        }
+    }
+
+    // Build the mesh primitives and add them to the mesh
+    for (const auto& part : parts) {
+        mesh.primitives.push_back(AddPrimitive(m, writer, part, quantize, boxMin, boxMax, log));
+    }
+    mesh.name = name;
+    m.meshes.push_back(mesh);
+    node.name = name;
+    node.mesh = static_cast<int>(m.meshes.size() - 1);
+    m.nodes.push_back(node);
+    return static_cast<int>(m.nodes.size() - 1);
+}
+
+// scene, asset and the single material shared by all primitives
+void finishModel(tinygltf::Model& m, int rootNode) {
+    tinygltf::Scene scene;
+    tinygltf::Asset asset;
+    scene.nodes.push_back(rootNode); // Default scene
+
+    // Define the asset. The version is required
+    asset.version = "2.0";
+    asset.generator = "WorldCreatorToGLTF";
+
+    m.scenes.push_back(scene);
+    m.defaultScene = 0;
+    m.asset = asset;
+
+    // Create a simple material
+    tinygltf::Material mat;
+    mat.pbrMetallicRoughness.baseColorFactor = { 1.0f, 1.0f, 1.0f, 1.0f };
+    //mat.doubleSided = true; may need to be set for off cases
+    m.materials.push_back(mat);
+}
+
+// create model from data of the exported WorldCreator mesh, one primitive per mesh part.
+// Parts may point into the mapped mesh file, it has to stay mapped until the glb is written.
+// With quantize, vertex attributes are written as KHR_mesh_quantization integer formats
+void createModel(tinygltf::Model& m, GlbWriter& writer, const std::vector<MeshPart>& parts, bool quantize, const ConvertLog& log) {
+    finishModel(m, AddMeshNode(m, writer, parts, quantize, "", log));
+}
+
+// group node over the square block of tiles starting at x, y, recursively down to single tiles
+int AddQuadtreeNode(tinygltf::Model& m, const std::vector<int>& tileNodes, size_t tiles, size_t x, size_t y, size_t size) {
+    if (size == 1) {
+        return tileNodes[y * tiles + x];
+    }
+    size_t half = size / 2;
+    tinygltf::Node node;
+    node.name = "tiles_" + std::to_string(x) + "_" + std::to_string(y) + "_" + std::to_string(size);
+    node.children.push_back(AddQuadtreeNode(m, tileNodes, tiles, x, y, half));
+    node.children.push_back(AddQuadtreeNode(m, tileNodes, tiles, x + half, y, half));
+    node.children.push_back(AddQuadtreeNode(m, tileNodes, tiles, x, y + half, half));
+    node.children.push_back(AddQuadtreeNode(m, tileNodes, tiles, x + half, y + half, half));
+    m.nodes.push_back(node);
+    return static_cast<int>(m.nodes.size() - 1);
+}
+
+// create model with a quadtree of tile nodes. Each tile node shows its full resolution mesh and
+// lists the coarser levels with MSFT_lod, the level nodes are only referenced from there.
+// Screen coverage thresholds halve with every level
+void createTiledModel(tinygltf::Model& m, GlbWriter& writer, const std::vector<TerrainTile>& tiles, size_t tilesPerSide, bool quantize,
+    const ConvertLog& log) {
+    std::vector<int> tileNodes;
+    bool anyLods = false;
+    for (const auto& tile : tiles) {
+        std::string name = "tile_" + std::to_string(tile.x) + "_" + std::to_string(tile.y);
+        int tileNode = AddMeshNode(m, writer, tile.lods[0], quantize, name, log);
+        tinygltf::Value::Array ids;
+        tinygltf::Value::Array coverage;
+        double threshold = 0.5;
+        for (size_t level = 1; level < tile.lods.size(); ++level) {
+            ids.push_back(tinygltf::Value(AddMeshNode(m, writer, tile.lods[level], quantize, name + "_lod" + std::to_string(level), log)));
+            coverage.push_back(tinygltf::Value(threshold));
+            threshold *= 0.5;
+        }
+        if (!ids.empty()) {
+            // one coverage value per level including the full resolution one
+            coverage.push_back(tinygltf::Value(threshold));
+            tinygltf::Value::Object lod;
+            lod["ids"] = tinygltf::Value(std::move(ids));
+            m.nodes[tileNode].extensions["MSFT_lod"] = tinygltf::Value(std::move(lod));
+            tinygltf::Value::Object extras;
+            extras["MSFT_screencoverage"] = tinygltf::Value(std::move(coverage));
+            m.nodes[tileNode].extras = tinygltf::Value(std::move(extras));
+            anyLods = true;
+        }
+        tileNodes.push_back(tileNode);
+    }
+    if (anyLods) {
+        m.extensionsUsed.push_back("MSFT_lod");
+    }
+    finishModel(m, AddQuadtreeNode(m, tileNodes, tilesPerSide, 0, 0, tilesPerSide));
+}
+
+// Generate the mesh of a heightmap input, sized by the terrain options. columns and rows are the grid size
+bool LoadHeightmapMesh(const InputData& input, const ConvertOptions& options, ThreadPool& pool, SourceMesh& mesh,
+    size_t& columns, size_t& rows, std::string& err) {
+    Heightmap map;
+    {
+        ScopedTimer timer("heightmap decode", input.name);
+        if (!LoadHeightmap(input.data, input.size, input.name, map, err)) {
+            return false;
+        }
+    }
+    TerrainSize size;
+    size.width = options.terrainWidth;
+    size.length = options.terrainLength;
+    size.height = options.terrainHeight;
+    ScopedTimer timer("heightmap mesh");
+    mesh = BuildHeightmapMesh(map, size, pool);
+    columns = map.columns;
+    rows = map.rows;
+    Progress(options.log, "Generated mesh of " << columns << " x " << rows << " vertices from heightmap " << input.name);
+    return true;
+}
+
+// process wide pool of conversions without their own pool, created on first use
+ThreadPool& DefaultPool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+} // namespace
+
+const char* ConvertStatusName(ConvertStatus status) {
+    switch (status) {
+    case ConvertStatus::Ok: return "ok";
+    case ConvertStatus::InvalidArgument: return "invalid argument";
+    case ConvertStatus::MissingInput: return "missing input";
+    case ConvertStatus::ReadError: return "read error";
+    case ConvertStatus::MeshError: return "mesh error";
+    case ConvertStatus::TextureError: return "texture error";
+    case ConvertStatus::InvalidOutput: return "invalid output";
+    case ConvertStatus::WriteError: return "write error";
+    }
+    return "unknown";
+}
+
+ConvertInput FileInput(const std::string& path) {
+    ConvertInput input;
+    input.name = path;
+    input.path = path;
+    return input;
+}
+
+ConvertInput MemoryInput(const std::string& name, const unsigned char* data, size_t size) {
+    ConvertInput input;
+    input.name = name;
+    input.data = data;
+    input.size = size;
+    return input;
+}
+
+ConvertInput ReaderInput(const std::string& name, std::function<bool(std::vector<unsigned char>& bytes, std::string& err)> read) {
+    ConvertInput input;
+    input.name = name;
+    input.read = std::move(read);
+    return input;
+}
+
+ConvertStatus ConvertVariants(const ConvertInputs& inputs, const ConvertOptions& options,
+    const std::vector<ConvertVariant>& variants, std::string& err) {
+    if (variants.empty()) {
+        err = "No output given";
+        return ConvertStatus::InvalidArgument;
+    }
+    if ((options.tiles & (options.tiles - 1)) != 0) {
+        err = "Tile count has to be a power of 2";
+        return ConvertStatus::InvalidArgument;
+    }
+    if (inputs.maps.empty()) {
+        err = "No texture files given";
+        return ConvertStatus::MissingInput;
+    }
+    bool heightmap = HasInput(inputs.heightmap);
+    if (!heightmap && !HasInput(inputs.mesh)) {
+        err = "No mesh file given";
+        return ConvertStatus::MissingInput;
+    }
+    if (heightmap && !(options.terrainWidth > 0.0f && options.terrainLength > 0.0f && options.terrainHeight >= 0.0f)) {
+        err = "A heightmap needs the terrain width, length and height";
+        return ConvertStatus::InvalidArgument;
+    }
+    ThreadPool& pool = options.pool ? *options.pool : DefaultPool();
+    const ConversionCache* cache = options.cache;
+
+    // textures are read, decoded, merged and encoded in the background while the mesh is loaded
+    TextureSettings textureSettings;
+    textureSettings.passthrough = options.passthrough;
+    textureSettings.ktx2 = options.ktx2;
+    textureSettings.orm = options.orm;
+    textureSettings.pngLevel = options.pngLevel;
+    textureSettings.log = options.log;
+    textureSettings.maxSizes.clear();
+    for (const auto& variant : variants) {
+        textureSettings.maxSizes.push_back(variant.maxTextureSize);
+    }
+    std::vector<TextureJob> textureJobs;
+    if (!StartTextureJobs(pool, inputs.maps, textureSettings, cache, textureJobs, err)) {
+        return ConvertStatus::MissingInput;
+    }
+    // jobs reference the pool and cache, they have to finish before an early return
+    auto failed = [&textureJobs](ConvertStatus status) {
+        for (auto& job : textureJobs) {
+            job.result.wait();
+        }
+        return status;
+    };
+
+    // mesh is mapped, only its json chunk is parsed. Attributes are copied once, directly to the output.
+    // A heightmap is decoded and the mesh generated from it instead
+    InputData meshInput;
+    SourceMesh sourceMesh;
+    size_t heightmapColumns = 0, heightmapRows = 0;
+    {
+        ScopedTimer timer("mesh load");
+        if (!ReadInput(heightmap ? inputs.heightmap : inputs.mesh, meshInput, err)) {
+            return failed(ConvertStatus::ReadError);
+        }
+        bool loaded = heightmap
+            ? LoadHeightmapMesh(meshInput, options, pool, sourceMesh, heightmapColumns, heightmapRows, err)
+            : LoadMeshData(meshInput.data, meshInput.size, meshInput.name, sourceMesh, err);
+        if (!loaded) {
+            return failed(ConvertStatus::MeshError);
+        }
+    }
+    Progress(options.log, "Loaded mesh model");
+    // generated meshes are a row major grid already, exports are sorted into one
+    auto buildGrid = [&](TerrainGrid& grid) {
+        if (heightmap) {
+            grid = RowMajorGrid(sourceMesh, heightmapColumns, heightmapRows);
+            return true;
+        }
+        return BuildTerrainGrid(sourceMesh, grid, err);
+    };
+
+    bool tiled = options.tiles > 0 || options.lods > 0;
+    size_t tilesPerSide = options.tiles > 0 ? options.tiles : 1;
+    // processed meshes are cached as one tile per mesh, the unprocessed export is streamed from the input anyway
+    bool processed = tiled || options.maxError > 0.0f || options.optimizeMesh;
+    std::vector<TerrainTile> tiles;
+    uint64_t meshKey = 0;
+    if (cache && processed) {
+        ScopedTimer timer("cache hash");
+        CacheKey key(heightmap ? "heightmap" : "mesh");
+        key.add(CACHE_VERSION).addBytes(meshInput.data, meshInput.size);
+        if (heightmap) {
+            key.addFloat(options.terrainWidth).addFloat(options.terrainLength).addFloat(options.terrainHeight);
+        }
+        meshKey = key.add(options.tiles).add(options.lods).addFloat(options.maxError).add(options.optimizeMesh).value();
+        auto entry = cache->load(meshKey);
+        if (entry && DeserializeTiles(entry, tiles)) {
+            Progress(options.log, "Reusing cached mesh: " << meshInput.name);
+        } else {
+            tiles.clear();
+        }
+    }
+    if (tiles.empty() && tiled) {
+        TilingOptions tiling;
+        tiling.tiles = tilesPerSide;
+        tiling.lods = options.lods > 0 ? options.lods : 3;
+        tiling.optimizeMesh = options.optimizeMesh;
+        tiling.maxError = options.maxError;
+        TerrainGrid grid;
+        ScopedTimer gridTimer("terrain grid");
+        if (!buildGrid(grid)) {
+            err = "Cannot tile mesh: " + err;
+            return failed(ConvertStatus::MeshError);
+        }
+        gridTimer.stop();
+        size_t cells = std::min(grid.columns, grid.rows) - 1;
+        if (tiling.tiles > cells) {
+            err = "Cannot split " + std::to_string(grid.columns) + " x " + std::to_string(grid.rows) + " vertices into "
+                + std::to_string(tiling.tiles) + " x " + std::to_string(tiling.tiles) + " tiles";
+            return failed(ConvertStatus::MeshError);
+        }
+        // tile levels are built on the texture pool, tile jobs queue up behind the texture jobs
+        ScopedTimer tileTimer("tiles");
+        if (!BuildTiles(grid, tiling, pool, tiles, err)) {
+            return failed(ConvertStatus::MeshError);
+        }
+        Progress(options.log, "Built " << tiles.size() << " tiles with " << tiling.lods << " levels of detail");
+    } else if (tiles.empty()) {
+        std::vector<MeshPart> meshParts;
+        MeshPart wholeMesh = WholeMesh(sourceMesh);
+        if (options.maxError > 0.0f) {
+            TerrainGrid grid;
+            ScopedTimer gridTimer("terrain grid");
+            if (!buildGrid(grid)) {
+                err = "Cannot simplify mesh: " + err;
+                return failed(ConvertStatus::MeshError);
+            }
+            gridTimer.stop();
+            ScopedTimer simplifyTimer("simplify");
+            wholeMesh = BuildTerrainMesh(grid, options.maxError, pool);
+            Progress(options.log, "Simplified mesh to " << wholeMesh.indices.count / 3 << " of " << sourceMesh.indices.count / 3
+                << " triangles");
+        }
+        if (options.optimizeMesh) {
+            MeshOptimizeStats stats;
+            ScopedTimer optimizeTimer("mesh optimize");
+            if (!OptimizeMesh(wholeMesh, meshParts, stats, err)) {
+                return failed(ConvertStatus::MeshError);
+            }
+            Progress(options.log, "Optimized index buffer: ACMR " << stats.acmrBefore << " -> " << stats.acmrAfter << ", "
+                << stats.parts << " primitive(s) with 16 bit indices");
+        } else {
+            meshParts.push_back(std::move(wholeMesh));
+        }
+        tiles.resize(1);
+        tiles[0].lods.push_back(std::move(meshParts));
+    } else {
+        meshKey = 0; // reused from the cache
+    }
+    if (meshKey != 0) {
+        cache->store(meshKey, SerializeTiles(tiles));
+    }
+    {
+        // time the textures take longer than the mesh
+        ScopedTimer timer("texture wait");
+        ConvertStatus status = FinishTextureJobs(textureJobs, err);
+        if (status != ConvertStatus::Ok) {
+            return status;
+        }
+    }
+
+    // variants share the mesh data and differ in their images
+    for (size_t variant = 0; variant < variants.size(); ++variant) {
+        tinygltf::Model model;
+        GlbWriter writer;
+        {
+            ScopedTimer timer("model build");
+            if (tiled) {
+                createTiledModel(model, writer, tiles, tilesPerSide, options.quantize, options.log);
+            } else {
+                createModel(model, writer, tiles[0].lods[0], options.quantize, options.log);
+            }
+            AddTexturesToMaterial(model, writer, textureJobs, variant);
+        }
+
+        // the model is checked before anything is written, its data while it streams to the output
+        GltfValidator validator;
+        if (options.validate && !validator.begin(model, writer.binaryLength(), err)) {
+            err = "Invalid glb: " + err;
+            return ConvertStatus::InvalidOutput;
+        }
+        GlbWriter::BinaryObserver observer;
+        if (options.validate) {
+            observer = [&validator](size_t offset, const unsigned char* data, size_t size) {
+                validator.consume(offset, data, size);
+            };
+        }
+
+        // mesh data and images are streamed to the glb binary chunk, the mesh input stays alive until then
+        ScopedTimer writeTimer("glb write");
+        SinkStreamBuf buffer(variants[variant].sink);
+        std::ostream out(&buffer);
+        if (!writer.write(model, out, err, observer)) {
+            return ConvertStatus::WriteError;
+        }
+        writeTimer.stop();
+        if (options.validate) {
+            ScopedTimer validateTimer("validate");
+            if (!validator.finish(err)) {
+                err = "Invalid glb: " + err;
+                return ConvertStatus::InvalidOutput;
+            }
+        }
+    }
+    return ConvertStatus::Ok;
+}
+
+ConvertStatus Convert(const ConvertInputs& inputs, const ConvertOptions& options, const GlbSink& sink, std::string& err) {
+    return ConvertVariants(inputs, options, { { options.maxTextureSize, sink } }, err);
+}
+
+ConvertStatus Convert(const ConvertInputs& inputs, const ConvertOptions& options, std::ostream& out, std::string& err) {
+    return Convert(inputs, options, [&out](const unsigned char* data, size_t size) {
+        out.write(reinterpret_cast<const char*>(data), size);
+        return static_cast<bool>(out);
+    }, err);
+}
+
+ConvertStatus ConvertToMemory(const ConvertInputs& inputs, const ConvertOptions& options, std::vector<unsigned char>& glb,
+    std::string& err) {
+    glb.clear();
+    return Convert(inputs, options, [&glb](const unsigned char* data, size_t size) {
+        glb.insert(glb.end(), data, data + size);
+        return true;
+    }, err);
+}
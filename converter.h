@@ -0,0 +1,108 @@
+#pragma once
+#include "png_writer.h"
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class ThreadPool;
+class ConversionCache;
+
+// Conversion of one WorldCreator export to a binary glTF, usable without the command line tool.
+// Inputs can be files, bytes in memory or callbacks that read them, the glb is streamed to a sink.
+// Errors are returned, nothing ends the process
+
+// result of Convert, Ok or the stage that failed. err has the details
+enum class ConvertStatus {
+    Ok,
+    InvalidArgument, // options that cannot be used, e.g. a tile count that is not a power of 2
+    MissingInput,    // no mesh or heightmap, no maps, or the roughness or metalness map is missing
+    ReadError,       // an input file or reader failed
+    MeshError,       // mesh is not a glb export, heightmap cannot be decoded, mesh cannot be tiled or simplified, or has indices out of range
+    TextureError,    // a map cannot be decoded, or merged maps differ in size
+    InvalidOutput,   // the glb failed validation. Structural problems are found before anything is written,
+                     // data problems only at the end, then the sink has received the complete invalid glb
+    WriteError       // sink failed or the glb exceeds 4 GB
+};
+
+// short name of a status for messages, e.g. "read error"
+const char* ConvertStatusName(ConvertStatus status);
+
+// one export file. The bytes come from data if set, otherwise from read, otherwise the file at path is mapped.
+// name is the export file name, map names select the material slot: *Color*, *Normal*, *AmbientOcclusion*,
+// *Roughness* and *Metalness*. data has to stay valid until Convert returns. read is called once per input,
+// from worker threads, so different inputs may be read at the same time
+struct ConvertInput {
+    std::string name;
+    std::string path;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+    std::function<bool(std::vector<unsigned char>& bytes, std::string& err)> read;
+};
+
+// input mapped from a file, named after its path
+ConvertInput FileInput(const std::string& path);
+
+// input borrowed from memory owned by the caller
+ConvertInput MemoryInput(const std::string& name, const unsigned char* data, size_t size);
+
+// input read by a callback, e.g. from an archive or a network stream
+ConvertInput ReaderInput(const std::string& name, std::function<bool(std::vector<unsigned char>& bytes, std::string& err)> read);
+
+// the files of one export: mesh glb or heightmap, and png maps
+struct ConvertInputs {
+    ConvertInput mesh;
+    ConvertInput heightmap; // 8 / 16 bit png, .raw / .r16 or float .r32 heightmap. If set, the mesh is generated from it
+    std::vector<ConvertInput> maps;
+};
+
+// conversion settings, the defaults match the command line tool without options
+// receives a progress message without line break. Called from pool threads and from conversions running
+// at the same time, so it has to be thread safe
+using ConvertLog = std::function<void(const std::string& message)>;
+
+struct ConvertOptions {
+    bool passthrough = true; // embed 8 bit source pngs without decoding them
+    bool ktx2 = false; // block compressed KTX2 textures instead of png
+    PngLevel pngLevel = PngLevel::Default; // speed / size of the pngs that are encoded, not of embedded source pngs
+    bool orm = false; // pack occlusion, roughness and metalness into one texture
+    bool quantize = false; // KHR_mesh_quantization vertex formats
+    bool optimizeMesh = false; // vertex cache / fetch optimization and 16 bit index parts
+    size_t tiles = 0; // tiles per side, a power of 2. 0: one mesh without tiling
+    size_t lods = 0; // levels of detail per tile, 0: default
+    float maxError = 0.0f; // height error bound of the simplification, 0: keep the full grid
+    float terrainWidth = 0.0f; // heightmap input: terrain extent along x and z, in mesh units
+    float terrainLength = 0.0f;
+    float terrainHeight = 0.0f; // heightmap input: y of sample value 1 (65535 in 16 bit heightmaps)
+    size_t maxTextureSize = 0; // larger maps are halved until width and height fit, 0: keep the exported size
+    bool validate = true; // check references, bounds, indices, min/max and normals of the glb while it is written
+    ThreadPool* pool = nullptr; // texture and tile jobs, may be shared by conversions. nullptr: process wide pool
+    const ConversionCache* cache = nullptr; // reusable texture and mesh results, nullptr: no cache
+    ConvertLog log; // progress messages, empty: the library writes nothing
+};
+
+// receives the glb in order, in blocks. Returns false to abort the conversion
+using GlbSink = std::function<bool(const unsigned char* data, size_t size)>;
+
+// convert one export and stream the glb to sink. Safe to call from several threads at the same time
+ConvertStatus Convert(const ConvertInputs& inputs, const ConvertOptions& options, const GlbSink& sink, std::string& err);
+
+// same, writing to a stream
+ConvertStatus Convert(const ConvertInputs& inputs, const ConvertOptions& options, std::ostream& out, std::string& err);
+
+// same, returning the complete glb in memory
+ConvertStatus ConvertToMemory(const ConvertInputs& inputs, const ConvertOptions& options, std::vector<unsigned char>& glb,
+    std::string& err);
+
+// one glb of ConvertVariants, with its own texture size limit (replaces options.maxTextureSize)
+struct ConvertVariant {
+    size_t maxTextureSize = 0;
+    GlbSink sink;
+};
+
+// Convert one export to several glbs that only differ in texture size, e.g. 8192, 2048 and 512.
+// The mesh is processed and every map decoded once, each map is halved down to the smallest size and
+// the sizes are encoded in parallel. Variants are written in order, the first failure stops the conversion
+ConvertStatus ConvertVariants(const ConvertInputs& inputs, const ConvertOptions& options,
+    const std::vector<ConvertVariant>& variants, std::string& err);
@@ -0,0 +1,131 @@
+#include "folder_watch.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+#if defined(__linux__)
+
+FolderWatcher::~FolderWatcher() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+bool FolderWatcher::open(const std::string& watchFolder, std::string& err) {
+    folder = watchFolder;
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        err = std::string("inotify_init1 failed: ") + std::strerror(errno);
+        return false;
+    }
+    // IN_MODIFY as well as IN_CLOSE_WRITE: writers that keep the file open are caught by the debounce
+    uint32_t mask = IN_CLOSE_WRITE | IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+    if (inotify_add_watch(fd, folder.c_str(), mask) < 0) {
+        err = "cannot watch " + folder + ": " + std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+bool FolderWatcher::wait(int timeoutMs, std::vector<std::string>& changed, std::string& err) {
+    pollfd pfd = { fd, POLLIN, 0 };
+    int ready = ::poll(&pfd, 1, timeoutMs);
+    if (ready < 0) {
+        if (errno == EINTR) {
+            return true;
+        }
+        err = std::string("poll failed: ") + std::strerror(errno);
+        return false;
+    }
+    alignas(inotify_event) char buffer[16 * 1024];
+    for (;;) {
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break; // EAGAIN: all events read
+        }
+        for (char* p = buffer; p < buffer + length;) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+            if (event->mask & (IN_IGNORED | IN_DELETE_SELF)) {
+                err = "watched folder was removed: " + folder;
+                return false;
+            }
+            if (event->len > 0) {
+                changed.push_back(event->name);
+            }
+            p += sizeof(inotify_event) + event->len;
+        }
+    }
+    return true;
+}
+
+#else
+
+FolderWatcher::~FolderWatcher() = default;
+
+bool FolderWatcher::open(const std::string& watchFolder, std::string& err) {
+    folder = watchFolder;
+    if (!std::filesystem::is_directory(folder)) {
+        err = "cannot watch " + folder;
+        return false;
+    }
+    std::vector<std::string> ignored;
+    poll(ignored);
+    return true;
+}
+
+bool FolderWatcher::poll(std::vector<std::string>& changed) {
+    std::map<std::string, std::pair<uint64_t, int64_t>> current;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(folder, ec)) {
+        if (!entry.is_regular_file(ec)) {
+            continue;
+        }
+        uint64_t size = entry.file_size(ec);
+        int64_t time = entry.last_write_time(ec).time_since_epoch().count();
+        current[entry.path().filename().string()] = { size, time };
+    }
+    if (ec) {
+        return false;
+    }
+    for (const auto& [name, state] : current) {
+        auto old = snapshot.find(name);
+        if (old == snapshot.end() || old->second != state) {
+            changed.push_back(name);
+        }
+    }
+    for (const auto& [name, state] : snapshot) {
+        if (current.find(name) == current.end()) {
+            changed.push_back(name);
+        }
+    }
+    snapshot.swap(current);
+    return true;
+}
+
+bool FolderWatcher::wait(int timeoutMs, std::vector<std::string>& changed, std::string& err) {
+    auto start = std::chrono::steady_clock::now();
+    size_t before = changed.size();
+    for (;;) {
+        if (!poll(changed)) {
+            err = "cannot read " + folder;
+            return false;
+        }
+        auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+        if (changed.size() > before || (timeoutMs >= 0 && waited >= timeoutMs)) {
+            return true;
+        }
+        int sleep = timeoutMs < 0 ? POLL_INTERVAL_MS : std::min<int>(POLL_INTERVAL_MS, timeoutMs - static_cast<int>(waited));
+        std::this_thread::sleep_for(std::chrono::milliseconds(sleep));
+    }
+}
+
+#endif
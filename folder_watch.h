@@ -0,0 +1,33 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Reports which files of one folder were written, created, renamed or deleted.
+// Uses inotify on Linux and compares file sizes and dates every POLL_INTERVAL_MS elsewhere
+class FolderWatcher {
+public:
+    FolderWatcher() = default;
+    ~FolderWatcher();
+    FolderWatcher(const FolderWatcher&) = delete;
+    FolderWatcher& operator=(const FolderWatcher&) = delete;
+
+    bool open(const std::string& folder, std::string& err);
+
+    // wait up to timeoutMs (< 0: no limit) for changes and append the changed file names.
+    // Returns false if the folder cannot be watched any more
+    bool wait(int timeoutMs, std::vector<std::string>& changed, std::string& err);
+
+    static const int POLL_INTERVAL_MS = 250;
+
+private:
+    std::string folder;
+#if defined(__linux__)
+    int fd = -1;
+#else
+    // file name -> size and modification time of the last poll
+    std::map<std::string, std::pair<uint64_t, int64_t>> snapshot;
+    bool poll(std::vector<std::string>& changed);
+#endif
+};
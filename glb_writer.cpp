@@ -0,0 +1,238 @@
+#include "glb_writer.h"
+#include "gltf_json.h"
+#include <algorithm>
+#include <fstream>
+#include <memory>
+
+namespace {
+
+const uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+const uint32_t GLB_VERSION = 2;
+const uint32_t CHUNK_JSON = 0x4E4F534A; // "JSON"
+const uint32_t CHUNK_BIN = 0x004E4942; // "BIN\0"
+
+size_t Align4(size_t n) {
+    return (n + 3) & ~size_t(3);
+}
+
+void WriteUint32(std::ostream& out, uint32_t v) {
+    unsigned char bytes[4] = {
+        static_cast<unsigned char>(v & 0xff), static_cast<unsigned char>((v >> 8) & 0xff),
+        static_cast<unsigned char>((v >> 16) & 0xff), static_cast<unsigned char>((v >> 24) & 0xff)
+    };
+    out.write(reinterpret_cast<const char*>(bytes), 4);
+}
+
+void WritePadding(std::ostream& out, size_t count, char fill) {
+    static const char zeros[4] = { 0, 0, 0, 0 };
+    static const char spaces[4] = { ' ', ' ', ' ', ' ' };
+    out.write(fill == ' ' ? spaces : zeros, count);
+}
+
+// stream buffer that shows the binary chunk to an observer on its way to the output
+class ObservedStreamBuf : public std::streambuf {
+public:
+    ObservedStreamBuf(std::ostream& out, const GlbWriter::BinaryObserver& observer)
+        : out(out)
+        , observer(observer) {
+    }
+
+protected:
+    int_type overflow(int_type ch) override {
+        if (traits_type::eq_int_type(ch, traits_type::eof())) {
+            return traits_type::not_eof(ch);
+        }
+        char c = traits_type::to_char_type(ch);
+        return xsputn(&c, 1) == 1 ? ch : traits_type::eof();
+    }
+
+    // large writes are passed on in blocks that stay in the cache between observer and output
+    std::streamsize xsputn(const char* s, std::streamsize count) override {
+        const std::streamsize blockSize = 256 * 1024;
+        for (std::streamsize done = 0; done < count; done += blockSize) {
+            std::streamsize n = std::min(blockSize, count - done);
+            observer(offset, reinterpret_cast<const unsigned char*>(s + done), static_cast<size_t>(n));
+            offset += static_cast<size_t>(n);
+            if (!out.write(s + done, n)) {
+                return 0;
+            }
+        }
+        return count;
+    }
+
+    int sync() override {
+        return out.flush() ? 0 : -1;
+    }
+
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override {
+        if (off != 0 || dir != std::ios_base::cur || !(which & std::ios_base::out)) {
+            return pos_type(off_type(-1));
+        }
+        return pos_type(static_cast<off_type>(offset));
+    }
+
+private:
+    std::ostream& out;
+    const GlbWriter::BinaryObserver& observer;
+    size_t offset = 0;
+};
+
+} // namespace
+
+size_t GlbWriter::addSegment(size_t byteLength, SegmentWriter writer) {
+    size_t offset = length;
+    segments.push_back({ offset, byteLength, std::move(writer) });
+    length = Align4(offset + byteLength);
+    return offset;
+}
+
+int GlbWriter::addBufferView(tinygltf::Model& model, size_t byteLength, int target, SegmentWriter writer) {
+    tinygltf::BufferView bufferView;
+    bufferView.buffer = 0;
+    bufferView.byteOffset = addSegment(byteLength, std::move(writer));
+    bufferView.byteLength = byteLength;
+    bufferView.target = target;
+    model.bufferViews.push_back(bufferView);
+    return static_cast<int>(model.bufferViews.size() - 1);
+}
+
+bool GlbWriter::write(const tinygltf::Model& model, const std::string& path, std::string& err) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        err = "cannot open output file " + path;
+        return false;
+    }
+    if (!write(model, out, err)) {
+        if (!out) {
+            err = "failed writing to " + path;
+        }
+        return false;
+    }
+    return true;
+}
+
+bool GlbWriter::write(const tinygltf::Model& model, std::ostream& out, std::string& err, const BinaryObserver& observer) {
+    std::string json = SerializeModelJson(model, length);
+    size_t jsonLength = Align4(json.size());
+    size_t totalLength = 12 + 8 + jsonLength + (length > 0 ? 8 + length : 0);
+    if (totalLength > UINT32_MAX) {
+        err = "glb output exceeds 4 GB limit";
+        return false;
+    }
+
+    WriteUint32(out, GLB_MAGIC);
+    WriteUint32(out, GLB_VERSION);
+    WriteUint32(out, static_cast<uint32_t>(totalLength));
+
+    WriteUint32(out, static_cast<uint32_t>(jsonLength));
+    WriteUint32(out, CHUNK_JSON);
+    out.write(json.data(), json.size());
+    WritePadding(out, jsonLength - json.size(), ' ');
+    json.clear();
+    json.shrink_to_fit();
+
+    if (length > 0) {
+        WriteUint32(out, static_cast<uint32_t>(length));
+        WriteUint32(out, CHUNK_BIN);
+        // with an observer, segments write through it. Streams that cannot report their position skip the size check
+        std::unique_ptr<ObservedStreamBuf> observed;
+        std::unique_ptr<std::ostream> observedOut;
+        if (observer) {
+            observed = std::make_unique<ObservedStreamBuf>(out, observer);
+            observedOut = std::make_unique<std::ostream>(observed.get());
+        }
+        std::ostream& bin = observer ? *observedOut : out;
+        std::streamoff binStart = bin.tellp();
+        for (auto& segment : segments) {
+            if (!segment.writer(bin)) {
+                err = "failed to write glb segment at offset " + std::to_string(segment.offset);
+                return false;
+            }
+            std::streamoff written = bin.tellp() - binStart;
+            if (binStart >= 0 && written != static_cast<std::streamoff>(segment.offset + segment.byteLength)) {
+                err = "glb segment at offset " + std::to_string(segment.offset) + " has wrong size";
+                return false;
+            }
+            WritePadding(bin, Align4(segment.byteLength) - segment.byteLength, 0);
+            segment.writer = nullptr; // release captured data as early as possible
+        }
+    }
+    out.flush();
+    if (!out) {
+        err = "failed writing glb output";
+        return false;
+    }
+    return true;
+}
+
+GlbWriter::SegmentWriter MemorySegment(std::vector<unsigned char>&& data) {
+    auto shared = std::make_shared<std::vector<unsigned char>>(std::move(data));
+    return [shared](std::ostream& out) {
+        out.write(reinterpret_cast<const char*>(shared->data()), shared->size());
+        std::vector<unsigned char>().swap(*shared);
+        return static_cast<bool>(out);
+    };
+}
+
+GlbWriter::SegmentWriter SpanSegment(const unsigned char* data, size_t byteLength, std::shared_ptr<const void> owner) {
+    return [data, byteLength, owner](std::ostream& out) {
+        out.write(reinterpret_cast<const char*>(data), byteLength);
+        return static_cast<bool>(out);
+    };
+}
+
+SinkStreamBuf::SinkStreamBuf(Sink sink)
+    : sink(std::move(sink))
+    , buffer(64 * 1024) {
+    setp(buffer.data(), buffer.data() + buffer.size());
+}
+
+SinkStreamBuf::~SinkStreamBuf() {
+    sync();
+}
+
+bool SinkStreamBuf::flushBuffer() {
+    size_t n = static_cast<size_t>(pptr() - pbase());
+    if (n > 0 && !failed && !sink(reinterpret_cast<const unsigned char*>(pbase()), n)) {
+        failed = true;
+    }
+    written += n;
+    setp(buffer.data(), buffer.data() + buffer.size());
+    return !failed;
+}
+
+SinkStreamBuf::int_type SinkStreamBuf::overflow(int_type ch) {
+    if (!flushBuffer()) {
+        return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(ch);
+        pbump(1);
+    }
+    return traits_type::not_eof(ch);
+}
+
+std::streamsize SinkStreamBuf::xsputn(const char* s, std::streamsize count) {
+    // large blocks go to the sink directly instead of through the buffer
+    if (static_cast<size_t>(count) < buffer.size()) {
+        return std::streambuf::xsputn(s, count);
+    }
+    if (!flushBuffer() || !sink(reinterpret_cast<const unsigned char*>(s), static_cast<size_t>(count))) {
+        failed = true;
+        return 0;
+    }
+    written += static_cast<size_t>(count);
+    return count;
+}
+
+int SinkStreamBuf::sync() {
+    return flushBuffer() ? 0 : -1;
+}
+
+SinkStreamBuf::pos_type SinkStreamBuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+    // only position queries are supported, needed for tellp()
+    if (off != 0 || dir != std::ios_base::cur || !(which & std::ios_base::out)) {
+        return pos_type(off_type(-1));
+    }
+    return pos_type(static_cast<off_type>(written + static_cast<size_t>(pptr() - pbase())));
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include "tiny_gltf.h"
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+// Streaming writer for binary glTF files.
+// The binary chunk layout is planned up front by adding segments with their final size,
+// the model only references them through bufferViews. On write() the json chunk is
+// serialized first, then every segment writer streams its data directly to the file,
+// so no complete copy of the binary chunk is ever held in memory.
+class GlbWriter {
+public:
+    // writes exactly the announced number of bytes, returns false on failure
+    using SegmentWriter = std::function<bool(std::ostream& out)>;
+
+    // sees the binary chunk while it is written: offset in the chunk and the bytes, in order and without gaps
+    using BinaryObserver = std::function<void(size_t offset, const unsigned char* data, size_t size)>;
+
+    // reserve byteLength bytes in the binary chunk. Returns the offset of the segment,
+    // offsets are 4 byte aligned as required for accessor data
+    size_t addSegment(size_t byteLength, SegmentWriter writer);
+
+    // add a segment and a bufferView for it to the model, returns the bufferView index
+    int addBufferView(tinygltf::Model& model, size_t byteLength, int target, SegmentWriter writer);
+
+    // total size of the binary chunk including alignment padding
+    size_t binaryLength() const { return length; }
+
+    // write json and binary chunk, segments are released after they are written
+    bool write(const tinygltf::Model& model, const std::string& path, std::string& err);
+    bool write(const tinygltf::Model& model, std::ostream& out, std::string& err, const BinaryObserver& observer = nullptr);
+
+private:
+    struct Segment {
+        size_t offset;
+        size_t byteLength;
+        SegmentWriter writer;
+    };
+    std::vector<Segment> segments;
+    size_t length = 0;
+};
+
+// segment writer for data that is already in memory, the data is freed once written
+GlbWriter::SegmentWriter MemorySegment(std::vector<unsigned char>&& data);
+
+// segment writer for data owned by someone else, owner keeps it alive until it is written
+GlbWriter::SegmentWriter SpanSegment(const unsigned char* data, size_t byteLength, std::shared_ptr<const void> owner);
+
+// output stream buffer that hands its data to a callback in blocks, used to stream a glb
+// to a caller supplied sink instead of a file
+class SinkStreamBuf : public std::streambuf {
+public:
+    // returns false to abort writing
+    using Sink = std::function<bool(const unsigned char* data, size_t size)>;
+
+    explicit SinkStreamBuf(Sink sink);
+    ~SinkStreamBuf() override;
+
+protected:
+    int_type overflow(int_type ch) override;
+    std::streamsize xsputn(const char* s, std::streamsize count) override;
+    int sync() override;
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+
+private:
+    bool flushBuffer();
+
+    Sink sink;
+    std::vector<char> buffer;
+    size_t written = 0; // bytes handed to the sink
+    bool failed = false;
+};
@@ -0,0 +1,652 @@
+#include "gltf_json.h"
+#include <charconv>
+#include <cstring>
+
+namespace {
+
+const char* TypeName(int type) {
+    switch (type) {
+    case TINYGLTF_TYPE_SCALAR: return "SCALAR";
+    case TINYGLTF_TYPE_VEC2: return "VEC2";
+    case TINYGLTF_TYPE_VEC3: return "VEC3";
+    case TINYGLTF_TYPE_VEC4: return "VEC4";
+    case TINYGLTF_TYPE_MAT2: return "MAT2";
+    case TINYGLTF_TYPE_MAT3: return "MAT3";
+    case TINYGLTF_TYPE_MAT4: return "MAT4";
+    default: return "SCALAR";
+    }
+}
+
+void WriteValue(JsonWriter& w, const tinygltf::Value& v) {
+    if (v.IsBool()) {
+        w.value(v.Get<bool>());
+    } else if (v.IsInt()) {
+        w.value(v.Get<int>());
+    } else if (v.IsReal()) {
+        w.value(v.Get<double>());
+    } else if (v.IsString()) {
+        w.value(v.Get<std::string>());
+    } else if (v.IsArray()) {
+        w.beginArray();
+        for (size_t i = 0; i < v.ArrayLen(); ++i) {
+            WriteValue(w, v.Get(static_cast<int>(i)));
+        }
+        w.endArray();
+    } else if (v.IsObject()) {
+        w.beginObject();
+        for (const auto& key : v.Keys()) {
+            w.key(key.c_str());
+            WriteValue(w, v.Get(key));
+        }
+        w.endObject();
+    } else {
+        w.null();
+    }
+}
+
+void WriteNumbers(JsonWriter& w, const char* name, const std::vector<double>& values) {
+    if (values.empty()) {
+        return;
+    }
+    w.key(name);
+    w.beginArray();
+    for (double v : values) {
+        w.value(v);
+    }
+    w.endArray();
+}
+
+void WriteInts(JsonWriter& w, const char* name, const std::vector<int>& values) {
+    if (values.empty()) {
+        return;
+    }
+    w.key(name);
+    w.beginArray();
+    for (int v : values) {
+        w.value(v);
+    }
+    w.endArray();
+}
+
+void WriteStrings(JsonWriter& w, const char* name, const std::vector<std::string>& values) {
+    if (values.empty()) {
+        return;
+    }
+    w.key(name);
+    w.beginArray();
+    for (const auto& v : values) {
+        w.value(v);
+    }
+    w.endArray();
+}
+
+void WriteName(JsonWriter& w, const std::string& name) {
+    if (!name.empty()) {
+        w.key("name");
+        w.value(name);
+    }
+}
+
+// extensions and extras are written the same way for every object
+void WriteExtensions(JsonWriter& w, const tinygltf::ExtensionMap& extensions, const tinygltf::Value& extras) {
+    if (!extensions.empty()) {
+        w.key("extensions");
+        w.beginObject();
+        for (const auto& ext : extensions) {
+            w.key(ext.first.c_str());
+            WriteValue(w, ext.second);
+        }
+        w.endObject();
+    }
+    if (extras.Type() != tinygltf::NULL_TYPE) {
+        w.key("extras");
+        WriteValue(w, extras);
+    }
+}
+
+// scaleName is "scale" for normal textures and "strength" for occlusion textures, written if not 1.0
+template <typename Info>
+void WriteTextureInfo(JsonWriter& w, const char* name, const Info& info, const char* scaleName = nullptr, double scale = 1.0) {
+    if (info.index < 0) {
+        return;
+    }
+    w.key(name);
+    w.beginObject();
+    w.key("index");
+    w.value(info.index);
+    if (info.texCoord != 0) {
+        w.key("texCoord");
+        w.value(info.texCoord);
+    }
+    if (scaleName && scale != 1.0) {
+        w.key(scaleName);
+        w.value(scale);
+    }
+    WriteExtensions(w, info.extensions, info.extras);
+    w.endObject();
+}
+
+void WriteAccessor(JsonWriter& w, const tinygltf::Accessor& a) {
+    w.beginObject();
+    if (a.bufferView >= 0) {
+        w.key("bufferView");
+        w.value(a.bufferView);
+    }
+    if (a.byteOffset != 0) {
+        w.key("byteOffset");
+        w.value(a.byteOffset);
+    }
+    w.key("componentType");
+    w.value(a.componentType);
+    if (a.normalized) {
+        w.key("normalized");
+        w.value(true);
+    }
+    w.key("count");
+    w.value(a.count);
+    w.key("type");
+    w.value(std::string(TypeName(a.type)));
+    WriteNumbers(w, "min", a.minValues);
+    WriteNumbers(w, "max", a.maxValues);
+    WriteName(w, a.name);
+    WriteExtensions(w, a.extensions, a.extras);
+    w.endObject();
+}
+
+void WriteBufferView(JsonWriter& w, const tinygltf::BufferView& v) {
+    w.beginObject();
+    w.key("buffer");
+    w.value(v.buffer);
+    if (v.byteOffset != 0) {
+        w.key("byteOffset");
+        w.value(v.byteOffset);
+    }
+    w.key("byteLength");
+    w.value(v.byteLength);
+    if (v.byteStride >= 4) {
+        w.key("byteStride");
+        w.value(v.byteStride);
+    }
+    if (v.target != 0) {
+        w.key("target");
+        w.value(v.target);
+    }
+    WriteName(w, v.name);
+    WriteExtensions(w, v.extensions, v.extras);
+    w.endObject();
+}
+
+void WriteImage(JsonWriter& w, const tinygltf::Image& image) {
+    w.beginObject();
+    if (image.bufferView >= 0) {
+        w.key("bufferView");
+        w.value(image.bufferView);
+        w.key("mimeType");
+        w.value(image.mimeType);
+    } else if (!image.uri.empty()) {
+        w.key("uri");
+        w.value(image.uri);
+    }
+    WriteName(w, image.name);
+    WriteExtensions(w, image.extensions, image.extras);
+    w.endObject();
+}
+
+void WriteSampler(JsonWriter& w, const tinygltf::Sampler& s) {
+    w.beginObject();
+    if (s.magFilter >= 0) {
+        w.key("magFilter");
+        w.value(s.magFilter);
+    }
+    if (s.minFilter >= 0) {
+        w.key("minFilter");
+        w.value(s.minFilter);
+    }
+    w.key("wrapS");
+    w.value(s.wrapS);
+    w.key("wrapT");
+    w.value(s.wrapT);
+    WriteName(w, s.name);
+    WriteExtensions(w, s.extensions, s.extras);
+    w.endObject();
+}
+
+void WriteTexture(JsonWriter& w, const tinygltf::Texture& t) {
+    w.beginObject();
+    if (t.sampler >= 0) {
+        w.key("sampler");
+        w.value(t.sampler);
+    }
+    if (t.source >= 0) {
+        w.key("source");
+        w.value(t.source);
+    }
+    WriteName(w, t.name);
+    WriteExtensions(w, t.extensions, t.extras);
+    w.endObject();
+}
+
+void WriteMaterial(JsonWriter& w, const tinygltf::Material& m) {
+    w.beginObject();
+    const tinygltf::PbrMetallicRoughness& pbr = m.pbrMetallicRoughness;
+    w.key("pbrMetallicRoughness");
+    w.beginObject();
+    if (pbr.baseColorFactor != std::vector<double>{ 1.0, 1.0, 1.0, 1.0 }) {
+        WriteNumbers(w, "baseColorFactor", pbr.baseColorFactor);
+    }
+    WriteTextureInfo(w, "baseColorTexture", pbr.baseColorTexture);
+    if (pbr.metallicFactor != 1.0) {
+        w.key("metallicFactor");
+        w.value(pbr.metallicFactor);
+    }
+    if (pbr.roughnessFactor != 1.0) {
+        w.key("roughnessFactor");
+        w.value(pbr.roughnessFactor);
+    }
+    WriteTextureInfo(w, "metallicRoughnessTexture", pbr.metallicRoughnessTexture);
+    WriteExtensions(w, pbr.extensions, pbr.extras);
+    w.endObject();
+
+    WriteTextureInfo(w, "normalTexture", m.normalTexture, "scale", m.normalTexture.scale);
+    WriteTextureInfo(w, "occlusionTexture", m.occlusionTexture, "strength", m.occlusionTexture.strength);
+    WriteTextureInfo(w, "emissiveTexture", m.emissiveTexture);
+    if (m.emissiveFactor != std::vector<double>{ 0.0, 0.0, 0.0 }) {
+        WriteNumbers(w, "emissiveFactor", m.emissiveFactor);
+    }
+    if (m.alphaMode != "OPAQUE") {
+        w.key("alphaMode");
+        w.value(m.alphaMode);
+        if (m.alphaMode == "MASK") {
+            w.key("alphaCutoff");
+            w.value(m.alphaCutoff);
+        }
+    }
+    if (m.doubleSided) {
+        w.key("doubleSided");
+        w.value(true);
+    }
+    WriteName(w, m.name);
+    WriteExtensions(w, m.extensions, m.extras);
+    w.endObject();
+}
+
+void WriteMesh(JsonWriter& w, const tinygltf::Mesh& mesh) {
+    w.beginObject();
+    w.key("primitives");
+    w.beginArray();
+    for (const auto& p : mesh.primitives) {
+        w.beginObject();
+        w.key("attributes");
+        w.beginObject();
+        for (const auto& attribute : p.attributes) {
+            w.key(attribute.first.c_str());
+            w.value(attribute.second);
+        }
+        w.endObject();
+        if (p.indices >= 0) {
+            w.key("indices");
+            w.value(p.indices);
+        }
+        if (p.material >= 0) {
+            w.key("material");
+            w.value(p.material);
+        }
+        if (p.mode >= 0) {
+            w.key("mode");
+            w.value(p.mode);
+        }
+        WriteExtensions(w, p.extensions, p.extras);
+        w.endObject();
+    }
+    w.endArray();
+    WriteName(w, mesh.name);
+    WriteExtensions(w, mesh.extensions, mesh.extras);
+    w.endObject();
+}
+
+void WriteNode(JsonWriter& w, const tinygltf::Node& n) {
+    w.beginObject();
+    if (n.mesh >= 0) {
+        w.key("mesh");
+        w.value(n.mesh);
+    }
+    WriteInts(w, "children", n.children);
+    WriteNumbers(w, "translation", n.translation);
+    WriteNumbers(w, "rotation", n.rotation);
+    WriteNumbers(w, "scale", n.scale);
+    WriteNumbers(w, "matrix", n.matrix);
+    WriteName(w, n.name);
+    WriteExtensions(w, n.extensions, n.extras);
+    w.endObject();
+}
+
+template <typename T, typename F>
+void WriteArray(JsonWriter& w, const char* name, const std::vector<T>& items, F writeItem) {
+    if (items.empty()) {
+        return;
+    }
+    w.key(name);
+    w.beginArray();
+    for (const auto& item : items) {
+        writeItem(w, item);
+    }
+    w.endArray();
+}
+
+// recursive descent json parser producing tinygltf::Value objects
+class JsonParser {
+public:
+    JsonParser(const char* text, size_t length) : p(text), end(text + length) {}
+
+    bool parse(tinygltf::Value& out, std::string& err) {
+        if (!parseValue(out, 0)) {
+            err = error.empty() ? "invalid json" : error;
+            return false;
+        }
+        skipWhitespace();
+        if (p != end) {
+            err = "unexpected data after json value";
+            return false;
+        }
+        return true;
+    }
+
+private:
+    bool fail(const char* message) {
+        if (error.empty()) {
+            error = message;
+        }
+        return false;
+    }
+
+    void skipWhitespace() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            ++p;
+        }
+    }
+
+    bool literal(const char* word) {
+        size_t n = std::strlen(word);
+        if (static_cast<size_t>(end - p) < n || std::memcmp(p, word, n) != 0) {
+            return fail("invalid literal");
+        }
+        p += n;
+        return true;
+    }
+
+    bool parseValue(tinygltf::Value& out, int depth) {
+        if (depth > 64) {
+            return fail("json nested too deep");
+        }
+        skipWhitespace();
+        if (p >= end) {
+            return fail("unexpected end of json");
+        }
+        switch (*p) {
+        case '{': return parseObject(out, depth);
+        case '[': return parseArray(out, depth);
+        case '"': {
+            std::string s;
+            if (!parseString(s)) {
+                return false;
+            }
+            out = tinygltf::Value(std::move(s));
+            return true;
+        }
+        case 't': out = tinygltf::Value(true); return literal("true");
+        case 'f': out = tinygltf::Value(false); return literal("false");
+        case 'n': out = tinygltf::Value(); return literal("null");
+        default: return parseNumber(out);
+        }
+    }
+
+    bool parseObject(tinygltf::Value& out, int depth) {
+        tinygltf::Value::Object object;
+        ++p; // {
+        skipWhitespace();
+        if (p < end && *p == '}') {
+            ++p;
+            out = tinygltf::Value(std::move(object));
+            return true;
+        }
+        for (;;) {
+            skipWhitespace();
+            std::string key;
+            if (p >= end || *p != '"' || !parseString(key)) {
+                return fail("expected object key");
+            }
+            skipWhitespace();
+            if (p >= end || *p != ':') {
+                return fail("expected ':'");
+            }
+            ++p;
+            if (!parseValue(object[key], depth + 1)) {
+                return false;
+            }
+            skipWhitespace();
+            if (p < end && *p == ',') {
+                ++p;
+            } else if (p < end && *p == '}') {
+                ++p;
+                out = tinygltf::Value(std::move(object));
+                return true;
+            } else {
+                return fail("expected ',' or '}'");
+            }
+        }
+    }
+
+    bool parseArray(tinygltf::Value& out, int depth) {
+        tinygltf::Value::Array array;
+        ++p; // [
+        skipWhitespace();
+        if (p < end && *p == ']') {
+            ++p;
+            out = tinygltf::Value(std::move(array));
+            return true;
+        }
+        for (;;) {
+            array.emplace_back();
+            if (!parseValue(array.back(), depth + 1)) {
+                return false;
+            }
+            skipWhitespace();
+            if (p < end && *p == ',') {
+                ++p;
+            } else if (p < end && *p == ']') {
+                ++p;
+                out = tinygltf::Value(std::move(array));
+                return true;
+            } else {
+                return fail("expected ',' or ']'");
+            }
+        }
+    }
+
+    bool parseHex4(uint32_t& cp) {
+        if (end - p < 4) {
+            return fail("invalid unicode escape");
+        }
+        cp = 0;
+        for (int i = 0; i < 4; ++i, ++p) {
+            char c = *p;
+            cp <<= 4;
+            if (c >= '0' && c <= '9') cp |= c - '0';
+            else if (c >= 'a' && c <= 'f') cp |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') cp |= c - 'A' + 10;
+            else return fail("invalid unicode escape");
+        }
+        return true;
+    }
+
+    static void appendUtf8(std::string& s, uint32_t cp) {
+        if (cp < 0x80) {
+            s += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            s += static_cast<char>(0xC0 | (cp >> 6));
+            s += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            s += static_cast<char>(0xE0 | (cp >> 12));
+            s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            s += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            s += static_cast<char>(0xF0 | (cp >> 18));
+            s += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            s += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            s += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool parseString(std::string& s) {
+        ++p; // opening quote
+        while (p < end && *p != '"') {
+            char c = *p++;
+            if (c != '\\') {
+                s += c;
+                continue;
+            }
+            if (p >= end) {
+                break;
+            }
+            char e = *p++;
+            switch (e) {
+            case '"': s += '"'; break;
+            case '\\': s += '\\'; break;
+            case '/': s += '/'; break;
+            case 'b': s += '\b'; break;
+            case 'f': s += '\f'; break;
+            case 'n': s += '\n'; break;
+            case 'r': s += '\r'; break;
+            case 't': s += '\t'; break;
+            case 'u': {
+                uint32_t cp;
+                if (!parseHex4(cp)) {
+                    return false;
+                }
+                if (cp >= 0xD800 && cp <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    p += 2;
+                    uint32_t low;
+                    if (!parseHex4(low)) {
+                        return false;
+                    }
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                }
+                appendUtf8(s, cp);
+                break;
+            }
+            default:
+                return fail("invalid string escape");
+            }
+        }
+        if (p >= end) {
+            return fail("unterminated string");
+        }
+        ++p; // closing quote
+        return true;
+    }
+
+    bool parseNumber(tinygltf::Value& out) {
+        const char* start = p;
+        bool isInteger = true;
+        if (p < end && *p == '-') {
+            ++p;
+        }
+        while (p < end && ((*p >= '0' && *p <= '9') || *p == '.' || *p == 'e' || *p == 'E' || *p == '+' || *p == '-')) {
+            if (*p == '.' || *p == 'e' || *p == 'E') {
+                isInteger = false;
+            }
+            ++p;
+        }
+        if (p == start) {
+            return fail("unexpected character in json");
+        }
+        if (isInteger) {
+            long long v;
+            auto result = std::from_chars(start, p, v);
+            if (result.ec == std::errc() && result.ptr == p && v >= INT32_MIN && v <= INT32_MAX) {
+                out = tinygltf::Value(static_cast<int>(v));
+                return true;
+            }
+        }
+        // std::from_chars for double is not available everywhere yet
+        std::string number(start, p);
+        char* numberEnd = nullptr;
+        double d = std::strtod(number.c_str(), &numberEnd);
+        if (numberEnd != number.c_str() + number.size()) {
+            return fail("invalid number");
+        }
+        out = tinygltf::Value(d);
+        return true;
+    }
+
+    const char* p;
+    const char* end;
+    std::string error;
+};
+
+} // namespace
+
+bool ParseJson(const char* text, size_t length, tinygltf::Value& out, std::string& err) {
+    JsonParser parser(text, length);
+    return parser.parse(out, err);
+}
+
+std::string SerializeModelJson(const tinygltf::Model& model, size_t binaryLength) {
+    JsonWriter w;
+    w.beginObject();
+
+    w.key("asset");
+    w.beginObject();
+    w.key("version");
+    w.value(model.asset.version);
+    if (!model.asset.generator.empty()) {
+        w.key("generator");
+        w.value(model.asset.generator);
+    }
+    if (!model.asset.copyright.empty()) {
+        w.key("copyright");
+        w.value(model.asset.copyright);
+    }
+    if (!model.asset.minVersion.empty()) {
+        w.key("minVersion");
+        w.value(model.asset.minVersion);
+    }
+    WriteExtensions(w, model.asset.extensions, model.asset.extras);
+    w.endObject();
+
+    WriteStrings(w, "extensionsUsed", model.extensionsUsed);
+    WriteStrings(w, "extensionsRequired", model.extensionsRequired);
+    if (model.defaultScene >= 0) {
+        w.key("scene");
+        w.value(model.defaultScene);
+    }
+    WriteArray(w, "scenes", model.scenes, [](JsonWriter& w, const tinygltf::Scene& s) {
+        w.beginObject();
+        WriteInts(w, "nodes", s.nodes);
+        WriteName(w, s.name);
+        WriteExtensions(w, s.extensions, s.extras);
+        w.endObject();
+    });
+    WriteArray(w, "nodes", model.nodes, WriteNode);
+    WriteArray(w, "meshes", model.meshes, WriteMesh);
+    WriteArray(w, "materials", model.materials, WriteMaterial);
+    WriteArray(w, "textures", model.textures, WriteTexture);
+    WriteArray(w, "samplers", model.samplers, WriteSampler);
+    WriteArray(w, "images", model.images, WriteImage);
+    WriteArray(w, "accessors", model.accessors, WriteAccessor);
+    WriteArray(w, "bufferViews", model.bufferViews, WriteBufferView);
+
+    // the only buffer is the glb binary chunk
+    if (binaryLength > 0) {
+        w.key("buffers");
+        w.beginArray();
+        w.beginObject();
+        w.key("byteLength");
+        w.value(binaryLength);
+        w.endObject();
+        w.endArray();
+    }
+    WriteExtensions(w, model.extensions, model.extras);
+    w.endObject();
+    return std::move(w.str());
+}
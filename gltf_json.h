@@ -0,0 +1,75 @@
+#pragma once
+#include "tiny_gltf.h"
+#include <charconv>
+#include <cstdio>
+#include <string>
+
+// minimal json text builder, keeps track of where commas are needed
+class JsonWriter {
+public:
+    void beginObject() { separator(); out += '{'; first = true; }
+    void endObject() { out += '}'; first = false; }
+    void beginArray() { separator(); out += '['; first = true; }
+    void endArray() { out += ']'; first = false; }
+    void key(const char* name) {
+        separator();
+        string(name);
+        out += ':';
+        first = true; // value directly follows the key
+    }
+    void value(int v) { separator(); out += std::to_string(v); }
+    void value(size_t v) { separator(); out += std::to_string(v); }
+    void value(bool v) { separator(); out += v ? "true" : "false"; }
+    void value(double v) {
+        separator();
+        char text[32];
+        auto result = std::to_chars(text, text + sizeof(text), v);
+        out.append(text, result.ptr);
+    }
+    void value(const std::string& v) { separator(); string(v); }
+    void value(const char* v) { separator(); string(v); }
+    void null() { separator(); out += "null"; }
+    // json text that is already complete, e.g. a nested report
+    void raw(const std::string& json) { separator(); out += json; }
+    std::string& str() { return out; }
+
+private:
+    void separator() {
+        if (!first) {
+            out += ',';
+        }
+        first = false;
+    }
+    void string(const std::string& s) {
+        out += '"';
+        for (unsigned char c : s) {
+            switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += static_cast<char>(c);
+                }
+            }
+        }
+        out += '"';
+    }
+
+    std::string out;
+    bool first = true;
+};
+
+// Serialize the json part of a glTF model without touching buffer data.
+// binaryLength is written as byteLength of buffer 0, which is the glb binary chunk.
+std::string SerializeModelJson(const tinygltf::Model& model, size_t binaryLength);
+
+// Parse json text into a tinygltf::Value tree. Used for the json chunk of input glb files,
+// so the binary chunk never has to be copied by tinygltf
+bool ParseJson(const char* text, size_t length, tinygltf::Value& out, std::string& err);
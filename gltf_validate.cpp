@@ -0,0 +1,531 @@
+#include "gltf_validate.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const char* const PNG_SIGNATURE = "\x89PNG\r\n\x1a\n";
+const char* const KTX2_IDENTIFIER = "\xabKTX 20\xbb\r\n\x1a\n";
+const char* const QUANTIZATION_EXTENSION = "KHR_mesh_quantization";
+
+// allowed deviation of normal lengths from 1, normalized integers add their rounding error on top
+const double NORMAL_LENGTH_TOLERANCE = 0.005;
+
+bool Contains(const std::vector<std::string>& list, const std::string& name) {
+    return std::find(list.begin(), list.end(), name) != list.end();
+}
+
+template <typename T>
+bool ValidIndex(int index, const std::vector<T>& list) {
+    return index >= 0 && static_cast<size_t>(index) < list.size();
+}
+
+// largest value of an integer component type, normalized values are divided by it
+double ComponentMax(int componentType) {
+    switch (componentType) {
+    case TINYGLTF_COMPONENT_TYPE_BYTE: return 127.0;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: return 255.0;
+    case TINYGLTF_COMPONENT_TYPE_SHORT: return 32767.0;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: return 65535.0;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: return 4294967295.0;
+    default: return 1.0;
+    }
+}
+
+// value of a running bound in the component type, bounds start at +-infinity
+template <typename T>
+T ClampBound(double v) {
+    if (v >= static_cast<double>(std::numeric_limits<T>::max())) {
+        return std::numeric_limits<T>::max();
+    }
+    if (v <= static_cast<double>(std::numeric_limits<T>::lowest())) {
+        return std::numeric_limits<T>::lowest();
+    }
+    return static_cast<T>(v);
+}
+
+// per component min/max of count elements with N components. Returns false if a float is NaN or infinite
+template <typename T, size_t N>
+bool ScanBoundsN(const unsigned char* data, size_t count, size_t stride, double* min, double* max) {
+    T lo[N], hi[N];
+    for (size_t c = 0; c < N; ++c) {
+        lo[c] = ClampBound<T>(min[c]);
+        hi[c] = ClampBound<T>(max[c]);
+    }
+    bool finite = true;
+    for (size_t i = 0; i < count; ++i, data += stride) {
+        T v[N];
+        std::memcpy(v, data, sizeof(v));
+        for (size_t c = 0; c < N; ++c) {
+            lo[c] = v[c] < lo[c] ? v[c] : lo[c];
+            hi[c] = v[c] > hi[c] ? v[c] : hi[c];
+            if (std::numeric_limits<T>::has_quiet_NaN) {
+                // v - v is 0 for finite values only
+                finite &= v[c] - v[c] == T(0);
+            }
+        }
+    }
+    for (size_t c = 0; c < N; ++c) {
+        min[c] = static_cast<double>(lo[c]);
+        max[c] = static_cast<double>(hi[c]);
+    }
+    return finite;
+}
+
+template <typename T>
+bool ScanBounds(const unsigned char* data, size_t count, size_t stride, size_t components, double* min, double* max) {
+    switch (components) {
+    case 1: return ScanBoundsN<T, 1>(data, count, stride, min, max);
+    case 2: return ScanBoundsN<T, 2>(data, count, stride, min, max);
+    case 3: return ScanBoundsN<T, 3>(data, count, stride, min, max);
+    case 4: return ScanBoundsN<T, 4>(data, count, stride, min, max);
+    default:
+        // matrices, one component at a time
+        bool finite = true;
+        for (size_t c = 0; c < components; ++c) {
+            finite &= ScanBoundsN<T, 1>(data + c * sizeof(T), count, stride, min + c, max + c);
+        }
+        return finite;
+    }
+}
+
+// range of squared lengths of 3 component vectors, scale maps normalized integers to [-1, 1]
+template <typename T>
+void ScanLengths(const unsigned char* data, size_t count, size_t stride, float scale, float& minLength2, float& maxLength2) {
+    float lo = minLength2;
+    float hi = maxLength2;
+    for (size_t i = 0; i < count; ++i, data += stride) {
+        T v[3];
+        std::memcpy(v, data, sizeof(v));
+        float x = std::max(v[0] * scale, -1.0f);
+        float y = std::max(v[1] * scale, -1.0f);
+        float z = std::max(v[2] * scale, -1.0f);
+        float length2 = x * x + y * y + z * z;
+        lo = length2 < lo ? length2 : lo;
+        hi = length2 > hi ? length2 : hi;
+    }
+    minLength2 = lo;
+    maxLength2 = hi;
+}
+
+std::string Number(double v) {
+    char text[32];
+    std::snprintf(text, sizeof(text), "%.9g", v);
+    return text;
+}
+
+} // namespace
+
+bool GltfValidator::begin(const tinygltf::Model& model, size_t binaryLength, std::string& err) {
+    checks.clear();
+    active = 0;
+    consumed = 0;
+    expected = binaryLength;
+
+    for (const auto& name : model.extensionsRequired) {
+        if (!Contains(model.extensionsUsed, name)) {
+            err = "extension " + name + " is required but not listed as used";
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < model.bufferViews.size(); ++i) {
+        const tinygltf::BufferView& view = model.bufferViews[i];
+        std::string what = "bufferView " + std::to_string(i);
+        if (view.buffer != 0 || binaryLength == 0) {
+            err = what + " does not refer to the binary chunk";
+            return false;
+        }
+        if (view.byteLength == 0 || view.byteOffset + view.byteLength > binaryLength) {
+            err = what + " is outside the binary chunk";
+            return false;
+        }
+        if (view.byteStride != 0 && (view.byteStride < 4 || view.byteStride > 252 || view.byteStride % 4 != 0)) {
+            err = what + " has byteStride " + std::to_string(view.byteStride);
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < model.accessors.size(); ++i) {
+        const tinygltf::Accessor& accessor = model.accessors[i];
+        DataCheck check;
+        check.what = "accessor " + std::to_string(i);
+        int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+        int components = tinygltf::GetNumComponentsInType(accessor.type);
+        if (componentSize <= 0 || components <= 0 || accessor.componentType == TINYGLTF_COMPONENT_TYPE_INT
+            || accessor.componentType == TINYGLTF_COMPONENT_TYPE_DOUBLE) {
+            err = check.what + " has an invalid component type or type";
+            return false;
+        }
+        if (accessor.count == 0) {
+            err = check.what + " is empty";
+            return false;
+        }
+        if (accessor.normalized && (accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT
+            || accessor.componentType == TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)) {
+            err = check.what + " cannot be normalized";
+            return false;
+        }
+        if (accessor.minValues.size() != accessor.maxValues.size()
+            || (!accessor.minValues.empty() && accessor.minValues.size() != static_cast<size_t>(components))) {
+            err = check.what + " min/max do not match its type";
+            return false;
+        }
+        if (!ValidIndex(accessor.bufferView, model.bufferViews)) {
+            err = check.what + " has no valid bufferView";
+            return false;
+        }
+        const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+        check.componentType = accessor.componentType;
+        check.components = static_cast<size_t>(components);
+        check.elementSize = check.components * componentSize;
+        check.stride = view.byteStride != 0 ? view.byteStride : check.elementSize;
+        check.count = accessor.count;
+        check.begin = view.byteOffset + accessor.byteOffset;
+        check.normalized = accessor.normalized;
+        if (check.stride < check.elementSize || check.stride % componentSize != 0 || check.begin % componentSize != 0) {
+            err = check.what + " is not aligned to its component size";
+            return false;
+        }
+        if (accessor.byteOffset + (accessor.count - 1) * check.stride + check.elementSize > view.byteLength) {
+            err = check.what + " exceeds bufferView " + std::to_string(accessor.bufferView);
+            return false;
+        }
+        check.bounds = !accessor.minValues.empty();
+        check.declaredMin = accessor.minValues;
+        check.declaredMax = accessor.maxValues;
+        checks.push_back(std::move(check));
+    }
+
+    bool quantization = Contains(model.extensionsUsed, QUANTIZATION_EXTENSION);
+    for (size_t m = 0; m < model.meshes.size(); ++m) {
+        for (size_t p = 0; p < model.meshes[m].primitives.size(); ++p) {
+            const tinygltf::Primitive& primitive = model.meshes[m].primitives[p];
+            std::string what = "mesh " + std::to_string(m) + " primitive " + std::to_string(p);
+            auto position = primitive.attributes.find("POSITION");
+            if (position == primitive.attributes.end()) {
+                err = what + " has no POSITION";
+                return false;
+            }
+            size_t vertexCount = 0;
+            for (const auto& attribute : primitive.attributes) {
+                if (!ValidIndex(attribute.second, model.accessors)) {
+                    err = what + " " + attribute.first + " has no valid accessor";
+                    return false;
+                }
+                const tinygltf::Accessor& accessor = model.accessors[attribute.second];
+                const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+                DataCheck& check = checks[attribute.second];
+                if (vertexCount != 0 && accessor.count != vertexCount) {
+                    err = what + " " + attribute.first + " has " + std::to_string(accessor.count) + " elements, not "
+                        + std::to_string(vertexCount);
+                    return false;
+                }
+                vertexCount = accessor.count;
+                if (check.begin % 4 != 0 || check.stride % 4 != 0) {
+                    err = what + " " + attribute.first + " is not aligned to 4 bytes";
+                    return false;
+                }
+                if (view.target != 0 && view.target != TINYGLTF_TARGET_ARRAY_BUFFER) {
+                    err = what + " " + attribute.first + " is not in a vertex bufferView";
+                    return false;
+                }
+                bool isFloat = accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT;
+                if (attribute.first == "POSITION" || attribute.first == "NORMAL") {
+                    if (accessor.type != TINYGLTF_TYPE_VEC3 || (!isFloat && !quantization)) {
+                        err = what + " " + attribute.first + " has to be a float VEC3";
+                        return false;
+                    }
+                }
+                if (attribute.first == "POSITION" && accessor.minValues.empty()) {
+                    err = what + " POSITION has no min/max";
+                    return false;
+                }
+                if (attribute.first == "NORMAL") {
+                    if (!isFloat && !(accessor.normalized && (accessor.componentType == TINYGLTF_COMPONENT_TYPE_BYTE
+                        || accessor.componentType == TINYGLTF_COMPONENT_TYPE_SHORT))) {
+                        err = what + " NORMAL has to be float or normalized signed integers";
+                        return false;
+                    }
+                    check.unitLength = true;
+                }
+                if (attribute.first.rfind("TEXCOORD_", 0) == 0 && (accessor.type != TINYGLTF_TYPE_VEC2
+                    || (!isFloat && !accessor.normalized && !quantization))) {
+                    err = what + " " + attribute.first + " has to be a VEC2 of floats or normalized integers";
+                    return false;
+                }
+            }
+            if (primitive.mode < -1 || primitive.mode > TINYGLTF_MODE_TRIANGLE_FAN) {
+                err = what + " has an invalid mode";
+                return false;
+            }
+            if (primitive.material != -1 && !ValidIndex(primitive.material, model.materials)) {
+                err = what + " has no valid material";
+                return false;
+            }
+            if (primitive.indices == -1) {
+                continue;
+            }
+            if (!ValidIndex(primitive.indices, model.accessors)) {
+                err = what + " has no valid index accessor";
+                return false;
+            }
+            const tinygltf::Accessor& indices = model.accessors[primitive.indices];
+            const tinygltf::BufferView& view = model.bufferViews[indices.bufferView];
+            if (indices.type != TINYGLTF_TYPE_SCALAR || indices.normalized
+                || (indices.componentType != TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE
+                    && indices.componentType != TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT
+                    && indices.componentType != TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT)) {
+                err = what + " indices have to be unsigned integer scalars";
+                return false;
+            }
+            if (view.byteStride != 0 || (view.target != 0 && view.target != TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER)) {
+                err = what + " indices are not in an index bufferView";
+                return false;
+            }
+            if ((primitive.mode == -1 || primitive.mode == TINYGLTF_MODE_TRIANGLES) && indices.count % 3 != 0) {
+                err = what + " has " + std::to_string(indices.count) + " indices, not a multiple of 3";
+                return false;
+            }
+            // an index accessor shared by primitives has to fit the smallest of them
+            DataCheck& check = checks[primitive.indices];
+            if (check.vertexCount == 0 || vertexCount < check.vertexCount) {
+                check.vertexCount = vertexCount;
+            }
+        }
+    }
+
+    std::vector<int> parents(model.nodes.size(), -1);
+    for (size_t n = 0; n < model.nodes.size(); ++n) {
+        const tinygltf::Node& node = model.nodes[n];
+        std::string what = "node " + std::to_string(n);
+        if (node.mesh != -1 && !ValidIndex(node.mesh, model.meshes)) {
+            err = what + " has no valid mesh";
+            return false;
+        }
+        for (int child : node.children) {
+            if (!ValidIndex(child, model.nodes) || child == static_cast<int>(n) || parents[child] != -1) {
+                err = what + " has an invalid child " + std::to_string(child);
+                return false;
+            }
+            parents[child] = static_cast<int>(n);
+        }
+        auto lod = node.extensions.find("MSFT_lod");
+        if (lod != node.extensions.end()) {
+            const tinygltf::Value& ids = lod->second.Get("ids");
+            for (size_t i = 0; i < ids.ArrayLen(); ++i) {
+                const tinygltf::Value& id = ids.Get(static_cast<int>(i));
+                if (!id.IsInt() || !ValidIndex(id.Get<int>(), model.nodes)) {
+                    err = what + " has an invalid MSFT_lod node";
+                    return false;
+                }
+            }
+        }
+    }
+    for (size_t s = 0; s < model.scenes.size(); ++s) {
+        for (int node : model.scenes[s].nodes) {
+            if (!ValidIndex(node, model.nodes) || parents[node] != -1) {
+                err = "scene " + std::to_string(s) + " has an invalid root node " + std::to_string(node);
+                return false;
+            }
+        }
+    }
+    if (model.defaultScene != -1 && !ValidIndex(model.defaultScene, model.scenes)) {
+        err = "default scene does not exist";
+        return false;
+    }
+
+    for (size_t i = 0; i < model.images.size(); ++i) {
+        const tinygltf::Image& image = model.images[i];
+        DataCheck check;
+        check.what = "image " + std::to_string(i);
+        if (image.bufferView == -1 && !image.uri.empty()) {
+            continue;
+        }
+        if (!ValidIndex(image.bufferView, model.bufferViews) || model.bufferViews[image.bufferView].byteStride != 0) {
+            err = check.what + " has no valid bufferView";
+            return false;
+        }
+        if (image.mimeType == "image/png") {
+            check.signature = PNG_SIGNATURE;
+        } else if (image.mimeType == "image/ktx2") {
+            check.signature = std::string(KTX2_IDENTIFIER, 12);
+        } else {
+            err = check.what + " has mime type '" + image.mimeType + "'";
+            return false;
+        }
+        const tinygltf::BufferView& view = model.bufferViews[image.bufferView];
+        if (view.byteLength < check.signature.size()) {
+            err = check.what + " is too small";
+            return false;
+        }
+        check.begin = view.byteOffset;
+        check.count = 1;
+        check.elementSize = check.signature.size();
+        check.stride = check.elementSize;
+        checks.push_back(std::move(check));
+    }
+    for (size_t i = 0; i < model.textures.size(); ++i) {
+        const tinygltf::Texture& texture = model.textures[i];
+        int source = texture.source;
+        for (const auto& extension : texture.extensions) {
+            if (extension.second.Get("source").IsInt()) {
+                source = extension.second.Get("source").Get<int>();
+            }
+        }
+        if (!ValidIndex(source, model.images)) {
+            err = "texture " + std::to_string(i) + " has no valid image";
+            return false;
+        }
+    }
+    for (size_t i = 0; i < model.materials.size(); ++i) {
+        const tinygltf::Material& material = model.materials[i];
+        for (int texture : { material.pbrMetallicRoughness.baseColorTexture.index, material.pbrMetallicRoughness.metallicRoughnessTexture.index,
+            material.normalTexture.index, material.occlusionTexture.index, material.emissiveTexture.index }) {
+            if (texture != -1 && !ValidIndex(texture, model.textures)) {
+                err = "material " + std::to_string(i) + " refers to texture " + std::to_string(texture);
+                return false;
+            }
+        }
+    }
+
+    for (auto& check : checks) {
+        check.min.assign(check.components, std::numeric_limits<double>::infinity());
+        check.max.assign(check.components, -std::numeric_limits<double>::infinity());
+        // index checks need the largest index, and floats are checked for NaN, even without declared bounds
+        check.bounds = check.bounds || check.vertexCount != 0 || check.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT;
+    }
+    // accessors nothing is checked for are not scanned at all
+    checks.erase(std::remove_if(checks.begin(), checks.end(), [](const DataCheck& check) {
+        return !check.bounds && !check.unitLength && check.signature.empty();
+    }), checks.end());
+    std::stable_sort(checks.begin(), checks.end(), [](const DataCheck& a, const DataCheck& b) { return a.begin < b.begin; });
+    return true;
+}
+
+void GltfValidator::scan(DataCheck& check, const unsigned char* data, size_t count) {
+    if (!check.signature.empty()) {
+        if (std::memcmp(data, check.signature.data(), check.signature.size()) != 0) {
+            check.error = check.what + " data does not start with the signature of its mime type";
+        }
+        return;
+    }
+    switch (check.componentType) {
+    case TINYGLTF_COMPONENT_TYPE_BYTE: scanAs<int8_t>(check, data, count); break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: scanAs<uint8_t>(check, data, count); break;
+    case TINYGLTF_COMPONENT_TYPE_SHORT: scanAs<int16_t>(check, data, count); break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: scanAs<uint16_t>(check, data, count); break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: scanAs<uint32_t>(check, data, count); break;
+    case TINYGLTF_COMPONENT_TYPE_FLOAT: scanAs<float>(check, data, count); break;
+    }
+}
+
+template <typename T>
+void GltfValidator::scanAs(DataCheck& check, const unsigned char* data, size_t count) {
+    if (check.bounds && !ScanBounds<T>(data, count, check.stride, check.components, check.min.data(), check.max.data())) {
+        check.finite = false;
+    }
+    if (check.unitLength) {
+        float scale = check.normalized ? static_cast<float>(1.0 / ComponentMax(check.componentType)) : 1.0f;
+        ScanLengths<T>(data, count, check.stride, scale, check.minLength2, check.maxLength2);
+    }
+}
+
+void GltfValidator::consume(size_t offset, const unsigned char* data, size_t size) {
+    size_t blockEnd = offset + size;
+    consumed = blockEnd;
+    for (size_t i = active; i < checks.size() && checks[i].begin < blockEnd; ++i) {
+        DataCheck& check = checks[i];
+        while (check.next < check.count) {
+            size_t element = check.begin + check.next * check.stride;
+            size_t from = element + check.carried;
+            if (from >= blockEnd) {
+                break;
+            }
+            if (from < offset) {
+                check.error = check.what + " data was skipped";
+                check.next = check.count;
+                break;
+            }
+            if (check.carried == 0 && element >= offset && element + check.elementSize <= blockEnd) {
+                // all complete elements of this block at once
+                size_t n = std::min(check.count - check.next, (blockEnd - element - check.elementSize) / check.stride + 1);
+                scan(check, data + (element - offset), n);
+                check.next += n;
+                continue;
+            }
+            // element split between blocks
+            size_t available = std::min(blockEnd, element + check.elementSize) - from;
+            std::memcpy(check.carry + check.carried, data + (from - offset), available);
+            check.carried += available;
+            if (check.carried < check.elementSize) {
+                break;
+            }
+            scan(check, check.carry, 1);
+            check.carried = 0;
+            ++check.next;
+        }
+    }
+    while (active < checks.size() && checks[active].next == checks[active].count) {
+        ++active;
+    }
+}
+
+bool GltfValidator::finish(std::string& err) {
+    if (consumed < expected) {
+        err = "binary chunk ends after " + std::to_string(consumed) + " of " + std::to_string(expected) + " bytes";
+        return false;
+    }
+    for (const auto& check : checks) {
+        if (!check.error.empty()) {
+            err = check.error;
+            return false;
+        }
+        if (check.next < check.count) {
+            err = check.what + " data is incomplete";
+            return false;
+        }
+        if (!check.finite) {
+            err = check.what + " contains NaN or infinite values";
+            return false;
+        }
+        for (size_t c = 0; c < check.declaredMin.size(); ++c) {
+            // float bounds only have to match after rounding to float, exports write them with fewer digits
+            bool isFloat = check.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT;
+            bool minMatches = isFloat ? static_cast<float>(check.declaredMin[c]) == static_cast<float>(check.min[c])
+                                      : check.declaredMin[c] == check.min[c];
+            bool maxMatches = isFloat ? static_cast<float>(check.declaredMax[c]) == static_cast<float>(check.max[c])
+                                      : check.declaredMax[c] == check.max[c];
+            if (!minMatches || !maxMatches) {
+                err = check.what + " declares min " + Number(check.declaredMin[c]) + " max " + Number(check.declaredMax[c])
+                    + " for component " + std::to_string(c) + ", the data has " + Number(check.min[c]) + " " + Number(check.max[c]);
+                return false;
+            }
+        }
+        if (check.vertexCount != 0 && (check.max[0] >= static_cast<double>(check.vertexCount)
+            || check.max[0] == ComponentMax(check.componentType))) {
+            err = check.what + " contains index " + Number(check.max[0]) + ", there are " + std::to_string(check.vertexCount) + " vertices";
+            return false;
+        }
+        if (check.unitLength) {
+            double tolerance = NORMAL_LENGTH_TOLERANCE;
+            if (check.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) {
+                // rounding of each component is at most half a step
+                tolerance += std::sqrt(3.0) * 0.5 / ComponentMax(check.componentType);
+            }
+            double low = 1.0 - tolerance;
+            double high = 1.0 + tolerance;
+            // length2 is accumulated in float, which is exact enough for a tolerance of this size
+            if (!(check.minLength2 >= low * low) || !(check.maxLength2 <= high * high)) {
+                double worst = std::abs(std::sqrt(check.minLength2) - 1.0) > std::abs(std::sqrt(check.maxLength2) - 1.0)
+                    ? check.minLength2 : check.maxLength2;
+                err = check.what + " contains a normal of length " + Number(std::sqrt(worst));
+                return false;
+            }
+        }
+    }
+    return true;
+}
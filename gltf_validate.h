@@ -0,0 +1,59 @@
+#pragma once
+#include "tiny_gltf.h"
+#include <string>
+#include <vector>
+
+// Validation of the glb we write, without writing it twice or parsing it back.
+// begin() checks the model: references, accessor and bufferView bounds and alignment, and required fields.
+// The binary chunk is then shown to consume() while GlbWriter streams it, in one pass: index values are
+// checked against the vertex count, declared min/max against the data, normals for unit length and
+// embedded images for their png / ktx2 signature. finish() reports the first problem of the data checks
+class GltfValidator {
+public:
+    // structural checks, binaryLength is the size of the binary chunk the model refers to
+    bool begin(const tinygltf::Model& model, size_t binaryLength, std::string& err);
+
+    // bytes of the binary chunk at offset, offsets have to follow each other without gaps
+    void consume(size_t offset, const unsigned char* data, size_t size);
+
+    // result of the data checks, all bytes have to be consumed
+    bool finish(std::string& err);
+
+private:
+    // running check of one accessor or image
+    struct DataCheck {
+        std::string what;      // e.g. "accessor 3", for messages
+        size_t begin = 0;      // binary chunk offset of the first element
+        size_t count = 0;
+        size_t stride = 0;
+        size_t elementSize = 0;
+        int componentType = 0;
+        size_t components = 0;
+        bool normalized = false;
+        bool bounds = false;   // compare declared min/max with the data
+        bool unitLength = false;
+        uint64_t vertexCount = 0; // index accessors: indices have to be below, 0: no index check
+        std::vector<double> declaredMin, declaredMax;
+        std::string signature; // images: expected first bytes, count is 1 and elementSize the signature length
+
+        // state while consuming
+        size_t next = 0; // next element
+        size_t carried = 0; // bytes of element next seen in earlier blocks
+        unsigned char carry[64];
+        std::vector<double> min, max;
+        bool finite = true;
+        float minLength2 = 1.0f, maxLength2 = 1.0f;
+        std::string error; // signature mismatch or missing data, found while consuming
+
+        size_t end() const { return begin + (count - 1) * stride + elementSize; }
+    };
+
+    void scan(DataCheck& check, const unsigned char* data, size_t count);
+    template <typename T>
+    void scanAs(DataCheck& check, const unsigned char* data, size_t count);
+
+    std::vector<DataCheck> checks; // sorted by begin
+    size_t active = 0; // first check that is not finished
+    size_t consumed = 0;
+    size_t expected = 0;
+};
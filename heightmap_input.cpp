@@ -0,0 +1,218 @@
+#include "heightmap_input.h"
+#include "tiny_gltf.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <cctype>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HEIGHTMAP_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define HEIGHTMAP_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// rows per parallelFor task
+const size_t ROWS_PER_BAND = 64;
+
+// lower case file extension including the dot, e.g. ".r16"
+std::string Extension(const std::string& name) {
+    size_t dot = name.find_last_of('.');
+    std::string extension = dot == std::string::npos ? std::string() : name.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+    return extension;
+}
+
+// side of a square raw heightmap of size bytes, 0 if it is not square
+size_t SquareSide(size_t size, size_t sampleBytes) {
+    size_t samples = size / sampleBytes;
+    size_t side = static_cast<size_t>(std::llround(std::sqrt(static_cast<double>(samples))));
+    return side * side * sampleBytes == size ? side : 0;
+}
+
+// Unit normals of one row from central differences, one sided at the first and last column.
+// above and below are the neighbouring rows (the row itself at the border), scaleX and scaleZ turn
+// sample differences into height differences per unit, including the distance of the samples
+void RowNormals(const float* above, const float* row, const float* below, size_t columns, float scaleX, float scaleZ, float* normals) {
+    auto normal = [&](size_t c, float dx, float* n) {
+        float nx = dx;
+        float nz = (above[c] - below[c]) * scaleZ;
+        float length = std::sqrt(nx * nx + 1.0f + nz * nz);
+        n[0] = nx / length;
+        n[1] = 1.0f / length;
+        n[2] = nz / length;
+    };
+    normal(0, (row[0] - row[1]) * 2.0f * scaleX, normals);
+    size_t c = 1;
+#if defined(HEIGHTMAP_SSE2)
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 sx = _mm_set1_ps(scaleX);
+    const __m128 sz = _mm_set1_ps(scaleZ);
+    for (; c + 4 < columns; c += 4) {
+        __m128 nx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(row + c - 1), _mm_loadu_ps(row + c + 1)), sx);
+        __m128 nz = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(above + c), _mm_loadu_ps(below + c)), sz);
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), one), _mm_mul_ps(nz, nz)));
+        __m128 x = _mm_div_ps(nx, length);
+        __m128 y = _mm_div_ps(one, length);
+        __m128 z = _mm_div_ps(nz, length);
+        // x0 x1 x2 x3, y.., z.. -> x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+        __m128 xy01 = _mm_unpacklo_ps(x, y);
+        __m128 xy23 = _mm_unpackhi_ps(x, y);
+        __m128 z0x1 = _mm_shuffle_ps(z, xy01, _MM_SHUFFLE(2, 2, 0, 0));
+        __m128 y1z1 = _mm_shuffle_ps(xy01, z, _MM_SHUFFLE(1, 1, 3, 3));
+        __m128 z2x3 = _mm_shuffle_ps(z, xy23, _MM_SHUFFLE(2, 2, 2, 2));
+        __m128 y3z3 = _mm_shuffle_ps(xy23, z, _MM_SHUFFLE(3, 3, 3, 3));
+        float* out = normals + c * 3;
+        _mm_storeu_ps(out, _mm_shuffle_ps(xy01, z0x1, _MM_SHUFFLE(2, 0, 1, 0)));
+        _mm_storeu_ps(out + 4, _mm_shuffle_ps(y1z1, xy23, _MM_SHUFFLE(1, 0, 2, 0)));
+        _mm_storeu_ps(out + 8, _mm_shuffle_ps(z2x3, y3z3, _MM_SHUFFLE(2, 0, 2, 0)));
+    }
+#elif defined(HEIGHTMAP_NEON)
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    for (; c + 4 < columns; c += 4) {
+        float32x4_t nx = vmulq_n_f32(vsubq_f32(vld1q_f32(row + c - 1), vld1q_f32(row + c + 1)), scaleX);
+        float32x4_t nz = vmulq_n_f32(vsubq_f32(vld1q_f32(above + c), vld1q_f32(below + c)), scaleZ);
+        float32x4_t length = vsqrtq_f32(vaddq_f32(vaddq_f32(vmulq_f32(nx, nx), one), vmulq_f32(nz, nz)));
+        float32x4x3_t n;
+        n.val[0] = vdivq_f32(nx, length);
+        n.val[1] = vdivq_f32(one, length);
+        n.val[2] = vdivq_f32(nz, length);
+        vst3q_f32(normals + c * 3, n);
+    }
+#endif
+    for (; c + 1 < columns; ++c) {
+        normal(c, (row[c - 1] - row[c + 1]) * scaleX, normals + c * 3);
+    }
+    normal(columns - 1, (row[columns - 2] - row[columns - 1]) * 2.0f * scaleX, normals + (columns - 1) * 3);
+}
+
+} // namespace
+
+bool LoadHeightmap(const unsigned char* data, size_t size, const std::string& name, Heightmap& map, std::string& err) {
+    static const unsigned char pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    std::string extension = Extension(name);
+    if (size >= 8 && std::memcmp(data, pngSignature, 8) == 0) {
+        // 8 bit pngs are widened to 16 bit by the decoder
+        int width = 0, height = 0, channels = 0;
+        stbi_us* pixels = size <= INT_MAX ? stbi_load_16_from_memory(data, static_cast<int>(size), &width, &height, &channels, 1) : nullptr;
+        if (!pixels) {
+            err = "Cannot decode heightmap " + name;
+            return false;
+        }
+        map.columns = static_cast<size_t>(width);
+        map.rows = static_cast<size_t>(height);
+        map.samples.resize(map.columns * map.rows);
+        for (size_t i = 0; i < map.samples.size(); ++i) {
+            map.samples[i] = pixels[i] * (1.0f / 65535.0f);
+        }
+        stbi_image_free(pixels);
+    } else if (extension == ".raw" || extension == ".r16") {
+        map.columns = map.rows = SquareSide(size, 2);
+        map.samples.resize(map.columns * map.rows);
+        for (size_t i = 0; i < map.samples.size(); ++i) {
+            map.samples[i] = (data[2 * i] | (data[2 * i + 1] << 8)) * (1.0f / 65535.0f);
+        }
+    } else if (extension == ".r32") {
+        map.columns = map.rows = SquareSide(size, 4);
+        map.samples.resize(map.columns * map.rows);
+        std::memcpy(map.samples.data(), data, map.samples.size() * sizeof(float));
+    } else {
+        err = "Heightmap " + name + " is not a png, .raw, .r16 or .r32 file";
+        return false;
+    }
+    if (map.columns < 2 || map.rows < 2) {
+        err = "Heightmap " + name + " needs at least 2 x 2 samples, raw heightmaps have to be square";
+        return false;
+    }
+    if (map.columns * map.rows > UINT32_MAX) {
+        err = "Heightmap " + name + " has too many samples for 32 bit indices";
+        return false;
+    }
+    for (float sample : map.samples) {
+        if (!std::isfinite(sample)) {
+            err = "Heightmap " + name + " contains NaN or infinite heights";
+            return false;
+        }
+    }
+    return true;
+}
+
+SourceMesh BuildHeightmapMesh(const Heightmap& map, const TerrainSize& size, ThreadPool& pool) {
+    const size_t columns = map.columns;
+    const size_t rows = map.rows;
+    const size_t vertexCount = columns * rows;
+    const float stepX = size.width / static_cast<float>(columns - 1);
+    const float stepZ = size.length / static_cast<float>(rows - 1);
+    std::vector<float> positions(vertexCount * 3);
+    std::vector<float> normals(vertexCount * 3);
+    std::vector<float> texCoords(vertexCount * 2);
+    std::vector<uint32_t> indices((columns - 1) * (rows - 1) * 6);
+
+    const size_t bands = (rows + ROWS_PER_BAND - 1) / ROWS_PER_BAND;
+    std::vector<float> bandMin(bands, FLT_MAX), bandMax(bands, -FLT_MAX);
+    pool.parallelFor(bands, [&](size_t band) {
+        for (size_t r = band * ROWS_PER_BAND; r < std::min(rows, (band + 1) * ROWS_PER_BAND); ++r) {
+            const float* row = &map.samples[r * columns];
+            float* p = &positions[r * columns * 3];
+            float* t = &texCoords[r * columns * 2];
+            float z = static_cast<float>(r) * stepZ;
+            float v = static_cast<float>(r) / static_cast<float>(rows - 1);
+            for (size_t c = 0; c < columns; ++c) {
+                float y = row[c] * size.height;
+                p[c * 3 + 0] = static_cast<float>(c) * stepX;
+                p[c * 3 + 1] = y;
+                p[c * 3 + 2] = z;
+                t[c * 2 + 0] = static_cast<float>(c) / static_cast<float>(columns - 1);
+                t[c * 2 + 1] = v;
+                bandMin[band] = std::min(bandMin[band], y);
+                bandMax[band] = std::max(bandMax[band], y);
+            }
+
+            // one sided differences in the first and last row
+            size_t r0 = r > 0 ? r - 1 : r;
+            size_t r1 = r + 1 < rows ? r + 1 : r;
+            float scaleX = size.height / (2.0f * stepX);
+            float scaleZ = size.height / (static_cast<float>(r1 - r0) * stepZ);
+            RowNormals(&map.samples[r0 * columns], row, &map.samples[r1 * columns], columns, scaleX, scaleZ, &normals[r * columns * 3]);
+
+            if (r + 1 < rows) {
+                uint32_t* cell = &indices[r * (columns - 1) * 6];
+                for (size_t c = 0; c + 1 < columns; ++c, cell += 6) {
+                    uint32_t v00 = static_cast<uint32_t>(r * columns + c);
+                    uint32_t v01 = v00 + 1;
+                    uint32_t v10 = v00 + static_cast<uint32_t>(columns);
+                    uint32_t v11 = v10 + 1;
+                    cell[0] = v00;
+                    cell[1] = v10;
+                    cell[2] = v01;
+                    cell[3] = v01;
+                    cell[4] = v10;
+                    cell[5] = v11;
+                }
+            }
+        }
+    });
+
+    float minHeight = *std::min_element(bandMin.begin(), bandMin.end());
+    float maxHeight = *std::max_element(bandMax.begin(), bandMax.end());
+    std::vector<double> positionMin = { 0.0, minHeight, 0.0 };
+    std::vector<double> positionMax = { positions[(columns - 1) * 3], maxHeight, positions[(vertexCount - 1) * 3 + 2] };
+    size_t indexCount = indices.size();
+
+    SourceMesh mesh;
+    mesh.positions = OwnedAttribute(std::move(positions), vertexCount, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3);
+    mesh.positions.min = positionMin;
+    mesh.positions.max = positionMax;
+    mesh.normals = OwnedAttribute(std::move(normals), vertexCount, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3);
+    mesh.texCoords = OwnedAttribute(std::move(texCoords), vertexCount, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC2);
+    mesh.texCoords.min = { 0.0, 0.0 };
+    mesh.texCoords.max = { 1.0, 1.0 };
+    mesh.indices = OwnedAttribute(std::move(indices), indexCount, TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT, TINYGLTF_TYPE_SCALAR);
+    return mesh;
+}
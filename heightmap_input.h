@@ -0,0 +1,29 @@
+#pragma once
+#include "mesh_input.h"
+#include "thread_pool.h"
+#include <string>
+#include <vector>
+
+// heightmap samples, row major. Integer exports are normalized to [0, 1], float exports keep their values
+struct Heightmap {
+    size_t columns = 0;
+    size_t rows = 0;
+    std::vector<float> samples;
+};
+
+// size of the terrain a heightmap covers, in mesh units
+struct TerrainSize {
+    float width = 0.0f;  // x extent of the heightmap columns
+    float length = 0.0f; // z extent of the heightmap rows
+    float height = 0.0f; // y of sample value 1, samples of 0 are at y 0
+};
+
+// Decode a WorldCreator heightmap export: 8 or 16 bit grayscale png, 16 bit little endian raw (.raw, .r16)
+// or 32 bit float raw (.r32). Raw files have no header, they have to be square. name selects the raw format
+bool LoadHeightmap(const unsigned char* data, size_t size, const std::string& name, Heightmap& map, std::string& err);
+
+// Generate the mesh the Gltf2 export would have: one vertex per sample with x / z from 0 to the terrain size,
+// y up, texture coordinates from 0 to 1 along x and z, and two triangles per cell facing +y with 32 bit indices.
+// Normals are central differences of the heights, computed with vector instructions.
+// Bands of rows are built in parallel on the pool. The mesh owns its data
+SourceMesh BuildHeightmapMesh(const Heightmap& map, const TerrainSize& size, ThreadPool& pool);
@@ -0,0 +1,141 @@
+#include "ktx2_writer.h"
+#include "texture_kernels.h"
+#include <cstring>
+
+namespace {
+
+// Vulkan formats of the block compressed levels
+const uint32_t VK_FORMAT_BC4_UNORM_BLOCK = 139;
+const uint32_t VK_FORMAT_BC5_UNORM_BLOCK = 141;
+const uint32_t VK_FORMAT_BC7_UNORM_BLOCK = 145;
+const uint32_t VK_FORMAT_BC7_SRGB_BLOCK = 146;
+
+// data format descriptor values (Khronos Data Format Specification)
+const uint32_t KHR_DF_MODEL_BC4 = 131;
+const uint32_t KHR_DF_MODEL_BC5 = 132;
+const uint32_t KHR_DF_MODEL_BC7 = 134;
+const uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+const uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+const uint32_t KHR_DF_TRANSFER_SRGB = 2;
+
+const size_t KTX2_HEADER_SIZE = 80;
+const size_t KTX2_LEVEL_ENTRY_SIZE = 24;
+
+void Put32(std::vector<unsigned char>& out, size_t offset, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        out[offset + i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+void Put64(std::vector<unsigned char>& out, size_t offset, uint64_t value) {
+    Put32(out, offset, static_cast<uint32_t>(value));
+    Put32(out, offset + 4, static_cast<uint32_t>(value >> 32));
+}
+
+void Append32(std::vector<unsigned char>& out, uint32_t value) {
+    out.resize(out.size() + 4);
+    Put32(out, out.size() - 4, value);
+}
+
+void AlignTo(std::vector<unsigned char>& out, size_t alignment) {
+    out.resize((out.size() + alignment - 1) / alignment * alignment, 0);
+}
+
+// basic data format descriptor of a block compressed format: one sample per 64 bit half that holds a channel
+void AppendDataFormatDescriptor(std::vector<unsigned char>& out, BcFormat format, bool srgb) {
+    struct Sample {
+        uint32_t bitOffset, bitLength, channel;
+    };
+    // red in the whole 64 bit (BC4) or 128 bit (BC7) block, red and green halves for BC5
+    std::vector<Sample> samples{ { 0, format == BcFormat::BC7 ? 127u : 63u, 0 } };
+    if (format == BcFormat::BC5) {
+        samples.push_back({ 64, 63, 1 });
+    }
+    uint32_t model = 0;
+    switch (format) {
+    case BcFormat::BC4: model = KHR_DF_MODEL_BC4; break;
+    case BcFormat::BC5: model = KHR_DF_MODEL_BC5; break;
+    case BcFormat::BC7: model = KHR_DF_MODEL_BC7; break;
+    }
+    uint32_t blockSize = 24 + 16 * static_cast<uint32_t>(samples.size());
+    Append32(out, 4 + blockSize); // dfdTotalSize
+    Append32(out, 0); // vendorId and descriptorType: Khronos basic descriptor
+    Append32(out, 2 | (blockSize << 16)); // versionNumber, descriptorBlockSize
+    Append32(out, model | (KHR_DF_PRIMARIES_BT709 << 8) | ((srgb ? KHR_DF_TRANSFER_SRGB : KHR_DF_TRANSFER_LINEAR) << 16));
+    Append32(out, 3 | (3 << 8)); // texel block dimensions 4x4, stored minus one
+    Append32(out, static_cast<uint32_t>(BcBlockSize(format))); // bytesPlane0
+    Append32(out, 0);
+    for (const Sample& sample : samples) {
+        Append32(out, sample.bitOffset | (sample.bitLength << 16) | (sample.channel << 24));
+        Append32(out, 0); // sample position
+        Append32(out, 0); // sampleLower
+        Append32(out, 0xFFFFFFFF); // sampleUpper
+    }
+}
+
+} // namespace
+
+std::vector<unsigned char> EncodeKtx2(const uint8_t* rgba, int width, int height, BcFormat format, MipFilter filter, ThreadPool& pool) {
+    bool srgb = filter == MipFilter::Srgb && format == BcFormat::BC7;
+    uint32_t vkFormat = format == BcFormat::BC4 ? VK_FORMAT_BC4_UNORM_BLOCK
+        : format == BcFormat::BC5             ? VK_FORMAT_BC5_UNORM_BLOCK
+        : srgb                                ? VK_FORMAT_BC7_SRGB_BLOCK
+                                              : VK_FORMAT_BC7_UNORM_BLOCK;
+
+    // compress the levels, every level is filtered from the previous one
+    std::vector<std::vector<uint8_t>> levels;
+    std::vector<uint8_t> mip;
+    const uint8_t* current = rgba;
+    int levelWidth = width, levelHeight = height;
+    for (;;) {
+        levels.push_back(CompressImage(current, levelWidth, levelHeight, format, pool));
+        if (levelWidth == 1 && levelHeight == 1) {
+            break;
+        }
+        int nextWidth, nextHeight;
+        mip = Downsample(current, levelWidth, levelHeight, 4, filter, pool, nextWidth, nextHeight);
+        current = mip.data();
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
+
+    std::vector<unsigned char> out(KTX2_HEADER_SIZE + levels.size() * KTX2_LEVEL_ENTRY_SIZE, 0);
+    static const unsigned char identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+    std::memcpy(out.data(), identifier, sizeof(identifier));
+    Put32(out, 12, vkFormat);
+    Put32(out, 16, 1); // typeSize
+    Put32(out, 20, static_cast<uint32_t>(width));
+    Put32(out, 24, static_cast<uint32_t>(height));
+    Put32(out, 28, 0); // pixelDepth
+    Put32(out, 32, 0); // layerCount
+    Put32(out, 36, 1); // faceCount
+    Put32(out, 40, static_cast<uint32_t>(levels.size()));
+    Put32(out, 44, 0); // no supercompression
+
+    size_t dfdOffset = out.size();
+    AppendDataFormatDescriptor(out, format, srgb);
+    Put32(out, 48, static_cast<uint32_t>(dfdOffset));
+    Put32(out, 52, static_cast<uint32_t>(out.size() - dfdOffset));
+
+    // key/value data: the recommended KTXwriter entry
+    size_t kvdOffset = out.size();
+    static const char writerEntry[] = "KTXwriter\0WorldCreatorToGLTF";
+    Append32(out, sizeof(writerEntry));
+    out.insert(out.end(), writerEntry, writerEntry + sizeof(writerEntry));
+    AlignTo(out, 4);
+    Put32(out, 56, static_cast<uint32_t>(kvdOffset));
+    Put32(out, 60, static_cast<uint32_t>(out.size() - kvdOffset));
+
+    // level data, smallest level first. Offsets are aligned to the block size
+    for (size_t level = levels.size(); level-- > 0;) {
+        AlignTo(out, BcBlockSize(format));
+        size_t entry = KTX2_HEADER_SIZE + level * KTX2_LEVEL_ENTRY_SIZE;
+        Put64(out, entry, out.size());
+        Put64(out, entry + 8, levels[level].size());
+        Put64(out, entry + 16, levels[level].size());
+        out.insert(out.end(), levels[level].begin(), levels[level].end());
+        levels[level].clear();
+        levels[level].shrink_to_fit();
+    }
+    return out;
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include "bc_encoder.h"
+#include "texture_kernels.h"
+#include "thread_pool.h"
+#include <cstdint>
+#include <vector>
+
+// Build the full mip chain of an rgba image, block compress every level and wrap it in a KTX2 container.
+// Compression of each level is spread over the pool
+std::vector<unsigned char> EncodeKtx2(const uint8_t* rgba, int width, int height, BcFormat format, MipFilter filter, ThreadPool& pool);
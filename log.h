@@ -0,0 +1,32 @@
+#pragma once
+#include <iostream>
+#include <sstream>
+#include <string>
+
+// Log writes progress messages of the command line tool
+#if defined(_WIN64)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
+#include <windows.h>
+#define Log(x)\
+{\
+    std::stringstream s1768;  s1768 << x; \
+    std::string str = s1768.str(); \
+    std::wstring wstr(str.begin(), str.end()); \
+    std::wstringstream wss(wstr); \
+    OutputDebugString(wss.str().c_str()); \
+    std::cout << str << std::endl; \
+}
+#elif defined(__APPLE__)
+#define Log(x)\
+{\
+    std::stringstream s1765; s1765 << x; \
+	printf("%s", s1765.str().c_str()); \
+}
+#else
+#define Log(x)\
+{\
+    std::stringstream s1765; s1765 << x; \
+    std::cout << s1765.str(); \
+}
+#endif
@@ -1,549 +1,552 @@
-#define TINYGLTF_IMPLEMENTATION
-#define STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include "tiny_gltf.h"
+#include "converter.h"
+#include "log.h"
 #include <iostream>
+#include <fstream>
 #include <vector>
-#include <array>
+#include <filesystem>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include "thread_pool.h"
+#include "batch_input.h"
+#include "conversion_cache.h"
+#include "folder_watch.h"
+#include "conversion_stats.h"
 
-#if defined(_WIN64)
-#define NOMINMAX
-#define WIN32_LEAN_AND_MEAN             // Exclude rarely-used stuff from Windows headers
-#include <windows.h>
-#define Log(x)\
-{\
-    std::stringstream s1768;  s1768 << x; \
-    std::string str = s1768.str(); \
-    std::wstring wstr(str.begin(), str.end()); \
-    std::wstringstream wss(wstr); \
-    OutputDebugString(wss.str().c_str()); \
-    std::cout << str << std::endl; \
-}
-#elif defined(__APPLE__)
-#define Log(x)\
-{\
-    std::stringstream s1765; s1765 << x; \
-	printf("%s", s1765.str().c_str()); \
-}
-#else
-#define Log(x)\
-{\
-    std::stringstream s1765; s1765 << x; \
+void usage() {
+    Log("Usage: WorldCreatorToGLTF [options] <BaseName> <InputFolder> [<OutputFolder>]" << std::endl);
+    Log("       WorldCreatorToGLTF [options] --batch <Manifest|Folder> [<OutputFolder>]" << std::endl);
+    Log("  typical use: WorldCreatorToGLTF Terrain c:/export " << std::endl);
+    Log("    will produce Terrain.glb in folder c:/export " << std::endl);
+    Log("Options:" << std::endl);
+    Log("  --jobs N    use at most N threads for texture processing (default: all cores)" << std::endl);
+    Log("  --reencode  decode and encode all textures again instead of embedding source pngs unchanged" << std::endl);
+    Log("  --ktx2      store textures block compressed (BC7/BC5/BC4) with mip maps in KTX2 containers" << std::endl);
+    Log("  --png-level L  speed / size of encoded pngs: store, rle, fast, default or max (default: default)" << std::endl);
+    Log("  --orm       pack occlusion into the red channel of the metallic-roughness texture" << std::endl);
+    Log("  --quantize  store vertex attributes as 16/8 bit integers (KHR_mesh_quantization)" << std::endl);
+    Log("  --optimize-mesh  reorder triangles and vertices for the GPU vertex cache, use 16 bit indices" << std::endl);
+    Log("  --tiles N   split the terrain into N x N tiles in a quadtree of nodes, N a power of 2" << std::endl);
+    Log("  --lods L    levels of detail per tile, referenced with MSFT_lod (default: 3 when tiling)" << std::endl);
+    Log("  --max-error E  simplify the terrain so heights differ at most E from the export (per level: E * 2^level)" << std::endl);
+    Log("  --max-texture-size N[,N...]  halve larger maps until they fit into N x N. Several sizes write one glb" << std::endl);
+    Log("              per size, e.g. 8192,2048,512 gives <BaseName>_8k.glb, <BaseName>_2k.glb and <BaseName>_512.glb" << std::endl);
+    Log("  --heightmap W,L,H  generate the mesh from the <BaseName>Height* export (png, .raw, .r16 or .r32) instead" << std::endl);
+    Log("              of reading the mesh export, for a terrain of width W, length L and height H in mesh units" << std::endl);
+    Log("  --no-validate  skip the checks of the written glb (references, bounds, index ranges, min/max, normals)" << std::endl);
+    Log("  --batch B   convert every terrain listed in manifest B (lines: BaseName InputFolder [OutputFolder])" << std::endl);
+    Log("              or found below folder B (files <BaseName>Mesh*.glb, with --heightmap <BaseName>Height*)" << std::endl);
+    Log("  --terrains N  convert up to N terrains of a batch at the same time (default 2)" << std::endl);
+    Log("  --watch     keep running and convert again whenever the export files change, results are kept in memory" << std::endl);
+    Log("  --stats F   write stage timings, byte counts and peak memory to json file F and print a summary" << std::endl);
+    Log("  --cache D   keep encoded textures and processed meshes in folder D and reuse them for unchanged input files" << std::endl);
 }
-#endif
 
-#define Error(x)\
-{\
-    Log(x); \
-    exit(0); \
+// options given on the command line, positional arguments are handled in main()
+struct Options {
+    size_t jobs = 0; // 0: one thread per core
+    ConvertOptions convert; // settings of every conversion, pool, cache and log are set in convertTerrain
+    std::string batch; // manifest file or folder tree of exports, empty: convert one terrain
+    size_t terrains = 2; // terrains of a batch converted at the same time
+    std::string cacheFolder; // folder of reusable texture and mesh results, empty: no cache
+    bool watch = false; // convert again whenever the export files change
+    std::string statsFile; // json report of stage timings, byte counts and peak memory, empty: no report
+    std::vector<size_t> textureSizes; // --max-texture-size, several sizes write one glb per size
+    bool heightmap = false; // --heightmap: the mesh is generated from the heightmap export, the terrain size is in convert
+};
+
+// parse a positive number for options like --jobs
+bool parseCount(const char* text, size_t& value) {
+    char* end = nullptr;
+    unsigned long long v = std::strtoull(text, &end, 10);
+    if (end == text || *end != '\0' || v == 0) {
+        return false;
+    }
+    value = static_cast<size_t>(v);
+    return true;
 }
 
-// Function to write a PNG image to a memory buffer using stb_image_write
-unsigned char* WritePngToBuffer(int width, int height, int channels, const unsigned char* data, int& out_len) {
-    // The stride_in_bytes parameter is the number of bytes between the start of one row and the start of the next row.
-    // If the rows are tightly packed, you can set it to width * channels.
-    int stride_in_bytes = width * channels;
-
-    // Write the PNG image to a memory buffer
-    unsigned char* png_buffer = stbi_write_png_to_mem(data, stride_in_bytes, width, height, channels, &out_len);
-    if (png_buffer) {
-        Log("Successfully wrote PNG image to buffer" << std::endl);
-    } else {
-        Error("Failed to write PNG image to buffer" << std::endl);
+// parse a comma separated list of distinct positive numbers, e.g. 8192,2048,512
+bool parseCountList(const char* text, std::vector<size_t>& values) {
+    std::string list = text;
+    values.clear();
+    for (size_t begin = 0; begin <= list.size();) {
+        size_t end = std::min(list.find(',', begin), list.size());
+        size_t value;
+        if (!parseCount(list.substr(begin, end - begin).c_str(), value)
+            || std::find(values.begin(), values.end(), value) != values.end()) {
+            return false;
+        }
+        values.push_back(value);
+        begin = end + 1;
     }
-    return png_buffer;
+    return true;
 }
 
-// Function to load a texture using stb_image
-unsigned char* LoadTextureData(const std::string& filePath, int& width, int& height, int& channels) {
-    unsigned char* data = stbi_load(filePath.c_str(), &width, &height, &channels, 0);
-    if (!data) {
-        Error("Failed to load texture: " << filePath << std::endl);
+// parse the level name of --png-level
+bool parsePngLevel(const std::string& text, PngLevel& level) {
+    static const std::pair<const char*, PngLevel> levels[] = { { "store", PngLevel::Store }, { "rle", PngLevel::Rle },
+        { "fast", PngLevel::Fast }, { "default", PngLevel::Default }, { "max", PngLevel::Max } };
+    for (const auto& entry : levels) {
+        if (text == entry.first) {
+            level = entry.second;
+            return true;
+        }
     }
-    return data;
+    return false;
 }
 
-// copy image data to global buffer and create BufferView for an image
-void handleImage(tinygltf::Model& model, tinygltf::Image& image, unsigned char* data) {
-
-    // write png format to intermediate buffer
-    int out_len;
-    unsigned char* png_buffer = WritePngToBuffer(image.width, image.height, image.component, data, out_len);
-
-    // copy png data to global buffer and create tinygltf::BufferView for the image
-    tinygltf::Buffer &buffer = model.buffers[0];
-    size_t imageDataSize = out_len; //image.width * image.height * image.component;
-    size_t bufferDataSize = buffer.data.size();
-    buffer.data.resize( bufferDataSize + imageDataSize);
-    std::copy(png_buffer, png_buffer + imageDataSize, buffer.data.begin() + bufferDataSize);
-    stbi_image_free(data);
-    stbi_image_free(png_buffer);
-
-    tinygltf::BufferView bufferView{};
-    bufferView.buffer = 0;
-    bufferView.byteOffset = bufferDataSize;
-    bufferView.byteLength = imageDataSize;
-    bufferView.target = 0; // No specific target
-
-    // Add the buffer view to the model
-    model.bufferViews.push_back(bufferView);
-
-    // Set the buffer view for the image
-    image.bufferView = static_cast<int>(model.bufferViews.size() - 1);
-    image.mimeType = "image/png"; // Set the appropriate MIME type
+// parse the terrain size of --heightmap: width,length,height with positive width and length
+bool parseTerrainSize(const char* text, ConvertOptions& options) {
+    float* values[3] = { &options.terrainWidth, &options.terrainLength, &options.terrainHeight };
+    for (size_t i = 0; i < 3; ++i) {
+        char* end = nullptr;
+        *values[i] = std::strtof(text, &end);
+        if (end == text || *end != (i < 2 ? ',' : '\0')) {
+            return false;
+        }
+        text = end + 1;
+    }
+    return options.terrainWidth > 0.0f && options.terrainLength > 0.0f && options.terrainHeight >= 0.0f;
 }
 
-// Function to create a tinygltf texture by loading from file
-tinygltf::Texture CreateTinyGltfTexture(tinygltf::Model& model, const std::string& filePath) {
-    int width, height, channels;
-    unsigned char* data = LoadTextureData(filePath, width, height, channels);
-    if (!data) {
-        return tinygltf::Texture();
+// split command line into options and positional arguments, returns false on unknown or malformed options
+bool parseArguments(int argc, char* argv[], Options& options, std::vector<std::string>& positional) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--jobs") {
+            if (i + 1 >= argc || !parseCount(argv[++i], options.jobs)) {
+                Log("--jobs needs a positive number" << std::endl);
+                return false;
+            }
+        } else if (arg == "--reencode") {
+            options.convert.passthrough = false;
+        } else if (arg == "--ktx2") {
+            options.convert.ktx2 = true;
+        } else if (arg == "--png-level") {
+            if (i + 1 >= argc || !parsePngLevel(argv[++i], options.convert.pngLevel)) {
+                Log("--png-level needs one of store, rle, fast, default or max" << std::endl);
+                return false;
+            }
+        } else if (arg == "--orm") {
+            options.convert.orm = true;
+        } else if (arg == "--quantize") {
+            options.convert.quantize = true;
+        } else if (arg == "--optimize-mesh") {
+            options.convert.optimizeMesh = true;
+        } else if (arg == "--tiles") {
+            if (i + 1 >= argc || !parseCount(argv[++i], options.convert.tiles) || (options.convert.tiles & (options.convert.tiles - 1)) != 0) {
+                Log("--tiles needs a power of 2" << std::endl);
+                return false;
+            }
+        } else if (arg == "--max-error") {
+            char* end = nullptr;
+            if (i + 1 < argc) {
+                options.convert.maxError = std::strtof(argv[++i], &end);
+            }
+            if (end == nullptr || *end != '\0' || !(options.convert.maxError > 0.0f)) {
+                Log("--max-error needs a positive number" << std::endl);
+                return false;
+            }
+        } else if (arg == "--batch") {
+            if (i + 1 >= argc) {
+                Log("--batch needs a manifest file or folder" << std::endl);
+                return false;
+            }
+            options.batch = argv[++i];
+        } else if (arg == "--terrains") {
+            if (i + 1 >= argc || !parseCount(argv[++i], options.terrains)) {
+                Log("--terrains needs a positive number" << std::endl);
+                return false;
+            }
+        } else if (arg == "--cache") {
+            if (i + 1 >= argc) {
+                Log("--cache needs a folder" << std::endl);
+                return false;
+            }
+            options.cacheFolder = argv[++i];
+        } else if (arg == "--max-texture-size") {
+            if (i + 1 >= argc || !parseCountList(argv[++i], options.textureSizes)) {
+                Log("--max-texture-size needs positive sizes, separated by commas" << std::endl);
+                return false;
+            }
+        } else if (arg == "--heightmap") {
+            if (i + 1 >= argc || !parseTerrainSize(argv[++i], options.convert)) {
+                Log("--heightmap needs the terrain size as width,length,height" << std::endl);
+                return false;
+            }
+            options.heightmap = true;
+        } else if (arg == "--no-validate") {
+            options.convert.validate = false;
+        } else if (arg == "--watch") {
+            options.watch = true;
+        } else if (arg == "--stats") {
+            if (i + 1 >= argc) {
+                Log("--stats needs a file name" << std::endl);
+                return false;
+            }
+            options.statsFile = argv[++i];
+        } else if (arg == "--lods") {
+            if (i + 1 >= argc || !parseCount(argv[++i], options.convert.lods)) {
+                Log("--lods needs a positive number" << std::endl);
+                return false;
+            }
+        } else if (arg.rfind("--", 0) == 0) {
+            Log("Unknown option: " << arg << std::endl);
+            return false;
+        } else {
+            positional.push_back(arg);
+        }
     }
-
-    // Create a tinygltf::Image
-    tinygltf::Image image{};
-    image.width = width;
-    image.height = height;
-    image.component = channels;
-    image.bits = 8;
-    image.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
-    handleImage(model, image, data);
-
-    // do not set uri, as we are embedding the image
-    //image.uri = filePath;
-
-    // Add the image to the model
-    model.images.push_back(image);
-
-    // Create a tinygltf::Texture
-    tinygltf::Texture texture{};
-    texture.source = static_cast<int>(model.images.size() - 1);
-    model.textures.push_back(texture);
-
-    return texture;
+    if (!options.batch.empty()) {
+        if (options.watch) {
+            Log("--watch needs a single terrain, not --batch" << std::endl);
+            return false;
+        }
+        return positional.size() <= 1;
+    }
+    return positional.size() == 2 || positional.size() == 3;
 }
 
-// Function to create a tinygltf texture by using in-memory data
-tinygltf::Texture CreateTinyGltfTexture(tinygltf::Model& model, tinygltf::Image& metallicRoughnessImage, unsigned char* data) {
-
-    handleImage(model, metallicRoughnessImage, data);
-
-    // Add the image to the model
-    model.images.push_back(metallicRoughnessImage);
-
-    // Create a tinygltf::Texture
-    tinygltf::Texture texture{};
-    texture.source = static_cast<int>(model.images.size() - 1);
-    model.textures.push_back(texture);
-
-    return texture;
+// paths of the glbs written for a terrain: <baseName>.glb, or one <baseName>_<size>.glb per texture size
+// if there are several, with sizes like 2048 shortened to 2k
+std::vector<std::filesystem::path> OutputPaths(const ConversionJob& job, const Options& options) {
+    std::filesystem::path folder(job.outputFolder);
+    if (options.textureSizes.size() <= 1) {
+        return { folder / (job.baseName + ".glb") };
+    }
+    std::vector<std::filesystem::path> paths;
+    for (size_t size : options.textureSizes) {
+        std::string label = size % 1024 == 0 ? std::to_string(size / 1024) + "k" : std::to_string(size);
+        paths.push_back(folder / (job.baseName + "_" + label + ".glb"));
+    }
+    return paths;
 }
 
-// Function to add PBR textures to tinygltf material
-void AddTexturesToMaterial(tinygltf::Model& model, const std::vector<std::string>& mapFiles, tinygltf::Image& metallicRoughnessImage, unsigned char* data) {
-    assert(model.materials.size() == 1);
-    tinygltf::Material& material = model.materials[0];
-    tinygltf::PbrMetallicRoughness& pbr = material.pbrMetallicRoughness;
+// size of a file in bytes, 0 if it does not exist
+uint64_t FileBytes(const std::string& path) {
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(path, ec);
+    return ec ? 0 : static_cast<uint64_t>(size);
+}
 
-    for (const auto& filePath : mapFiles) {
-        if (filePath.find("Color") != std::string::npos) {
-            tinygltf::Texture texture = CreateTinyGltfTexture(model, filePath);
-            pbr.baseColorTexture.index = static_cast<int>(model.textures.size() - 1);
-        } else if (filePath.find("Normal") != std::string::npos) {
-            tinygltf::Texture texture = CreateTinyGltfTexture(model, filePath);
-            material.normalTexture.index = static_cast<int>(model.textures.size() - 1);
-        } else if (filePath.find("AmbientOcclusion") != std::string::npos) {
-            tinygltf::Texture texture = CreateTinyGltfTexture(model, filePath);
-            material.occlusionTexture.index = static_cast<int>(model.textures.size() - 1);
-        }
+// size of all export files of a terrain that are read
+uint64_t InputBytes(const ConversionJob& job, const Options& options) {
+    uint64_t bytes = FileBytes(options.heightmap ? job.heightmapFile : job.meshFile);
+    for (const auto& file : job.texFiles) {
+        bytes += FileBytes(file);
     }
-    // now add merged metallic/rough texture:
-    tinygltf::Texture texture = CreateTinyGltfTexture(model, metallicRoughnessImage, data);
-    pbr.roughnessFactor = 1.0;
-    pbr.metallicRoughnessTexture.index = static_cast<int>(model.textures.size() - 1);
+    return bytes;
 }
 
-// Function to merge roughness and metalness maps into a single metallicRoughness map
-// we get grayscale info from each map and copy from the roughness map into the green channel of the combined map,
-// and from the metalness map into the blue channel of the combined map.
-// Red and alpha are all set to 255
-void MergeRoughnessAndMetalness(const std::vector<std::string>& mapFiles, tinygltf::Image& metallicRoughnessImage, unsigned char** data_ptr_addr) {
-    std::string metalnessPath;
-    std::string roughnessPath;
+// size of all glbs written for a terrain
+uint64_t OutputBytes(const ConversionJob& job, const Options& options) {
+    uint64_t bytes = 0;
+    for (const auto& path : OutputPaths(job, options)) {
+        bytes += FileBytes(path.string());
+    }
+    return bytes;
+}
 
-    for (const auto& filePath : mapFiles) {
-        if (filePath.find("Roughness") != std::string::npos) {
-            roughnessPath = filePath;
-        } else if (filePath.find("Metalness") != std::string::npos) {
-            metalnessPath = filePath;
-        }
+// check the files of a terrain and convert them to its glb file
+bool convertTerrainStages(const ConversionJob& job, const Options& options, ThreadPool& pool, const ConversionCache* cache,
+    std::string& err) {
+    if (job.texFiles.empty()) {
+        err = "No texture files found for base name " + job.baseName;
+        return false;
     }
-    if (roughnessPath.empty() || metalnessPath.empty()) {
-        Error("ERROR: Roughness or Metalness map not found" << std::endl);
+    if (options.heightmap && job.heightmapFile.empty()) {
+        err = "No heightmap file found for base name " + job.baseName;
+        return false;
     }
-    int width, height, channels;
-    // load metalness grayscale image
-    unsigned char* metalnessData = stbi_load(metalnessPath.c_str(), &width, &height, &channels, 1);
-    if (!metalnessData) {
-        Error("Failed to load metalness texture: " << metalnessPath << std::endl);
+    if (!options.heightmap && job.meshFile.empty()) {
+        err = "No mesh file found for base name " + job.baseName;
+        return false;
     }
-
-    int roughnessWidth, roughnessHeight, roughnessChannels;
-    // load roughness grayscale image
-    unsigned char* roughnessData = stbi_load(roughnessPath.c_str(), &roughnessWidth, &roughnessHeight, &roughnessChannels, 1);
-    if (!roughnessData) {
-        Error("Failed to load roughness texture: " << roughnessPath << std::endl);
+    if (!std::filesystem::exists(job.outputFolder)) {
+        err = "Output folder does not exist: " + job.outputFolder;
+        return false;
     }
-
-    if (width != roughnessWidth || height != roughnessHeight) {
-        Error("Metalness and roughness textures must have the same dimensions." << std::endl);
+    ConvertInputs inputs;
+    for (const auto& file : job.texFiles) {
+        Log("Found texture file: " << file << std::endl);
+        inputs.maps.push_back(FileInput(file));
     }
-
-    // load metalness again, this time as RGBA, where we want to store the merged image
-    unsigned char* metallicRoughnessData = stbi_load(metalnessPath.c_str(), &width, &height, &channels, 4);
-    if (!metallicRoughnessData) {
-        Error("Failed to load metalness texture: " << metalnessPath << std::endl);
+    if (options.heightmap) {
+        Log("Found heightmap file: " << job.heightmapFile << std::endl);
+        inputs.heightmap = FileInput(job.heightmapFile);
+    } else {
+        Log("Found mesh file: " << job.meshFile << std::endl);
+        inputs.mesh = FileInput(job.meshFile);
     }
 
-
-    for (int i = 0; i < width * height; ++i) {
-        metallicRoughnessData[i * 4 + 0] = 255; // Red channel
-        metallicRoughnessData[i * 4 + 1] = roughnessData[i]; // Green channel (roughness)
-        metallicRoughnessData[i * 4 + 2] = metalnessData[i]; // Blue channel (metalness)
-        metallicRoughnessData[i * 4 + 3] = 255; // Alpha channel
+    ConvertOptions convertOptions = options.convert;
+    convertOptions.pool = &pool;
+    convertOptions.cache = cache;
+    // progress of the library comes from pool threads and the other conversions of a batch, one line at a time
+    convertOptions.log = [](const std::string& message) {
+        static std::mutex logMutex;
+        std::lock_guard<std::mutex> lock(logMutex);
+        Log(message << std::endl);
+    };
+    // every glb is written to <path>.tmp and only renamed to its path if the conversion and the validation
+    // of the written data succeed, so a failed conversion leaves an earlier glb untouched
+    std::vector<std::filesystem::path> outputPaths = OutputPaths(job, options);
+    std::vector<std::filesystem::path> tempPaths;
+    for (const auto& outputPath : outputPaths) {
+        tempPaths.push_back(outputPath.string() + ".tmp");
     }
-
-    stbi_image_free(roughnessData);
-    stbi_image_free(metalnessData);
-
-    // fill texture info
-    metallicRoughnessImage.width = width;
-    metallicRoughnessImage.height = height;
-    metallicRoughnessImage.component = 4;
-    metallicRoughnessImage.bits = 8;
-    metallicRoughnessImage.pixel_type = TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE;
-    metallicRoughnessImage.image.resize(width * height * 4);
-    *data_ptr_addr = metallicRoughnessData;
-}
-
-
-bool ValidateTinyGltfModel(const tinygltf::Model& model) {
-    tinygltf::TinyGLTF gltf;
-    std::string err;
-    std::string warn;
-
-    // Serialize the model to a file
-    if (!gltf.WriteGltfSceneToFile(&model, "temp_validation.glb", true, true, true, true)) {
-        Log("Failed to serialize model to file" << std::endl);
-        return false;
+    std::vector<std::ofstream> outs(outputPaths.size());
+    std::vector<ConvertVariant> variants(outputPaths.size());
+    size_t writing = 0; // variant that received data last, for messages
+    for (size_t i = 0; i < variants.size(); ++i) {
+        variants[i].maxTextureSize = options.textureSizes.empty() ? 0 : options.textureSizes[i];
+        variants[i].sink = [&outs, &tempPaths, &writing, i](const unsigned char* data, size_t size) {
+            writing = i;
+            if (!outs[i].is_open()) {
+                outs[i].open(tempPaths[i], std::ios::binary | std::ios::trunc);
+            }
+            outs[i].write(reinterpret_cast<const char*>(data), size);
+            return static_cast<bool>(outs[i]);
+        };
     }
-
-    // Deserialize the model from the file
-    tinygltf::Model tempModel;
-    bool valid = gltf.LoadBinaryFromFile(&tempModel, &err, &warn, "temp_validation.glb");
-
-    if (!valid) {
-        if (!warn.empty()) {
-            Log("Warnings: " << warn << std::endl);
+    ConvertStatus status = ConvertVariants(inputs, convertOptions, variants, err);
+    for (size_t i = 0; i < outs.size(); ++i) {
+        if (outs[i].is_open()) {
+            outs[i].close();
         }
-        if (!err.empty()) {
-            Log("Errors: " << err << std::endl);
+        if (!outs[i] && status == ConvertStatus::Ok) {
+            status = ConvertStatus::WriteError;
+            err = "failed writing glb output";
+            writing = i;
         }
     }
-    return valid;
-}
-
-void extractIndexAttribute(const tinygltf::Model& model, const tinygltf::Primitive& primitive, std::vector<unsigned char>& outData, int& stride,
-    std::vector<double>& min, std::vector<double>& max,
-    tinygltf::Accessor& accessorOut, tinygltf::BufferView& bufferViewOut) {
-    auto& accessor = model.accessors[primitive.indices];
-    auto& bufferView = model.bufferViews[accessor.bufferView];
-    const unsigned char* bufferData = reinterpret_cast<const unsigned char*>(&(model.buffers[bufferView.buffer].data[accessor.byteOffset + bufferView.byteOffset]));
-    outData.assign(bufferData, bufferData + accessor.count * 4);
-    for (double minVal : accessor.minValues) {
-        min.push_back(minVal);
-    }
-    for (double maxVal : accessor.maxValues) {
-        max.push_back(maxVal);
-    }
-    bufferViewOut.target = bufferView.target;
-    accessorOut.componentType = accessor.componentType;
-    accessorOut.count = accessor.count;
-    accessorOut.type = accessor.type;
-}
-
-void extractVertexAttribute(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const std::string& attributeName, std::vector<float>& outData, int& stride,
-    std::vector<double>& min, std::vector<double>& max) {
-    auto it = primitive.attributes.find(attributeName);
-    if (it != primitive.attributes.end()) {
-        const tinygltf::Accessor& accessor = model.accessors[it->second];
-        const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
-        const float* bufferData = reinterpret_cast<const float*>(&(model.buffers[bufferView.buffer].data[accessor.byteOffset + bufferView.byteOffset]));
-        stride = accessor.ByteStride(bufferView) ? (accessor.ByteStride(bufferView) / sizeof(float)) : tinygltf::GetNumComponentsInType(accessor.type);
-        outData.assign(bufferData, bufferData + accessor.count * stride);
-        for (double minVal : accessor.minValues) {
-            min.push_back(minVal);
+    for (size_t i = 0; i < outputPaths.size() && status == ConvertStatus::Ok; ++i) {
+        std::error_code ec;
+        std::filesystem::rename(tempPaths[i], outputPaths[i], ec);
+        if (ec) {
+            status = ConvertStatus::WriteError;
+            err = ec.message();
+            writing = i;
         }
-        for (double maxVal : accessor.maxValues) {
-            max.push_back(maxVal);
+    }
+    if (status == ConvertStatus::WriteError) {
+        err = "Failed to write " + outputPaths[writing].string() + ": " + err;
+    }
+    if (status != ConvertStatus::Ok) {
+        for (const auto& tempPath : tempPaths) {
+            std::error_code ec;
+            std::filesystem::remove(tempPath, ec);
         }
+        return false;
     }
+    for (const auto& outputPath : outputPaths) {
+        Log("Exported successfully to " << outputPath << std::endl);
+    }
+    return true;
 }
 
-// create model from data of the exported WorldCreator mesh
-void createModel(tinygltf::Model& m, tinygltf::Model& modelMesh) {
-    tinygltf::Scene scene;
-    tinygltf::Mesh mesh;
-    tinygltf::Primitive primitive;
-    tinygltf::Node node;
-    tinygltf::Asset asset;
-
-    auto& primMesh = modelMesh.meshes[0].primitives[0];
-    // Extract positions
-    std::vector<float> positions;
-    std::vector<double> posMin;
-    std::vector<double> posMax;
-    int posStrideMesh;
-    extractVertexAttribute(modelMesh, primMesh, "POSITION", positions, posStrideMesh, posMin, posMax);
-    Log(" copy mesh buffer positions: " << positions.size()/posStrideMesh << std::endl);
-    // Extract normals
-    std::vector<float> normals;
-    std::vector<double> normalMin;
-    std::vector<double> normalMax;
-    int normalStride;
-    extractVertexAttribute(modelMesh, primMesh, "NORMAL", normals, normalStride, normalMin, normalMax);
-    Log(" copy mesh buffer normals: " << normals.size() / normalStride << std::endl);
-    // Extract texture coordinates
-    std::vector<float> texCoords;
-    std::vector<double> texMin;
-    std::vector<double> texMax;
-    int texCoordStride;
-    extractVertexAttribute(modelMesh, primMesh, "TEXCOORD_0", texCoords, texCoordStride, texMin, texMax);
-    Log(" copy mesh buffer tex 0: " << texCoords.size() / texCoordStride << std::endl);
-
-    // indices
-    tinygltf::Accessor indicesAccessor;
-    tinygltf::BufferView indicesBufferView;
-    // Extract normals
-    std::vector<unsigned char> indices; // typeless buffer
-    std::vector<double> indicesMin;
-    std::vector<double> indicesMax;
-    int indicesStride;
-    extractIndexAttribute(modelMesh, primMesh, indices, indicesStride, indicesMin, indicesMax, indicesAccessor, indicesBufferView);
-
-    // create buffer from the input data
-    tinygltf::Buffer buffer;
-    // store buffer sizes
-    size_t ps, is, ns, ts;
-    ps = positions.size() * sizeof(float);
-    is = indices.size(); // we handle this as bytes
-    ns = normals.size() * sizeof(float);
-    ts = texCoords.size() * sizeof(float);
-    size_t totalBufferLength = ps + is + ns + ts;
-    buffer.data.resize(totalBufferLength);
-    std::memcpy(buffer.data.data(), positions.data(), ps);
-    std::memcpy(buffer.data.data() + ps, indices.data(), is);
-    std::memcpy(buffer.data.data() + ps + is, normals.data(), ns);
-    std::memcpy(buffer.data.data() + ps + is + ns, texCoords.data(), ts);
-    m.buffers.push_back(buffer);
-
-    // define the buffer views
-    tinygltf::BufferView positionBufferView;
-    positionBufferView.buffer = 0;
-    positionBufferView.byteOffset = 0;
-    positionBufferView.byteLength = ps;
-    positionBufferView.target = TINYGLTF_TARGET_ARRAY_BUFFER;
-    m.bufferViews.push_back(positionBufferView);
-
-    indicesBufferView.buffer = 0;
-    indicesBufferView.byteOffset = ps;
-    indicesBufferView.byteLength = is;
-    //indicesBufferView.target = TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER; set in extract method
-    m.bufferViews.push_back(indicesBufferView);
-
-    tinygltf::BufferView normalBufferView;
-    normalBufferView.buffer = 0;
-    normalBufferView.byteOffset = ps + is;
-    normalBufferView.byteLength = ns;
-    normalBufferView.target = TINYGLTF_TARGET_ARRAY_BUFFER;
-    m.bufferViews.push_back(normalBufferView);
-
-    tinygltf::BufferView texcoordBufferView;
-    texcoordBufferView.buffer = 0;
-    texcoordBufferView.byteOffset = ps + is + ns;
-    texcoordBufferView.byteLength = ts;
-    texcoordBufferView.target = TINYGLTF_TARGET_ARRAY_BUFFER;
-    m.bufferViews.push_back(texcoordBufferView);
-
-    // define the accessors
-
-    tinygltf::Accessor positionAccessor;
-    positionAccessor.bufferView = 0;
-    positionAccessor.byteOffset = 0;
-    positionAccessor.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
-    positionAccessor.count = static_cast<int>(positions.size() / 3);
-    positionAccessor.type = TINYGLTF_TYPE_VEC3;
-    positionAccessor.maxValues = posMax;
-    positionAccessor.minValues = posMin;
-    m.accessors.push_back(positionAccessor);
-
-    indicesAccessor.bufferView = 1;
-    indicesAccessor.byteOffset = 0;
-    //indicesAccessor.componentType = TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT; // set in extract method, also count and type
-    // do NOT write min/max for index buffer:
-    //indicesAccessor.maxValues = indicesMax;
-    //indicesAccessor.minValues = indicesMin;
-    m.accessors.push_back(indicesAccessor);
-
-    tinygltf::Accessor normalAccessor;
-    normalAccessor.bufferView = 2;
-    normalAccessor.byteOffset = 0;
-    normalAccessor.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
-    normalAccessor.count = static_cast<int>(normals.size() / 3);
-    //normalAccessor.count = static_cast<int>(3); // override
-    normalAccessor.type = TINYGLTF_TYPE_VEC3;
-    normalAccessor.maxValues = normalMax;
-    normalAccessor.minValues = normalMin;
-    m.accessors.push_back(normalAccessor);
-
-    tinygltf::Accessor texcoordAccessor;
-    texcoordAccessor.bufferView = 3;
-    texcoordAccessor.byteOffset = 0;
-    texcoordAccessor.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
-    texcoordAccessor.count = static_cast<int>(texCoords.size() / 2);
-    texcoordAccessor.type = TINYGLTF_TYPE_VEC2;
-    texcoordAccessor.maxValues = texMax;
-    texcoordAccessor.minValues = texMin;
-    m.accessors.push_back(texcoordAccessor);
-
-    // Build the mesh primitive and add it to the mesh
-    primitive.attributes["POSITION"] = 0;
-    primitive.indices = 1;
-    primitive.attributes["NORMAL"] = 2;
-    primitive.attributes["TEXCOORD_0"] = 3;
-    primitive.mode = TINYGLTF_MODE_TRIANGLES;
-    primitive.material = 0;
-    mesh.primitives.push_back(primitive);
-
-    // Other tie ups
-    node.mesh = 0;
-    scene.nodes.push_back(0); // Default scene
-
-    // Define the asset. The version is required
-    asset.version = "2.0";
-    asset.generator = "tinygltf";
-
-    // Now all that remains is to tie back all the loose objects into the
-    // our single model.
-    m.scenes.push_back(scene);
-    m.meshes.push_back(mesh);
-    m.nodes.push_back(node);
-    m.asset = asset;
-
-    // Create a simple material
-    tinygltf::Material mat;
-    mat.pbrMetallicRoughness.baseColorFactor = { 1.0f, 1.0f, 1.0f, 1.0f };
-    //mat.doubleSided = true; may need to be set for off cases
-    m.materials.push_back(mat);
+// convert one terrain export to <baseName>.glb, or one glb per texture size. Texture and tile jobs run on pool, which can be shared by
+// conversions running at the same time. cache may be nullptr. Returns false with err set if the terrain cannot be converted
+bool convertTerrain(const ConversionJob& job, const Options& options, ThreadPool& pool, const ConversionCache* cache,
+    std::string& err) {
+    auto start = std::chrono::steady_clock::now();
+    bool ok = convertTerrainStages(job, options, pool, cache, err);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t inputBytes = InputBytes(job, options);
+    uint64_t outputBytes = ok ? OutputBytes(job, options) : 0;
+    Stats().addTerrain(job.baseName, ok, seconds, inputBytes, outputBytes);
+    if (ok) {
+        Stats().addBytes(ByteCounter::InputRead, inputBytes);
+        Stats().addBytes(ByteCounter::OutputWritten, outputBytes);
+    }
+    return ok;
 }
 
-void usage() {
-    Log("Usage: WorldCreatorToGLTF <BaseName> <InputFolder> [<OutputFolder>]" << std::endl);
-    Log("  typical use: WorldCreatorToGLTF Terrain c:/export " << std::endl);
-    Log("    will produce Terrain.glb in folder c:/export " << std::endl);
+// write the --stats report and log the summary, nothing without --stats
+void writeStats(const Options& options, const ThreadPool& pool) {
+    if (options.statsFile.empty()) {
+        return;
+    }
+    Log(Stats().summary());
+    std::ofstream out(options.statsFile);
+    out << Stats().json(pool.size()) << std::endl;
+    if (!out) {
+        std::cerr << "Cannot write " << options.statsFile << std::endl;
+    }
 }
 
-void setup(const std::string baseName, const std::string inputFolder, const std::string outputFolder, std::vector<std::string>& texFiles, std::string& meshFile) {
-    if (!std::filesystem::exists(inputFolder)) {
-        Error("Input folder does not exist: " << inputFolder << std::endl);
-    }
-    if (!std::filesystem::exists(outputFolder)) {
-        Error("Output folder does not exist: " << outputFolder << std::endl);
-    }
-    for (const auto& entry : std::filesystem::directory_iterator(inputFolder)) {
-        if (entry.is_regular_file()) {
-            const std::string fileName = entry.path().filename().string();
-            if (fileName.find(baseName) != std::string::npos && fileName.find(".png") != std::string::npos) {
-                texFiles.push_back(entry.path().string());
-                Log("Found texture file: " << fileName << std::endl);
+// convert all terrains of a batch. Up to options.terrains conversions run at the same time, each on its own
+// thread, and all of them queue their texture and tile jobs on the one pool, so the cores stay busy while a
+// conversion loads its mesh or writes its glb. Returns the number of failed terrains
+size_t runBatch(const std::vector<ConversionJob>& jobs, const Options& options, ThreadPool& pool, const ConversionCache* cache) {
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<size_t> next{ 0 };
+    std::mutex resultMutex;
+    size_t failed = 0;
+    uint64_t inputBytes = 0;
+    uint64_t outputBytes = 0;
+
+    auto drive = [&]() {
+        for (size_t i = next++; i < jobs.size(); i = next++) {
+            const ConversionJob& job = jobs[i];
+            std::string err;
+            bool ok = convertTerrain(job, options, pool, cache, err);
+            uint64_t in = InputBytes(job, options);
+            std::lock_guard<std::mutex> lock(resultMutex);
+            if (ok) {
+                inputBytes += in;
+                outputBytes += OutputBytes(job, options);
+            } else {
+                ++failed;
+                std::cerr << job.baseName << " (" << (options.heightmap ? job.heightmapFile : job.meshFile) << "): " << err << std::endl;
             }
         }
+    };
+    std::vector<std::thread> drivers;
+    size_t driverCount = std::min(options.terrains, jobs.size());
+    for (size_t i = 1; i < driverCount; ++i) {
+        drivers.emplace_back(drive);
     }
-    if (texFiles.size() == 0) {
-        Error("No texture files found in input folder for base name " << baseName << std::endl);
+    drive();
+    for (auto& driver : drivers) {
+        driver.join();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t converted = jobs.size() - failed;
+    double minutes = std::max(seconds, 1e-3) / 60.0;
+    Log("Converted " << converted << " of " << jobs.size() << " terrains in " << seconds << " s: "
+        << converted / minutes << " terrains/min, " << inputBytes / 1e6 / std::max(seconds, 1e-3) << " MB/s read ("
+        << inputBytes / 1e6 << " MB), " << outputBytes / 1e6 << " MB written" << std::endl);
+    return failed;
+}
+
+// time without further changes after which an export counts as completely written
+const int WATCH_SETTLE_MS = 500;
+
+// Convert job, then again whenever one of its export files changes, until the process is stopped.
+// Encoded textures and processed meshes stay in the memory cache between conversions, so only the
+// maps and the mesh that changed are processed again
+int runWatch(ConversionJob job, const std::string& inputFolder, const Options& options, ThreadPool& pool,
+    ConversionCache& cache) {
+    FolderWatcher watcher;
+    std::string err;
+    if (!watcher.open(inputFolder, err)) {
+        std::cerr << err << std::endl;
+        return EXIT_FAILURE;
     }
-    for (const auto& entry : std::filesystem::directory_iterator(inputFolder)) {
-        if (entry.is_regular_file()) {
-            const std::string fileName = entry.path().filename().string();
-            if (fileName.find(baseName) != std::string::npos && fileName.find("Mesh") != std::string::npos) {
-                meshFile = entry.path().string();
-                Log("Found mesh file: " << fileName << std::endl);
+    for (;;) {
+        auto start = std::chrono::steady_clock::now();
+        if (convertTerrain(job, options, pool, &cache, err)) {
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            Log("Converted in " << seconds << " s, watching " << inputFolder << " for changes" << std::endl);
+        } else {
+            std::cerr << err << std::endl;
+        }
+        cache.trimMemory();
+        // every report covers one conversion, collected timings would grow as long as the watch runs
+        writeStats(options, pool);
+        Stats().reset();
+
+        // wait for a change of an export file, then until nothing changed for WATCH_SETTLE_MS.
+        // Writes of our own glb show up here as well and are ignored
+        std::vector<std::string> changed;
+        auto isExportFile = [&job](const std::string& name) { return IsExportFile(job.baseName, name); };
+        while (std::none_of(changed.begin(), changed.end(), isExportFile)) {
+            changed.clear();
+            if (!watcher.wait(-1, changed, err)) {
+                std::cerr << err << std::endl;
+                return EXIT_FAILURE;
             }
         }
-    }
-    if (meshFile.empty()) {
-        Error("No mesh file found in input folder for base name " << baseName << std::endl);
+        for (size_t before = 0; before != changed.size();) {
+            before = changed.size();
+            if (!watcher.wait(WATCH_SETTLE_MS, changed, err)) {
+                std::cerr << err << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+
+        // the folder is only listed again if export files were added or removed
+        bool rescan = !std::filesystem::exists(options.heightmap ? job.heightmapFile : job.meshFile);
+        for (const auto& name : changed) {
+            std::string path = (std::filesystem::path(inputFolder) / name).string();
+            bool known = path == job.meshFile || path == job.heightmapFile || std::find(job.texFiles.begin(), job.texFiles.end(), path) != job.texFiles.end();
+            rescan = rescan || (isExportFile(name) && (!known || !std::filesystem::exists(path)));
+        }
+        if (rescan) {
+            ConversionJob found;
+            if (FindExport(job.baseName, inputFolder, job.outputFolder, found, err)) {
+                job = found;
+            }
+        }
+        Log("Export changed, converting again" << std::endl);
     }
 }
 
 int main(int argc, char* argv[]) {
     Log(argv[0] << std::endl);
-    if (argc != 4 && argc != 3) {
+    Options options;
+    std::vector<std::string> positional;
+    if (!parseArguments(argc, argv, options, positional)) {
         usage();
         exit(1);
     }
+    // timings are only collected for a --stats report
+    Stats().setEnabled(!options.statsFile.empty());
 
-    std::vector<std::string> texFiles;
-    std::string meshFile;
-    std::string baseName = argv[1];
-    std::string inputFolder = argv[2];
-    std::string outputFolder = argc == 4 ? argv[3] : inputFolder;
-    setup(baseName, inputFolder, outputFolder, texFiles, meshFile);
-
-    tinygltf::Model modelMesh;
-    tinygltf::Model model;
-    if (true) {
-        tinygltf::TinyGLTF loader;
-        std::string err;
-        std::string warn;
-        // assume ascii glTF.
-        bool ret = loader.LoadBinaryFromFile(&modelMesh, &err, &warn, meshFile.c_str());
-        if (!warn.empty()) {
-            std::cout << "warn : " << warn << std::endl;
+    std::string err;
+    std::vector<ConversionJob> jobs;
+    std::string inputFolder;
+    if (!options.batch.empty()) {
+        // all exports are found before the first conversion starts, with one scan per folder
+        std::string outputFolder = positional.empty() ? std::string() : positional[0];
+        ScopedTimer timer("find exports");
+        bool found = std::filesystem::is_directory(options.batch)
+            ? FindExportsInTree(options.batch, outputFolder, options.heightmap, jobs, err)
+            : ReadManifest(options.batch, outputFolder, jobs, err);
+        if (!found) {
+            std::cerr << err << std::endl;
+            return EXIT_FAILURE;
         }
-        if (!ret) {
-            if (!err.empty()) {
-                std::cerr << err << std::endl;
-            }
+        Log("Found " << jobs.size() << " terrains in " << options.batch << std::endl);
+    } else {
+        ConversionJob job;
+        std::string baseName = positional[0];
+        inputFolder = positional[1];
+        std::string outputFolder = positional.size() == 3 ? positional[2] : inputFolder;
+        ScopedTimer timer("find exports");
+        if (!FindExport(baseName, inputFolder, outputFolder, job, err)) {
+            std::cerr << err << std::endl;
             return EXIT_FAILURE;
         }
-        Log("Loaded mesh model" << std::endl);
+        jobs.push_back(job);
     }
-    createModel(model, modelMesh);
-    tinygltf::Image metallicRoughnessImage; // partly filled, not put to gltf model
-    unsigned char* metallicRoughnessData = nullptr;
-    MergeRoughnessAndMetalness(texFiles, metallicRoughnessImage, &metallicRoughnessData);
-
-    AddTexturesToMaterial(model, texFiles, metallicRoughnessImage, metallicRoughnessData);
-
-    //if (!ValidateTinyGltfModel(model)) {
-    //    Log("Model validation failed" << std::endl);
-    //    return -1;
-    //}
-
-    // Construct the output file path
-    std::string nameWithType = baseName + ".glb";
-    std::filesystem::path outputPath = std::filesystem::path(outputFolder) / nameWithType;
-    // Save it to a file
-    tinygltf::TinyGLTF gltf;
-    gltf.WriteGltfSceneToFile(&model, outputPath.string(),
-        false, // embedImages
-        true, // embedBuffers
-        false, // pretty print
-        true); // write binary
-
-    Log("Exported successfully to " << outputPath << std::endl);
 
+    ThreadPool pool(options.jobs);
+    Log("Using " << pool.size() << " threads for texture processing" << std::endl);
+    std::unique_ptr<ConversionCache> cache;
+    if (!options.cacheFolder.empty() || options.watch) {
+        // watch mode keeps results in memory even without a cache folder
+        cache = std::make_unique<ConversionCache>(options.cacheFolder, options.watch);
+    }
+    if (!options.batch.empty()) {
+        size_t failed = runBatch(jobs, options, pool, cache.get());
+        writeStats(options, pool);
+        return failed == 0 ? 0 : EXIT_FAILURE;
+    }
+    if (options.watch) {
+        return runWatch(jobs[0], inputFolder, options, pool, *cache);
+    }
+    bool ok = convertTerrain(jobs[0], options, pool, cache.get(), err);
+    writeStats(options, pool);
+    if (!ok) {
+        std::cerr << err << std::endl;
+        return EXIT_FAILURE;
+    }
     return 0;
 }
@@ -0,0 +1,278 @@
+#include "mesh_input.h"
+#include "gltf_json.h"
+#include "tiny_gltf.h"
+#include <algorithm>
+#include <limits>
+
+#if defined(_WIN64)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#if defined(_WIN64)
+bool MappedFile::open(const std::string& path, std::string& err) {
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        err = "cannot open " + path;
+        return false;
+    }
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        err = "cannot map empty file " + path;
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        err = "cannot map " + path;
+        return false;
+    }
+    bytes = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!bytes) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        err = "cannot map " + path;
+        return false;
+    }
+    length = static_cast<size_t>(fileSize.QuadPart);
+    fileHandle = file;
+    mappingHandle = mapping;
+    return true;
+}
+
+void MappedFile::close() {
+    if (bytes) {
+        UnmapViewOfFile(bytes);
+        CloseHandle(mappingHandle);
+        CloseHandle(fileHandle);
+    }
+    bytes = nullptr;
+    length = 0;
+}
+#else
+bool MappedFile::open(const std::string& path, std::string& err) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        err = "cannot open " + path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        err = "cannot map empty file " + path;
+        return false;
+    }
+    void* mapped = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // mapping stays valid
+    if (mapped == MAP_FAILED) {
+        err = "cannot map " + path;
+        return false;
+    }
+    // attributes are streamed front to back
+    madvise(mapped, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+    bytes = static_cast<const unsigned char*>(mapped);
+    length = static_cast<size_t>(st.st_size);
+    return true;
+}
+
+void MappedFile::close() {
+    if (bytes) {
+        munmap(const_cast<unsigned char*>(bytes), length);
+    }
+    bytes = nullptr;
+    length = 0;
+}
+#endif
+
+namespace {
+
+const uint32_t GLB_MAGIC = 0x46546C67; // "glTF"
+const uint32_t CHUNK_JSON = 0x4E4F534A; // "JSON"
+const uint32_t CHUNK_BIN = 0x004E4942; // "BIN\0"
+
+uint32_t ReadUint32(const unsigned char* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+}
+
+int ParseType(const std::string& type) {
+    if (type == "SCALAR") return TINYGLTF_TYPE_SCALAR;
+    if (type == "VEC2") return TINYGLTF_TYPE_VEC2;
+    if (type == "VEC3") return TINYGLTF_TYPE_VEC3;
+    if (type == "VEC4") return TINYGLTF_TYPE_VEC4;
+    return -1;
+}
+
+std::vector<double> ParseNumbers(const tinygltf::Value& array) {
+    std::vector<double> values;
+    for (size_t i = 0; i < array.ArrayLen(); ++i) {
+        values.push_back(array.Get(static_cast<int>(i)).GetNumberAsDouble());
+    }
+    return values;
+}
+
+int GetInt(const tinygltf::Value& object, const char* key, int defaultValue) {
+    const tinygltf::Value& v = object.Get(key);
+    return v.IsNumber() ? v.GetNumberAsInt() : defaultValue;
+}
+
+size_t GetSize(const tinygltf::Value& object, const char* key) {
+    const tinygltf::Value& v = object.Get(key);
+    return v.IsNumber() ? static_cast<size_t>(v.GetNumberAsDouble()) : 0;
+}
+
+// resolve an accessor to a view into the binary chunk, with bounds checks
+bool ResolveAccessor(const tinygltf::Value& json, int accessorIndex, const unsigned char* bin, size_t binLength,
+    AttributeView& view, std::string& err) {
+    const tinygltf::Value& accessor = json.Get("accessors").Get(accessorIndex);
+    if (!accessor.IsObject()) {
+        err = "accessor " + std::to_string(accessorIndex) + " not found";
+        return false;
+    }
+    if (accessor.Has("sparse")) {
+        err = "sparse accessors are not supported";
+        return false;
+    }
+    int bufferViewIndex = GetInt(accessor, "bufferView", -1);
+    const tinygltf::Value& bufferView = json.Get("bufferViews").Get(bufferViewIndex);
+    if (!bufferView.IsObject()) {
+        err = "accessor " + std::to_string(accessorIndex) + " has no bufferView";
+        return false;
+    }
+    int bufferIndex = GetInt(bufferView, "buffer", -1);
+    const tinygltf::Value& buffer = json.Get("buffers").Get(bufferIndex);
+    if (bufferIndex != 0 || buffer.Has("uri")) {
+        err = "only data inside the glb binary chunk is supported";
+        return false;
+    }
+
+    view.componentType = GetInt(accessor, "componentType", -1);
+    view.type = ParseType(accessor.Get("type").IsString() ? accessor.Get("type").Get<std::string>() : "");
+    int componentSize = tinygltf::GetComponentSizeInBytes(view.componentType);
+    int components = tinygltf::GetNumComponentsInType(view.type);
+    if (componentSize <= 0 || components <= 0) {
+        err = "accessor " + std::to_string(accessorIndex) + " has unsupported type";
+        return false;
+    }
+    view.count = GetSize(accessor, "count");
+    view.elementSize = static_cast<size_t>(componentSize) * components;
+    size_t byteStride = GetSize(bufferView, "byteStride");
+    view.byteStride = byteStride ? byteStride : view.elementSize;
+    view.min = ParseNumbers(accessor.Get("min"));
+    view.max = ParseNumbers(accessor.Get("max"));
+
+    size_t viewOffset = GetSize(bufferView, "byteOffset");
+    size_t viewLength = GetSize(bufferView, "byteLength");
+    size_t accessorOffset = GetSize(accessor, "byteOffset");
+    size_t needed = view.count == 0 ? 0 : accessorOffset + (view.count - 1) * view.byteStride + view.elementSize;
+    if (viewOffset + viewLength > binLength || needed > viewLength) {
+        err = "accessor " + std::to_string(accessorIndex) + " exceeds binary chunk";
+        return false;
+    }
+    view.data = bin + viewOffset + accessorOffset;
+    return true;
+}
+
+bool ResolveAttribute(const tinygltf::Value& json, const tinygltf::Value& primitive, const char* name,
+    const unsigned char* bin, size_t binLength, AttributeView& view, std::string& err) {
+    const tinygltf::Value& attribute = primitive.Get("attributes").Get(name);
+    if (!attribute.IsNumber()) {
+        err = std::string("Mesh has no ") + name + " attribute. Export the mesh with Normals and Texcoords.";
+        return false;
+    }
+    if (!ResolveAccessor(json, attribute.GetNumberAsInt(), bin, binLength, view, err)) {
+        return false;
+    }
+    if (view.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT) {
+        err = std::string(name) + " has to be float";
+        return false;
+    }
+    return true;
+}
+
+} // namespace
+
+void ComputeBounds(const AttributeView& view, std::vector<double>& min, std::vector<double>& max) {
+    size_t components = view.elementSize / sizeof(float);
+    std::vector<float> lo(components, std::numeric_limits<float>::max());
+    std::vector<float> hi(components, std::numeric_limits<float>::lowest());
+    for (size_t i = 0; i < view.count; ++i) {
+        const float* v = reinterpret_cast<const float*>(view.data + i * view.byteStride);
+        for (size_t c = 0; c < components; ++c) {
+            lo[c] = std::min(lo[c], v[c]);
+            hi[c] = std::max(hi[c], v[c]);
+        }
+    }
+    min.assign(lo.begin(), lo.end());
+    max.assign(hi.begin(), hi.end());
+}
+
+bool LoadMeshFile(const std::string& path, MappedFile& file, SourceMesh& mesh, std::string& err) {
+    if (!file.open(path, err)) {
+        return false;
+    }
+    return LoadMeshData(file.data(), file.size(), path, mesh, err);
+}
+
+bool LoadMeshData(const unsigned char* data, size_t size, const std::string& path, SourceMesh& mesh, std::string& err) {
+    if (size < 20 || ReadUint32(data) != GLB_MAGIC || ReadUint32(data + 4) != 2) {
+        err = path + " is not a binary glTF 2.0 file";
+        return false;
+    }
+    size_t jsonLength = ReadUint32(data + 12);
+    if (ReadUint32(data + 16) != CHUNK_JSON || 20 + jsonLength > size) {
+        err = path + " has no valid json chunk";
+        return false;
+    }
+    const unsigned char* bin = nullptr;
+    size_t binLength = 0;
+    size_t binHeader = 20 + jsonLength;
+    if (binHeader + 8 <= size && ReadUint32(data + binHeader + 4) == CHUNK_BIN) {
+        binLength = ReadUint32(data + binHeader);
+        bin = data + binHeader + 8;
+        if (binHeader + 8 + binLength > size) {
+            err = path + " binary chunk is truncated";
+            return false;
+        }
+    }
+
+    tinygltf::Value json;
+    if (!ParseJson(reinterpret_cast<const char*>(data + 20), jsonLength, json, err)) {
+        err = path + ": " + err;
+        return false;
+    }
+    const tinygltf::Value& primitive = json.Get("meshes").Get(0).Get("primitives").Get(0);
+    if (!primitive.IsObject()) {
+        err = path + " contains no mesh";
+        return false;
+    }
+    if (!ResolveAttribute(json, primitive, "POSITION", bin, binLength, mesh.positions, err) ||
+        !ResolveAttribute(json, primitive, "NORMAL", bin, binLength, mesh.normals, err) ||
+        !ResolveAttribute(json, primitive, "TEXCOORD_0", bin, binLength, mesh.texCoords, err)) {
+        return false;
+    }
+    if (!primitive.Get("indices").IsNumber()) {
+        err = "Mesh has no index buffer";
+        return false;
+    }
+    if (!ResolveAccessor(json, primitive.Get("indices").GetNumberAsInt(), bin, binLength, mesh.indices, err)) {
+        return false;
+    }
+    if (mesh.indices.type != TINYGLTF_TYPE_SCALAR || mesh.indices.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT) {
+        err = "index accessor has to be an unsigned integer scalar";
+        return false;
+    }
+    return true;
+}
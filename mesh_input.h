@@ -0,0 +1,75 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+// read-only file mapped into memory, unmapped on destruction
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path, std::string& err);
+    void close();
+    const unsigned char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+#if defined(_WIN64)
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
+
+// view of an attribute inside the mapped mesh file, nothing is copied until the glb is written.
+// Attributes created by mesh processing own their data through owner
+struct AttributeView {
+    const unsigned char* data = nullptr;
+    size_t count = 0;       // number of elements
+    size_t elementSize = 0; // bytes per element in the output, e.g. 12 for float VEC3
+    size_t byteStride = 0;  // distance of elements in the source buffer, may be larger than elementSize
+    int componentType = 0;  // TINYGLTF_COMPONENT_TYPE_*
+    int type = 0;           // TINYGLTF_TYPE_*
+    std::vector<double> min;
+    std::vector<double> max;
+    std::shared_ptr<const void> owner; // keeps generated data alive, empty for views into the mapped file
+    size_t byteLength() const { return count * elementSize; }
+};
+
+// attribute view that owns its tightly packed data
+template <typename T>
+AttributeView OwnedAttribute(std::vector<T>&& data, size_t count, int componentType, int type) {
+    auto storage = std::make_shared<std::vector<T>>(std::move(data));
+    AttributeView view;
+    view.data = reinterpret_cast<const unsigned char*>(storage->data());
+    view.count = count;
+    view.elementSize = count ? storage->size() * sizeof(T) / count : 0;
+    view.byteStride = view.elementSize;
+    view.componentType = componentType;
+    view.type = type;
+    view.owner = std::move(storage);
+    return view;
+}
+
+// min and max of every component of a float attribute, computed from the data
+void ComputeBounds(const AttributeView& view, std::vector<double>& min, std::vector<double>& max);
+
+// first primitive of the WorldCreator mesh export
+struct SourceMesh {
+    AttributeView positions;
+    AttributeView normals;
+    AttributeView texCoords;
+    AttributeView indices;
+};
+
+// Map a binary glTF file and locate the attributes of the first mesh primitive.
+// Only the json chunk is parsed, attribute views point directly into the mapped binary chunk,
+// so file has to stay open as long as the views are used
+bool LoadMeshFile(const std::string& path, MappedFile& file, SourceMesh& mesh, std::string& err);
+
+// Same for a glb already in memory, the views point into data. path is only used in error messages
+bool LoadMeshData(const unsigned char* data, size_t size, const std::string& path, SourceMesh& mesh, std::string& err);
@@ -0,0 +1,264 @@
+#include "mesh_optimize.h"
+#include "tiny_gltf.h"
+#include <cstring>
+#include <limits>
+
+namespace {
+
+// cache size Tipsify optimizes for, a bit larger than the measuring cache as on current GPUs
+const uint32_t TIPSIFY_CACHE_SIZE = 20;
+
+// glTF forbids the maximum value of the index type, so 16 bit parts address at most 65535 vertices
+const uint32_t MAX_PART_VERTICES = 65535;
+
+// Tipsify by Sander, Nehab and Barczak: fan around a vertex, continue with the neighbour
+// that will still be in the cache, fall back to recently used vertices on dead ends
+std::vector<uint32_t> Tipsify(const std::vector<uint32_t>& indices, size_t vertexCount, uint32_t cacheSize) {
+    size_t triangleCount = indices.size() / 3;
+
+    // vertex -> triangle adjacency in compressed rows
+    std::vector<uint32_t> offsets(vertexCount + 1, 0);
+    for (uint32_t v : indices) {
+        offsets[v + 1]++;
+    }
+    for (size_t v = 0; v < vertexCount; ++v) {
+        offsets[v + 1] += offsets[v];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; ++t) {
+        for (size_t k = 0; k < 3; ++k) {
+            adjacency[fill[indices[t * 3 + k]]++] = static_cast<uint32_t>(t);
+        }
+    }
+    std::vector<uint32_t>().swap(fill);
+
+    std::vector<uint32_t> liveTriangles(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        liveTriangles[v] = offsets[v + 1] - offsets[v];
+    }
+    std::vector<uint32_t> cacheTime(vertexCount, 0);
+    std::vector<uint8_t> emitted(triangleCount, 0);
+    std::vector<uint32_t> deadEnd;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(indices.size());
+
+    uint32_t time = cacheSize + 1;
+    size_t cursor = 0;
+    int64_t fanning = triangleCount > 0 ? indices[0] : -1;
+    while (fanning >= 0) {
+        candidates.clear();
+        uint32_t f = static_cast<uint32_t>(fanning);
+        for (uint32_t a = offsets[f]; a < offsets[f + 1]; ++a) {
+            uint32_t t = adjacency[a];
+            if (emitted[t]) {
+                continue;
+            }
+            emitted[t] = 1;
+            for (size_t k = 0; k < 3; ++k) {
+                uint32_t v = indices[t * 3 + k];
+                result.push_back(v);
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+                if (time - cacheTime[v] > cacheSize) {
+                    cacheTime[v] = time++;
+                }
+            }
+        }
+
+        // prefer the neighbour that entered the cache earliest but will still be cached after its fan
+        int64_t next = -1;
+        int64_t bestPriority = -1;
+        for (uint32_t v : candidates) {
+            if (liveTriangles[v] == 0) {
+                continue;
+            }
+            int64_t priority = 0;
+            if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+                priority = time - cacheTime[v];
+            }
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = v;
+            }
+        }
+        // dead end: use the most recently referenced vertex that still has triangles
+        while (next < 0 && !deadEnd.empty()) {
+            uint32_t v = deadEnd.back();
+            deadEnd.pop_back();
+            if (liveTriangles[v] > 0) {
+                next = v;
+            }
+        }
+        // nothing local left: continue with the next vertex in input order
+        while (next < 0 && cursor < vertexCount) {
+            if (liveTriangles[cursor] > 0) {
+                next = static_cast<int64_t>(cursor);
+            }
+            ++cursor;
+        }
+        fanning = next;
+    }
+    return result;
+}
+
+// number of vertices transformed for a FIFO post transform cache of cacheSize entries.
+// A vertex is a hit if fewer than cacheSize misses happened since it was loaded
+template <typename Index>
+uint64_t CacheMisses(const Index* indices, size_t indexCount, size_t vertexCount, size_t cacheSize) {
+    std::vector<uint64_t> loadedAt(vertexCount, std::numeric_limits<uint64_t>::max());
+    uint64_t misses = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+        Index v = indices[i];
+        if (loadedAt[v] == std::numeric_limits<uint64_t>::max() || misses - loadedAt[v] >= cacheSize) {
+            loadedAt[v] = misses++;
+        }
+    }
+    return misses;
+}
+
+// copy the elements listed in order from a (possibly interleaved) source attribute
+AttributeView Gather(const AttributeView& source, const std::vector<uint32_t>& order) {
+    std::vector<unsigned char> data(order.size() * source.elementSize);
+    for (size_t i = 0; i < order.size(); ++i) {
+        std::memcpy(data.data() + i * source.elementSize, source.data + order[i] * source.byteStride, source.elementSize);
+    }
+    AttributeView view = OwnedAttribute(std::move(data), order.size(), source.componentType, source.type);
+    ComputeBounds(view, view.min, view.max);
+    return view;
+}
+
+} // namespace
+
+MeshPart WholeMesh(const SourceMesh& mesh) {
+    MeshPart part;
+    part.positions = mesh.positions;
+    part.normals = mesh.normals;
+    part.texCoords = mesh.texCoords;
+    part.indices = mesh.indices;
+    return part;
+}
+
+MeshPart MakeMeshPart(std::vector<float>&& positions, std::vector<float>&& normals, std::vector<float>&& texCoords,
+    const std::vector<uint32_t>& indices) {
+    MeshPart part;
+    size_t vertexCount = positions.size() / 3;
+    part.positions = OwnedAttribute(std::move(positions), vertexCount, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3);
+    part.normals = OwnedAttribute(std::move(normals), vertexCount, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3);
+    part.texCoords = OwnedAttribute(std::move(texCoords), vertexCount, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC2);
+    ComputeBounds(part.positions, part.positions.min, part.positions.max);
+    ComputeBounds(part.normals, part.normals.min, part.normals.max);
+    ComputeBounds(part.texCoords, part.texCoords.min, part.texCoords.max);
+    if (vertexCount <= MAX_PART_VERTICES) {
+        std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+        part.indices = OwnedAttribute(std::move(shortIndices), indices.size(), TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, TINYGLTF_TYPE_SCALAR);
+    } else {
+        std::vector<uint32_t> longIndices(indices);
+        part.indices = OwnedAttribute(std::move(longIndices), indices.size(), TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT, TINYGLTF_TYPE_SCALAR);
+    }
+    return part;
+}
+
+std::vector<uint32_t> ReadIndices(const AttributeView& indices) {
+    std::vector<uint32_t> result(indices.count);
+    for (size_t i = 0; i < indices.count; ++i) {
+        const unsigned char* p = indices.data + i * indices.byteStride;
+        switch (indices.componentType) {
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            result[i] = *p;
+            break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+            uint16_t v;
+            std::memcpy(&v, p, 2);
+            result[i] = v;
+            break;
+        }
+        default:
+            std::memcpy(&result[i], p, 4);
+            break;
+        }
+    }
+    return result;
+}
+
+double ComputeACMR(const uint32_t* indices, size_t indexCount, size_t vertexCount, size_t cacheSize) {
+    if (indexCount < 3) {
+        return 0.0;
+    }
+    return static_cast<double>(CacheMisses(indices, indexCount, vertexCount, cacheSize)) / static_cast<double>(indexCount / 3);
+}
+
+bool OptimizeMesh(const MeshPart& mesh, std::vector<MeshPart>& parts, MeshOptimizeStats& stats, std::string& err) {
+    size_t vertexCount = mesh.positions.count;
+    std::vector<uint32_t> indices = ReadIndices(mesh.indices);
+    indices.resize(indices.size() - indices.size() % 3);
+    for (uint32_t v : indices) {
+        if (v >= vertexCount) {
+            err = "Mesh index " + std::to_string(v) + " is out of range for " + std::to_string(vertexCount) + " vertices";
+            return false;
+        }
+    }
+    stats.acmrBefore = ComputeACMR(indices.data(), indices.size(), vertexCount, ACMR_CACHE_SIZE);
+
+    std::vector<uint32_t> optimized = Tipsify(indices, vertexCount, TIPSIFY_CACHE_SIZE);
+    std::vector<uint32_t>().swap(indices);
+
+    // split the optimized triangle stream into parts, vertices are numbered by first use in each part
+    parts.clear();
+    std::vector<uint32_t> localIndex(vertexCount, UINT32_MAX);
+    std::vector<uint32_t> partVertices; // global vertex of each local index
+    std::vector<uint16_t> partIndices;
+    uint64_t missesAfter = 0;
+    size_t trianglesAfter = 0;
+
+    auto finishPart = [&]() {
+        if (partIndices.empty()) {
+            return;
+        }
+        missesAfter += CacheMisses(partIndices.data(), partIndices.size(), partVertices.size(), ACMR_CACHE_SIZE);
+        trianglesAfter += partIndices.size() / 3;
+
+        MeshPart part;
+        part.positions = Gather(mesh.positions, partVertices);
+        part.normals = Gather(mesh.normals, partVertices);
+        part.texCoords = Gather(mesh.texCoords, partVertices);
+        size_t indexCount = partIndices.size();
+        part.indices = OwnedAttribute(std::move(partIndices), indexCount, TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT, TINYGLTF_TYPE_SCALAR);
+        parts.push_back(std::move(part));
+
+        for (uint32_t v : partVertices) {
+            localIndex[v] = UINT32_MAX;
+        }
+        partVertices.clear();
+        partIndices = std::vector<uint16_t>();
+    };
+
+    for (size_t t = 0; t < optimized.size(); t += 3) {
+        size_t newVertices = 0;
+        for (size_t k = 0; k < 3; ++k) {
+            uint32_t v = optimized[t + k];
+            bool duplicate = (k > 0 && optimized[t] == v) || (k > 1 && optimized[t + 1] == v);
+            if (localIndex[v] == UINT32_MAX && !duplicate) {
+                newVertices++;
+            }
+        }
+        if (partVertices.size() + newVertices > MAX_PART_VERTICES) {
+            finishPart();
+        }
+        for (size_t k = 0; k < 3; ++k) {
+            uint32_t v = optimized[t + k];
+            if (localIndex[v] == UINT32_MAX) {
+                localIndex[v] = static_cast<uint32_t>(partVertices.size());
+                partVertices.push_back(v);
+            }
+            partIndices.push_back(static_cast<uint16_t>(localIndex[v]));
+        }
+    }
+    finishPart();
+
+    stats.acmrAfter = trianglesAfter ? static_cast<double>(missesAfter) / trianglesAfter : 0.0;
+    stats.parts = parts.size();
+    return true;
+}
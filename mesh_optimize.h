@@ -0,0 +1,40 @@
+#pragma once
+#include "mesh_input.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// part of the terrain mesh that is written as one primitive
+struct MeshPart {
+    AttributeView positions;
+    AttributeView normals;
+    AttributeView texCoords;
+    AttributeView indices;
+};
+
+// results of the index optimization, ACMR is measured for a FIFO cache of ACMR_CACHE_SIZE entries
+struct MeshOptimizeStats {
+    double acmrBefore = 0.0;
+    double acmrAfter = 0.0;
+    size_t parts = 0;
+};
+
+const size_t ACMR_CACHE_SIZE = 16;
+
+// whole source mesh as a single part, attribute views still point into the mapped file
+MeshPart WholeMesh(const SourceMesh& mesh);
+
+// part with 16 bit indices if the vertex count allows it, 32 bit otherwise
+MeshPart MakeMeshPart(std::vector<float>&& positions, std::vector<float>&& normals, std::vector<float>&& texCoords,
+    const std::vector<uint32_t>& indices);
+
+// indices of any unsigned component type widened to 32 bit
+std::vector<uint32_t> ReadIndices(const AttributeView& indices);
+
+// average cache miss ratio: transformed vertices per triangle for a FIFO post transform cache
+double ComputeACMR(const uint32_t* indices, size_t indexCount, size_t vertexCount, size_t cacheSize);
+
+// Reorder triangles for post transform vertex cache locality (Tipsify), then renumber vertices
+// in order of first use so vertex fetch is sequential. Every part uses 16 bit indices,
+// meshes with more than 65535 vertices are split into several parts. Fails if an index is out of range
+bool OptimizeMesh(const MeshPart& mesh, std::vector<MeshPart>& parts, MeshOptimizeStats& stats, std::string& err);
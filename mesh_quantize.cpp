@@ -0,0 +1,157 @@
+#include "mesh_quantize.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+const float* Element(const AttributeView& view, size_t i) {
+    return reinterpret_cast<const float*>(view.data + i * view.byteStride);
+}
+
+size_t Components(const AttributeView& view) {
+    return view.elementSize / sizeof(float);
+}
+
+// quantize one component, clamped to the limits of the output type
+long QuantizeComponent(const QuantizedAttribute& q, size_t c, float v) {
+    double scaled = std::round((static_cast<double>(v) - q.offset[c]) * q.scale[c]);
+    double lo = 0.0, hi = 0.0;
+    switch (q.componentType) {
+    case TINYGLTF_COMPONENT_TYPE_BYTE: lo = -127.0; hi = 127.0; break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: lo = 0.0; hi = 255.0; break;
+    case TINYGLTF_COMPONENT_TYPE_SHORT: lo = -32767.0; hi = 32767.0; break;
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: lo = 0.0; hi = 65535.0; break;
+    }
+    return static_cast<long>(std::min(hi, std::max(lo, scaled)));
+}
+
+void StoreComponent(const QuantizedAttribute& q, unsigned char* out, long v) {
+    switch (q.componentType) {
+    case TINYGLTF_COMPONENT_TYPE_BYTE: {
+        int8_t b = static_cast<int8_t>(v);
+        std::memcpy(out, &b, 1);
+        break;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+        *out = static_cast<uint8_t>(v);
+        break;
+    case TINYGLTF_COMPONENT_TYPE_SHORT: {
+        int16_t s = static_cast<int16_t>(v);
+        std::memcpy(out, &s, 2);
+        break;
+    }
+    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+        uint16_t s = static_cast<uint16_t>(v);
+        std::memcpy(out, &s, 2);
+        break;
+    }
+    }
+}
+
+// quantization is monotonic, so min/max of the quantized data follow from the float bounds
+void QuantizedBounds(QuantizedAttribute& q, const std::vector<double>& min, const std::vector<double>& max) {
+    size_t components = Components(q.source);
+    q.min.resize(components);
+    q.max.resize(components);
+    for (size_t c = 0; c < components; ++c) {
+        q.min[c] = static_cast<double>(QuantizeComponent(q, c, static_cast<float>(min[c])));
+        q.max[c] = static_cast<double>(QuantizeComponent(q, c, static_cast<float>(max[c])));
+    }
+}
+
+// largest side of the bounding box. Positions use it on every axis: with a non uniform node scale, viewers
+// transform normals by its inverse transpose and the stored normals would no longer match the surface
+double UniformExtent(const std::vector<double>& boxMin, const std::vector<double>& boxMax) {
+    double extent = 0.0;
+    for (size_t c = 0; c < 3; ++c) {
+        extent = std::max(extent, boxMax[c] - boxMin[c]);
+    }
+    return extent;
+}
+
+void Setup(QuantizedAttribute& q, const AttributeView& source, int componentType) {
+    q.source = source;
+    q.componentType = componentType;
+    q.elementSize = Components(source) * tinygltf::GetComponentSizeInBytes(componentType);
+    q.outputStride = (q.elementSize + 3) & ~size_t(3);
+}
+
+} // namespace
+
+void PositionTransform(const std::vector<double>& boxMin, const std::vector<double>& boxMax, std::vector<double>& translation, std::vector<double>& scale) {
+    translation.assign(boxMin.begin(), boxMin.begin() + 3);
+    // normalized 65535 maps to 1.0, so the node scale is the largest extent of the bounding box
+    double extent = UniformExtent(boxMin, boxMax);
+    scale.assign(3, extent > 0.0 ? extent : 1.0);
+}
+
+QuantizedAttribute QuantizePositions(const AttributeView& positions, const std::vector<double>& boxMin, const std::vector<double>& boxMax) {
+    QuantizedAttribute q;
+    Setup(q, positions, TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT);
+    // the same scale on every axis, flatter axes use part of the 16 bit range only
+    double extent = UniformExtent(boxMin, boxMax);
+    for (size_t c = 0; c < 3; ++c) {
+        q.offset[c] = static_cast<float>(boxMin[c]);
+        // single point: every value is 0 and the node scale stays 1
+        q.scale[c] = extent > 0.0 ? static_cast<float>(65535.0 / extent) : 0.0f;
+    }
+    std::vector<double> min, max;
+    ComputeBounds(positions, min, max);
+    QuantizedBounds(q, min, max);
+    return q;
+}
+
+QuantizedAttribute QuantizeNormals(const AttributeView& normals) {
+    QuantizedAttribute q;
+    Setup(q, normals, TINYGLTF_COMPONENT_TYPE_BYTE);
+    for (size_t c = 0; c < 3; ++c) {
+        q.offset[c] = 0.0f;
+        q.scale[c] = 127.0f;
+    }
+    std::vector<double> min, max;
+    ComputeBounds(normals, min, max);
+    QuantizedBounds(q, min, max);
+    return q;
+}
+
+bool QuantizeTexCoords(const AttributeView& texCoords, QuantizedAttribute& out) {
+    std::vector<double> min, max;
+    ComputeBounds(texCoords, min, max);
+    for (size_t c = 0; c < min.size(); ++c) {
+        if (min[c] < 0.0 || max[c] > 1.0) {
+            return false;
+        }
+    }
+    Setup(out, texCoords, TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT);
+    for (size_t c = 0; c < 2; ++c) {
+        out.offset[c] = 0.0f;
+        out.scale[c] = 65535.0f;
+    }
+    QuantizedBounds(out, min, max);
+    return true;
+}
+
+GlbWriter::SegmentWriter QuantizedSegment(const QuantizedAttribute& attribute) {
+    return [attribute](std::ostream& out) {
+        const AttributeView& view = attribute.source;
+        size_t components = Components(view);
+        size_t componentSize = tinygltf::GetComponentSizeInBytes(attribute.componentType);
+        const size_t elementsPerBlock = 64 * 1024;
+        std::vector<unsigned char> block;
+        for (size_t first = 0; first < view.count; first += elementsPerBlock) {
+            size_t n = std::min(elementsPerBlock, view.count - first);
+            block.assign(n * attribute.outputStride, 0); // padding bytes stay 0
+            for (size_t i = 0; i < n; ++i) {
+                const float* v = Element(view, first + i);
+                unsigned char* element = block.data() + i * attribute.outputStride;
+                for (size_t c = 0; c < components; ++c) {
+                    StoreComponent(attribute, element + c * componentSize, QuantizeComponent(attribute, c, v[c]));
+                }
+            }
+            out.write(reinterpret_cast<const char*>(block.data()), block.size());
+        }
+        return static_cast<bool>(out);
+    };
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "glb_writer.h"
+#include "mesh_input.h"
+#include <vector>
+
+// Float vertex attribute written in quantized form for KHR_mesh_quantization.
+// Each component is stored as round((v - offset) * scale), clamped to the range of the component type
+struct QuantizedAttribute {
+    AttributeView source;
+    int componentType = 0;   // TINYGLTF_COMPONENT_TYPE_* of the output
+    size_t outputStride = 0; // bytes per element in the output, padded to a multiple of 4
+    size_t elementSize = 0;  // bytes per element without padding
+    float offset[4] = {};
+    float scale[4] = {};
+    std::vector<double> min; // of the quantized values, as stored in the buffer
+    std::vector<double> max;
+    size_t byteLength() const { return source.count * outputStride; }
+};
+
+// node translation and uniform scale that map quantized positions back into the bounding box, uniform so
+// that normals need no correction
+void PositionTransform(const std::vector<double>& boxMin, const std::vector<double>& boxMax, std::vector<double>& translation, std::vector<double>& scale);
+
+// positions as normalized unsigned 16 bit values inside the bounding box.
+// All primitives of a node have to use the same box, so the node transform fits all of them
+QuantizedAttribute QuantizePositions(const AttributeView& positions, const std::vector<double>& boxMin, const std::vector<double>& boxMax);
+
+// normals as normalized signed 8 bit values
+QuantizedAttribute QuantizeNormals(const AttributeView& normals);
+
+// texture coordinates as normalized unsigned 16 bit values.
+// Returns false if coordinates are outside [0, 1] and have to stay float
+bool QuantizeTexCoords(const AttributeView& texCoords, QuantizedAttribute& out);
+
+// segment writer that quantizes the source attribute block by block while writing the glb
+GlbWriter::SegmentWriter QuantizedSegment(const QuantizedAttribute& attribute);
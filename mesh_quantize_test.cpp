@@ -0,0 +1,85 @@
+// Dequantization check of mesh_quantize: positions and normals of a flat tile are quantized as for
+// KHR_mesh_quantization, then decoded the way a viewer does it, with the node transform for positions
+// and the inverse transpose of the node scale for normals, and compared with the source
+#include "mesh_quantize.h"
+#include "tiny_gltf.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// quantized bytes of the attribute, as they end up in the glb
+std::string Encode(const QuantizedAttribute& q) {
+    std::ostringstream out;
+    QuantizedSegment(q)(out);
+    return out.str();
+}
+
+} // namespace
+
+int main() {
+    // a tile that is much wider than high, like the tiles of a flat terrain
+    const std::vector<double> boxMin = { -32.0, 3.5, 96.0 };
+    const std::vector<double> boxMax = { 32.0, 15.267, 160.0 };
+    const size_t count = 4096;
+    std::mt19937 random(5);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::vector<float> positions, normals;
+    for (size_t i = 0; i < count; ++i) {
+        for (size_t c = 0; c < 3; ++c) {
+            positions.push_back(static_cast<float>(boxMin[c] + (boxMax[c] - boxMin[c]) * unit(random)));
+        }
+        // mostly upwards like terrain normals, some steep
+        float n[3] = { unit(random) * 2.0f - 1.0f, unit(random) * 2.0f + 0.05f, unit(random) * 2.0f - 1.0f };
+        float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        normals.insert(normals.end(), { n[0] / length, n[1] / length, n[2] / length });
+    }
+    AttributeView positionView = OwnedAttribute(std::vector<float>(positions), count, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3);
+    AttributeView normalView = OwnedAttribute(std::vector<float>(normals), count, TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3);
+
+    std::vector<double> translation, scale;
+    PositionTransform(boxMin, boxMax, translation, scale);
+    QuantizedAttribute quantizedPositions = QuantizePositions(positionView, boxMin, boxMax);
+    QuantizedAttribute quantizedNormals = QuantizeNormals(normalView);
+    std::string positionBytes = Encode(quantizedPositions);
+    std::string normalBytes = Encode(quantizedNormals);
+
+    int failures = 0;
+    // half a step of the 16 bit grid, and the angle of a few snorm8 steps
+    double positionTolerance = 0.5 * scale[0] / 65535.0 + 1e-4;
+    const double normalTolerance = 0.02;
+    for (size_t i = 0; i < count && failures < 10; ++i) {
+        double normal[3];
+        double length = 0.0;
+        for (size_t c = 0; c < 3; ++c) {
+            uint16_t p;
+            std::memcpy(&p, positionBytes.data() + i * quantizedPositions.outputStride + c * 2, 2);
+            double position = translation[c] + scale[c] * (p / 65535.0);
+            if (std::fabs(position - positions[i * 3 + c]) > positionTolerance) {
+                std::fprintf(stderr, "position %zu component %zu: %f instead of %f\n", i, c, position, positions[i * 3 + c]);
+                ++failures;
+            }
+            int8_t n;
+            std::memcpy(&n, normalBytes.data() + i * quantizedNormals.outputStride + c, 1);
+            normal[c] = std::max(n / 127.0, -1.0) / scale[c];
+            length += normal[c] * normal[c];
+        }
+        length = std::sqrt(length);
+        double error = 0.0;
+        for (size_t c = 0; c < 3; ++c) {
+            error = std::max(error, std::fabs(normal[c] / length - normals[i * 3 + c]));
+        }
+        if (error > normalTolerance) {
+            std::fprintf(stderr, "normal %zu differs by %f after the node transform\n", i, error);
+            ++failures;
+        }
+    }
+    std::printf("%d mismatches in %zu quantized vertices\n", failures, count);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,832 @@
+#include "png_writer.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// filtered bytes per band of rows, every band is deflated as one task
+const size_t BAND_BYTES = 256 * 1024;
+// deflate window: matches reach at most this far back, also into the band before
+const size_t WINDOW = 32768;
+const size_t MIN_MATCH = 3;
+const size_t MAX_MATCH = 258;
+// matches of MIN_MATCH bytes further back than this cost more than the literals
+const size_t TOO_FAR = 4096;
+// symbols per deflate block, every block gets its own huffman codes
+const size_t BLOCK_SYMBOLS = 16384;
+// stored blocks hold at most this many bytes
+const size_t STORED_BYTES = 65535;
+const int HASH_BITS = 15;
+const int MAX_CODE_BITS = 15;
+const int MAX_CODE_LENGTH_BITS = 7;
+const size_t LITERAL_LENGTH_CODES = 286;
+const size_t DISTANCE_CODES = 30;
+const size_t CODE_LENGTH_CODES = 19;
+const uint16_t END_OF_BLOCK = 256;
+
+const uint16_t LENGTH_BASE[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115,
+    131, 163, 195, 227, 258 };
+const uint8_t LENGTH_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t DISTANCE_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025,
+    1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t DISTANCE_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12,
+    13, 13 };
+const uint8_t CODE_LENGTH_ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// match search of a compression level, the parameters are close to zlib levels 1, 5 and 9
+struct MatchSettings {
+    int maxChain;       // hash chain entries tried per position, 0: runs of the previous byte only
+    size_t good;        // after a match this long, only a quarter of the chain is tried at the next position
+    size_t maxLazy;     // a match this long is taken without looking for a longer one at the next position
+    size_t nice;        // a match this long ends the search
+    size_t insertLimit; // positions inside longer matches are not added to the hash chains
+};
+
+MatchSettings Settings(PngLevel level) {
+    switch (level) {
+    case PngLevel::Rle: return { 0, MAX_MATCH, MIN_MATCH, MAX_MATCH, 0 };
+    case PngLevel::Fast: return { 4, 4, MIN_MATCH, 16, 8 };
+    case PngLevel::Max: return { 4096, 32, MAX_MATCH, MAX_MATCH, MAX_MATCH + 1 };
+    default: return { 32, 4, 16, 128, MAX_MATCH + 1 };
+    }
+}
+
+// length and distance symbols of match lengths and distances
+struct CodeTables {
+    uint8_t lengthCode[MAX_MATCH + 1];
+    uint8_t distanceCode[512]; // distance - 1 below 256, 256 + (distance - 1) / 128 above
+
+    CodeTables() {
+        for (uint8_t code = 0; code < 29; ++code) {
+            for (size_t length = LENGTH_BASE[code]; length < LENGTH_BASE[code] + (1u << LENGTH_EXTRA[code]) && length <= MAX_MATCH; ++length) {
+                lengthCode[length] = code;
+            }
+        }
+        // 258 has its own code, 284 with all extra bits set would also reach it
+        lengthCode[MAX_MATCH] = 28;
+        for (uint8_t code = 0; code < 30; ++code) {
+            for (size_t distance = DISTANCE_BASE[code]; distance < DISTANCE_BASE[code] + (1u << DISTANCE_EXTRA[code]); ++distance) {
+                distanceCode[distance <= 256 ? distance - 1 : 256 + ((distance - 1) >> 7)] = code;
+            }
+        }
+    }
+
+    uint8_t distance(size_t distance) const {
+        return distanceCode[distance <= 256 ? distance - 1 : 256 + ((distance - 1) >> 7)];
+    }
+};
+
+const CodeTables& Tables() {
+    static const CodeTables tables;
+    return tables;
+}
+
+// literal byte, or a match of length value at distance
+struct Token {
+    uint16_t value;
+    uint16_t distance; // 0 for literals
+};
+
+// deflate bits, least significant bit first
+class BitWriter {
+public:
+    explicit BitWriter(std::vector<unsigned char>& out) : out(out) {}
+
+    void put(uint32_t bits, int count) {
+        buffer |= static_cast<uint64_t>(bits) << used;
+        used += count;
+        while (used >= 8) {
+            out.push_back(static_cast<unsigned char>(buffer));
+            buffer >>= 8;
+            used -= 8;
+        }
+    }
+
+    // pad with zero bits to the next byte
+    void align() {
+        if (used > 0) {
+            put(0, 8 - used);
+        }
+    }
+
+    void bytes(const unsigned char* data, size_t size) {
+        out.insert(out.end(), data, data + size);
+    }
+
+private:
+    std::vector<unsigned char>& out;
+    uint64_t buffer = 0;
+    int used = 0;
+};
+
+// Code lengths of a huffman code for freqs that is limited to maxBits. Unused symbols get length 0,
+// at least two symbols get a code, so the code is always complete
+void HuffmanLengths(const uint32_t* freqs, size_t count, int maxBits, uint8_t* lengths) {
+    std::vector<std::pair<uint32_t, uint16_t>> leaves; // frequency, symbol
+    for (size_t i = 0; i < count; ++i) {
+        lengths[i] = 0;
+        if (freqs[i] > 0) {
+            leaves.push_back({ freqs[i], static_cast<uint16_t>(i) });
+        }
+    }
+    for (size_t i = 0; leaves.size() < 2; ++i) {
+        if (freqs[i] == 0) {
+            leaves.push_back({ 0, static_cast<uint16_t>(i) });
+        }
+    }
+    std::sort(leaves.begin(), leaves.end());
+
+    // two queues: sorted leaves, and inner nodes that are created in order of weight
+    size_t n = leaves.size();
+    std::vector<uint64_t> weight(2 * n - 1);
+    std::vector<size_t> parent(2 * n - 1);
+    for (size_t i = 0; i < n; ++i) {
+        weight[i] = leaves[i].first;
+    }
+    size_t leaf = 0, inner = n;
+    for (size_t next = n; next < 2 * n - 1; ++next) {
+        auto take = [&]() {
+            return leaf < n && (inner >= next || weight[leaf] <= weight[inner]) ? leaf++ : inner++;
+        };
+        size_t a = take();
+        size_t b = take();
+        weight[next] = weight[a] + weight[b];
+        parent[a] = parent[b] = next;
+    }
+    std::vector<int> depth(2 * n - 1, 0);
+    for (size_t i = 2 * n - 1; i-- > 0;) {
+        depth[i] = i == 2 * n - 2 ? 0 : depth[parent[i]] + 1;
+    }
+
+    // leaves deeper than maxBits are moved up, and leaves above them down, until the code fits (as zlib does)
+    std::vector<size_t> lengthCount(maxBits + 1, 0);
+    int overflow = 0;
+    for (size_t i = 0; i < n; ++i) {
+        int bits = depth[i];
+        if (bits > maxBits) {
+            bits = maxBits;
+            ++overflow;
+        }
+        ++lengthCount[bits];
+    }
+    while (overflow > 0) {
+        int bits = maxBits - 1;
+        while (lengthCount[bits] == 0) {
+            --bits;
+        }
+        --lengthCount[bits];
+        lengthCount[bits + 1] += 2;
+        --lengthCount[maxBits];
+        overflow -= 2;
+    }
+    // the least frequent symbols get the longest codes
+    size_t next = 0;
+    for (int bits = maxBits; bits >= 1; --bits) {
+        for (size_t i = 0; i < lengthCount[bits]; ++i) {
+            lengths[leaves[next++].second] = static_cast<uint8_t>(bits);
+        }
+    }
+}
+
+// canonical codes of lengths, bit reversed for the least significant bit first output
+void CanonicalCodes(const uint8_t* lengths, size_t count, uint16_t* codes) {
+    uint16_t lengthCount[MAX_CODE_BITS + 1] = {};
+    for (size_t i = 0; i < count; ++i) {
+        ++lengthCount[lengths[i]];
+    }
+    lengthCount[0] = 0;
+    uint16_t next[MAX_CODE_BITS + 1] = {};
+    uint16_t code = 0;
+    for (int bits = 1; bits <= MAX_CODE_BITS; ++bits) {
+        code = static_cast<uint16_t>((code + lengthCount[bits - 1]) << 1);
+        next[bits] = code;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        uint16_t reversed = 0;
+        for (int bit = 0, value = next[lengths[i]]++; bit < lengths[i]; ++bit, value >>= 1) {
+            reversed = static_cast<uint16_t>((reversed << 1) | (value & 1));
+        }
+        codes[i] = reversed;
+    }
+}
+
+// code lengths of the fixed huffman block type
+void FixedLengths(uint8_t* literalLengths, uint8_t* distanceLengths) {
+    for (size_t i = 0; i < 288; ++i) {
+        literalLengths[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+    }
+    std::fill(distanceLengths, distanceLengths + DISTANCE_CODES, 5);
+}
+
+// code length symbol with its extra bits
+struct CodeLengthSymbol {
+    uint8_t symbol;
+    uint8_t extra;
+};
+
+// run length encoding of the code lengths of a dynamic block header: 16 repeats the previous length,
+// 17 and 18 are runs of zeros
+std::vector<CodeLengthSymbol> CodeLengthSymbols(const uint8_t* lengths, size_t count) {
+    std::vector<CodeLengthSymbol> symbols;
+    for (size_t i = 0; i < count;) {
+        uint8_t length = lengths[i];
+        size_t run = 1;
+        while (i + run < count && lengths[i + run] == length) {
+            ++run;
+        }
+        i += run;
+        if (length == 0) {
+            while (run >= 11) {
+                size_t part = std::min<size_t>(run, 138);
+                symbols.push_back({ 18, static_cast<uint8_t>(part - 11) });
+                run -= part;
+            }
+            if (run >= 3) {
+                symbols.push_back({ 17, static_cast<uint8_t>(run - 3) });
+                run = 0;
+            }
+        } else {
+            symbols.push_back({ length, 0 });
+            --run;
+            while (run >= 3) {
+                size_t part = std::min<size_t>(run, 6);
+                symbols.push_back({ 16, static_cast<uint8_t>(part - 3) });
+                run -= part;
+            }
+        }
+        for (; run > 0; --run) {
+            symbols.push_back({ length, 0 });
+        }
+    }
+    return symbols;
+}
+
+// huffman codes of one block and its size in bits as dynamic and as fixed block
+struct BlockPlan {
+    uint8_t literalLengths[288];
+    uint8_t distanceLengths[DISTANCE_CODES];
+    size_t literalCount;
+    size_t distanceCount;
+    std::vector<CodeLengthSymbol> headerSymbols;
+    uint8_t codeLengthLengths[CODE_LENGTH_CODES];
+    size_t codeLengthCount;
+    uint64_t dynamicBits;
+    uint64_t fixedBits;
+};
+
+int CodeLengthExtraBits(uint8_t symbol) {
+    return symbol == 16 ? 2 : symbol == 17 ? 3 : symbol == 18 ? 7 : 0;
+}
+
+// plan the codes of a block from its symbol frequencies, extraBits are the length and distance extra bits
+void PlanBlock(const uint32_t* literalFreqs, const uint32_t* distanceFreqs, uint64_t extraBits, BlockPlan& plan) {
+    HuffmanLengths(literalFreqs, LITERAL_LENGTH_CODES, MAX_CODE_BITS, plan.literalLengths);
+    HuffmanLengths(distanceFreqs, DISTANCE_CODES, MAX_CODE_BITS, plan.distanceLengths);
+    plan.literalCount = LITERAL_LENGTH_CODES;
+    while (plan.literalCount > 257 && plan.literalLengths[plan.literalCount - 1] == 0) {
+        --plan.literalCount;
+    }
+    plan.distanceCount = DISTANCE_CODES;
+    while (plan.distanceCount > 1 && plan.distanceLengths[plan.distanceCount - 1] == 0) {
+        --plan.distanceCount;
+    }
+    uint8_t headerLengths[LITERAL_LENGTH_CODES + DISTANCE_CODES];
+    std::copy(plan.literalLengths, plan.literalLengths + plan.literalCount, headerLengths);
+    std::copy(plan.distanceLengths, plan.distanceLengths + plan.distanceCount, headerLengths + plan.literalCount);
+    plan.headerSymbols = CodeLengthSymbols(headerLengths, plan.literalCount + plan.distanceCount);
+    uint32_t codeLengthFreqs[CODE_LENGTH_CODES] = {};
+    for (const auto& symbol : plan.headerSymbols) {
+        ++codeLengthFreqs[symbol.symbol];
+    }
+    HuffmanLengths(codeLengthFreqs, CODE_LENGTH_CODES, MAX_CODE_LENGTH_BITS, plan.codeLengthLengths);
+    plan.codeLengthCount = CODE_LENGTH_CODES;
+    while (plan.codeLengthCount > 4 && plan.codeLengthLengths[CODE_LENGTH_ORDER[plan.codeLengthCount - 1]] == 0) {
+        --plan.codeLengthCount;
+    }
+
+    uint8_t fixedLiteralLengths[288];
+    uint8_t fixedDistanceLengths[DISTANCE_CODES];
+    FixedLengths(fixedLiteralLengths, fixedDistanceLengths);
+    plan.dynamicBits = 3 + 14 + 3 * plan.codeLengthCount + extraBits;
+    plan.fixedBits = 3 + extraBits;
+    for (size_t i = 0; i < LITERAL_LENGTH_CODES; ++i) {
+        plan.dynamicBits += static_cast<uint64_t>(literalFreqs[i]) * plan.literalLengths[i];
+        plan.fixedBits += static_cast<uint64_t>(literalFreqs[i]) * fixedLiteralLengths[i];
+    }
+    for (size_t i = 0; i < DISTANCE_CODES; ++i) {
+        plan.dynamicBits += static_cast<uint64_t>(distanceFreqs[i]) * plan.distanceLengths[i];
+        plan.fixedBits += static_cast<uint64_t>(distanceFreqs[i]) * fixedDistanceLengths[i];
+    }
+    for (const auto& symbol : plan.headerSymbols) {
+        plan.dynamicBits += plan.codeLengthLengths[symbol.symbol] + CodeLengthExtraBits(symbol.symbol);
+    }
+}
+
+// Write one deflate block: tokens, or the raw bytes they stand for as literals only, as fixed, dynamic or
+// stored block, whichever is smallest. Literals only win on noisy maps where short matches cost more than they save
+void WriteBlock(BitWriter& bits, const std::vector<Token>& tokens, const unsigned char* raw, size_t rawSize, bool final) {
+    const CodeTables& tables = Tables();
+    uint32_t literalFreqs[LITERAL_LENGTH_CODES] = {};
+    uint32_t distanceFreqs[DISTANCE_CODES] = {};
+    uint64_t extraBits = 0;
+    for (const Token& token : tokens) {
+        if (token.distance == 0) {
+            ++literalFreqs[token.value];
+        } else {
+            uint8_t lengthCode = tables.lengthCode[token.value];
+            uint8_t distanceCode = tables.distance(token.distance);
+            ++literalFreqs[257 + lengthCode];
+            ++distanceFreqs[distanceCode];
+            extraBits += LENGTH_EXTRA[lengthCode] + DISTANCE_EXTRA[distanceCode];
+        }
+    }
+    ++literalFreqs[END_OF_BLOCK];
+    BlockPlan plan;
+    PlanBlock(literalFreqs, distanceFreqs, extraBits, plan);
+    uint64_t tokenBits = std::min(plan.dynamicBits, plan.fixedBits);
+
+    bool literalsOnly = false;
+    if (tokens.size() < rawSize) {
+        uint32_t rawFreqs[LITERAL_LENGTH_CODES] = {};
+        uint32_t noDistances[DISTANCE_CODES] = {};
+        for (size_t i = 0; i < rawSize; ++i) {
+            ++rawFreqs[raw[i]];
+        }
+        ++rawFreqs[END_OF_BLOCK];
+        BlockPlan literalPlan;
+        PlanBlock(rawFreqs, noDistances, 0, literalPlan);
+        if (std::min(literalPlan.dynamicBits, literalPlan.fixedBits) < tokenBits) {
+            plan = literalPlan;
+            tokenBits = std::min(plan.dynamicBits, plan.fixedBits);
+            literalsOnly = true;
+        }
+    }
+
+    size_t storedBlocks = std::max<size_t>(1, (rawSize + STORED_BYTES - 1) / STORED_BYTES);
+    uint64_t storedBits = (rawSize + storedBlocks * 5) * 8 + 7;
+    if (storedBits <= tokenBits) {
+        for (size_t i = 0; i < storedBlocks; ++i) {
+            size_t size = std::min(STORED_BYTES, rawSize - i * STORED_BYTES);
+            bits.put(final && i + 1 == storedBlocks ? 1 : 0, 3);
+            bits.align();
+            bits.put(static_cast<uint32_t>(size), 16);
+            bits.put(static_cast<uint32_t>(~size & 0xffff), 16);
+            bits.bytes(raw + i * STORED_BYTES, size);
+        }
+        return;
+    }
+
+    uint8_t fixedLiteralLengths[288];
+    uint8_t fixedDistanceLengths[DISTANCE_CODES];
+    const uint8_t* lengths = plan.literalLengths;
+    const uint8_t* distanceLengths = plan.distanceLengths;
+    size_t literalCodeCount = LITERAL_LENGTH_CODES;
+    if (plan.fixedBits <= plan.dynamicBits) {
+        bits.put(final ? 1 : 0, 1);
+        bits.put(1, 2);
+        FixedLengths(fixedLiteralLengths, fixedDistanceLengths);
+        lengths = fixedLiteralLengths;
+        distanceLengths = fixedDistanceLengths;
+        literalCodeCount = 288;
+    } else {
+        bits.put(final ? 1 : 0, 1);
+        bits.put(2, 2);
+        bits.put(static_cast<uint32_t>(plan.literalCount - 257), 5);
+        bits.put(static_cast<uint32_t>(plan.distanceCount - 1), 5);
+        bits.put(static_cast<uint32_t>(plan.codeLengthCount - 4), 4);
+        for (size_t i = 0; i < plan.codeLengthCount; ++i) {
+            bits.put(plan.codeLengthLengths[CODE_LENGTH_ORDER[i]], 3);
+        }
+        uint16_t codeLengthCodes[CODE_LENGTH_CODES];
+        CanonicalCodes(plan.codeLengthLengths, CODE_LENGTH_CODES, codeLengthCodes);
+        for (const auto& symbol : plan.headerSymbols) {
+            bits.put(codeLengthCodes[symbol.symbol], plan.codeLengthLengths[symbol.symbol]);
+            bits.put(symbol.extra, CodeLengthExtraBits(symbol.symbol));
+        }
+    }
+    uint16_t literalCodes[288];
+    uint16_t distanceCodes[DISTANCE_CODES];
+    CanonicalCodes(lengths, literalCodeCount, literalCodes);
+    CanonicalCodes(distanceLengths, DISTANCE_CODES, distanceCodes);
+    if (literalsOnly) {
+        for (size_t i = 0; i < rawSize; ++i) {
+            bits.put(literalCodes[raw[i]], lengths[raw[i]]);
+        }
+    } else {
+        for (const Token& token : tokens) {
+            if (token.distance == 0) {
+                bits.put(literalCodes[token.value], lengths[token.value]);
+            } else {
+                uint8_t lengthCode = tables.lengthCode[token.value];
+                uint8_t distanceCode = tables.distance(token.distance);
+                bits.put(literalCodes[257 + lengthCode], lengths[257 + lengthCode]);
+                bits.put(token.value - LENGTH_BASE[lengthCode], LENGTH_EXTRA[lengthCode]);
+                bits.put(distanceCodes[distanceCode], distanceLengths[distanceCode]);
+                bits.put(token.distance - DISTANCE_BASE[distanceCode], DISTANCE_EXTRA[distanceCode]);
+            }
+        }
+    }
+    bits.put(literalCodes[END_OF_BLOCK], lengths[END_OF_BLOCK]);
+}
+
+// number of equal bytes of a and b, at most limit
+size_t MatchLength(const unsigned char* a, const unsigned char* b, size_t limit) {
+    size_t n = 0;
+    while (n + 8 <= limit) {
+        uint64_t x, y;
+        std::memcpy(&x, a + n, 8);
+        std::memcpy(&y, b + n, 8);
+        if (x != y) {
+            break;
+        }
+        n += 8;
+    }
+    while (n < limit && a[n] == b[n]) {
+        ++n;
+    }
+    return n;
+}
+
+// Deflate data[begin, end) to out, with data[windowBegin, begin) as history that matches can refer to.
+// The last band of the stream ends with a final block, the others byte aligned with an empty stored block,
+// so the bands of an image can simply be concatenated
+void DeflateBand(const unsigned char* data, size_t windowBegin, size_t begin, size_t end, PngLevel level, bool final,
+    std::vector<unsigned char>& out) {
+    BitWriter bits(out);
+    if (level == PngLevel::Store) {
+        for (size_t offset = begin; offset < end; offset += STORED_BYTES) {
+            size_t size = std::min(STORED_BYTES, end - offset);
+            bits.put(final && offset + size == end ? 1 : 0, 3);
+            bits.align();
+            bits.put(static_cast<uint32_t>(size), 16);
+            bits.put(static_cast<uint32_t>(~size & 0xffff), 16);
+            bits.bytes(data + offset, size);
+        }
+        return;
+    }
+
+    const MatchSettings settings = Settings(level);
+    // hash chains of 3 byte prefixes, positions are stored + 1 relative to windowBegin, 0 ends a chain
+    std::vector<uint32_t> head(settings.maxChain > 0 ? size_t(1) << HASH_BITS : 0, 0);
+    std::vector<uint32_t> prev(settings.maxChain > 0 ? WINDOW : 0, 0);
+    auto hash = [&](size_t p) {
+        uint32_t v = data[p] | (data[p + 1] << 8) | (data[p + 2] << 16);
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    };
+    auto insert = [&](size_t p) {
+        if (settings.maxChain > 0 && p + MIN_MATCH <= end) {
+            uint32_t h = hash(p);
+            prev[p & (WINDOW - 1)] = head[h];
+            head[h] = static_cast<uint32_t>(p - windowBegin + 1);
+        }
+    };
+    // longest match at p, 0 if there is none of at least MIN_MATCH bytes
+    auto longest = [&](size_t p, size_t& distance, int maxChain) -> size_t {
+        size_t limit = std::min(MAX_MATCH, end - p);
+        if (limit < MIN_MATCH) {
+            return 0;
+        }
+        if (settings.maxChain == 0) {
+            size_t run = p > windowBegin ? MatchLength(data + p - 1, data + p, limit) : 0;
+            distance = 1;
+            return run >= MIN_MATCH ? run : 0;
+        }
+        size_t best = MIN_MATCH - 1;
+        uint32_t entry = head[hash(p)];
+        for (int chain = maxChain; entry != 0 && chain > 0; --chain) {
+            size_t candidate = windowBegin + entry - 1;
+            if (p - candidate > WINDOW) {
+                break;
+            }
+            // hashes collide, the first bytes and the byte that would make the match longer are checked first
+            if (data[candidate + best] == data[p + best] && data[candidate] == data[p] && data[candidate + 1] == data[p + 1]) {
+                size_t length = MatchLength(data + candidate, data + p, limit);
+                if (length > best) {
+                    best = length;
+                    distance = p - candidate;
+                    // no longer match is possible, and data[p + best] would be past the band
+                    if (length >= settings.nice || length >= limit) {
+                        break;
+                    }
+                }
+            }
+            uint32_t next = prev[candidate & (WINDOW - 1)];
+            if (next >= entry) {
+                // the chain entry was overwritten by a position WINDOW later
+                break;
+            }
+            entry = next;
+        }
+        return best >= MIN_MATCH && !(best == MIN_MATCH && distance > TOO_FAR) ? best : 0;
+    };
+
+    for (size_t p = windowBegin; p < begin; ++p) {
+        insert(p);
+    }
+    std::vector<Token> tokens;
+    tokens.reserve(BLOCK_SYMBOLS);
+    size_t blockBegin = begin;
+    size_t covered = begin; // end of the bytes the tokens stand for
+    auto emit = [&](uint16_t value, size_t distance, size_t length) {
+        tokens.push_back({ value, static_cast<uint16_t>(distance) });
+        covered += length;
+        if (tokens.size() >= BLOCK_SYMBOLS) {
+            WriteBlock(bits, tokens, data + blockBegin, covered - blockBegin, final && covered == end);
+            tokens.clear();
+            blockBegin = covered;
+        }
+    };
+    auto insertMatch = [&](size_t from, size_t to) {
+        if (to - from < settings.insertLimit) {
+            for (size_t q = from; q < to; ++q) {
+                insert(q);
+            }
+        }
+    };
+
+    // with lazy matching, a match found at p - 1 waits for the search at p
+    bool pending = false;
+    size_t pendingLength = 0, pendingDistance = 0;
+    size_t p = begin;
+    while (p < end) {
+        size_t distance = 0;
+        size_t length = longest(p, distance, pending && pendingLength >= settings.good ? settings.maxChain / 4 : settings.maxChain);
+        if (pending) {
+            if (pendingLength >= length) {
+                emit(static_cast<uint16_t>(pendingLength), pendingDistance, pendingLength);
+                insert(p);
+                insertMatch(p + 1, p - 1 + pendingLength);
+                p += pendingLength - 1;
+                pending = false;
+                continue;
+            }
+            emit(data[p - 1], 0, 1);
+            pending = false;
+        }
+        insert(p);
+        if (length >= settings.maxLazy) {
+            emit(static_cast<uint16_t>(length), distance, length);
+            insertMatch(p + 1, p + length);
+            p += length;
+        } else if (length > 0) {
+            pending = true;
+            pendingLength = length;
+            pendingDistance = distance;
+            ++p;
+        } else {
+            emit(data[p], 0, 1);
+            ++p;
+        }
+    }
+    if (pending) {
+        emit(static_cast<uint16_t>(pendingLength), pendingDistance, pendingLength);
+    }
+    if (!tokens.empty() || covered == begin) {
+        WriteBlock(bits, tokens, data + blockBegin, covered - blockBegin, final);
+    }
+    if (!final) {
+        // empty stored block: ends the band on a byte boundary
+        bits.put(0, 3);
+        bits.align();
+        bits.put(0, 16);
+        bits.put(0xffff, 16);
+    } else {
+        bits.align();
+    }
+}
+
+uint8_t Paeth(int a, int b, int c) {
+    int pa = std::abs(b - c);
+    int pb = std::abs(a - c);
+    int pc = std::abs(a + b - 2 * c);
+    return static_cast<uint8_t>(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+// png row filter type (0 none, 1 sub, 2 up, 3 average, 4 paeth) of row to out. prior is the row above, all zero
+// in the first row. The first pixel has no left neighbour, a loop per type keeps the switch out of the inner loop
+void FilterRow(int type, const unsigned char* row, const unsigned char* prior, size_t size, size_t bpp, unsigned char* out) {
+    size_t first = std::min(bpp, size);
+    switch (type) {
+    case 0:
+        std::memcpy(out, row, size);
+        break;
+    case 1:
+        std::memcpy(out, row, first);
+        for (size_t i = first; i < size; ++i) {
+            out[i] = static_cast<unsigned char>(row[i] - row[i - bpp]);
+        }
+        break;
+    case 2:
+        for (size_t i = 0; i < size; ++i) {
+            out[i] = static_cast<unsigned char>(row[i] - prior[i]);
+        }
+        break;
+    case 3:
+        for (size_t i = 0; i < first; ++i) {
+            out[i] = static_cast<unsigned char>(row[i] - (prior[i] >> 1));
+        }
+        for (size_t i = first; i < size; ++i) {
+            out[i] = static_cast<unsigned char>(row[i] - ((row[i - bpp] + prior[i]) >> 1));
+        }
+        break;
+    default:
+        for (size_t i = 0; i < first; ++i) {
+            out[i] = static_cast<unsigned char>(row[i] - prior[i]);
+        }
+        for (size_t i = first; i < size; ++i) {
+            out[i] = static_cast<unsigned char>(row[i] - Paeth(row[i - bpp], prior[i], prior[i - bpp]));
+        }
+        break;
+    }
+}
+
+// sum of the absolute values of the filtered bytes as signed numbers
+uint64_t FilterCost(const unsigned char* filtered, size_t size) {
+    uint64_t cost = 0;
+    for (size_t i = 0; i < size; ++i) {
+        cost += static_cast<uint64_t>(std::abs(static_cast<int>(static_cast<int8_t>(filtered[i]))));
+    }
+    return cost;
+}
+
+// Filter rows [first, last) to filtered, each row as filter type byte and filtered bytes. Compressed levels
+// pick the filter with the smallest sum of absolute differences per row, the usual png heuristic
+void FilterRows(const unsigned char* pixels, size_t stride, size_t bpp, size_t first, size_t last, PngLevel level,
+    unsigned char* filtered) {
+    std::vector<unsigned char> zeros(stride, 0);
+    std::vector<unsigned char> candidate(stride);
+    for (size_t r = first; r < last; ++r) {
+        const unsigned char* row = pixels + r * stride;
+        const unsigned char* prior = r > 0 ? row - stride : zeros.data();
+        unsigned char* out = filtered + r * (stride + 1);
+        if (level == PngLevel::Store) {
+            out[0] = 0;
+            std::memcpy(out + 1, row, stride);
+            continue;
+        }
+        uint64_t bestCost = UINT64_MAX;
+        for (int type = 0; type < 5; ++type) {
+            FilterRow(type, row, prior, stride, bpp, candidate.data());
+            uint64_t cost = FilterCost(candidate.data(), stride);
+            if (cost < bestCost) {
+                bestCost = cost;
+                out[0] = static_cast<unsigned char>(type);
+                std::memcpy(out + 1, candidate.data(), stride);
+            }
+        }
+    }
+}
+
+const uint32_t ADLER_BASE = 65521;
+
+uint32_t Adler32(const unsigned char* data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        // largest count that cannot overflow b before the modulo
+        size_t count = std::min<size_t>(size, 5552);
+        size -= count;
+        for (; count > 0; --count) {
+            a += *data++;
+            b += a;
+        }
+        a %= ADLER_BASE;
+        b %= ADLER_BASE;
+    }
+    return b << 16 | a;
+}
+
+// adler32 of two concatenated parts from the checksums of the parts, size2 is the size of the second part
+uint32_t Adler32Combine(uint32_t adler1, uint32_t adler2, size_t size2) {
+    uint32_t remainder = static_cast<uint32_t>(size2 % ADLER_BASE);
+    uint32_t sum1 = adler1 & 0xffff;
+    uint32_t sum2 = static_cast<uint32_t>((static_cast<uint64_t>(remainder) * sum1) % ADLER_BASE);
+    sum1 += (adler2 & 0xffff) + ADLER_BASE - 1;
+    sum2 += (adler1 >> 16) + (adler2 >> 16) + ADLER_BASE - remainder;
+    if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+    if (sum1 >= ADLER_BASE) sum1 -= ADLER_BASE;
+    if (sum2 >= 2 * ADLER_BASE) sum2 -= 2 * ADLER_BASE;
+    if (sum2 >= ADLER_BASE) sum2 -= ADLER_BASE;
+    return sum1 | (sum2 << 16);
+}
+
+uint32_t Crc32(const unsigned char* data, size_t size) {
+    static const auto table = []() {
+        std::vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    uint32_t crc = 0xffffffffu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc ^ 0xffffffffu;
+}
+
+void PutBigEndian(std::vector<unsigned char>& out, uint32_t value) {
+    out.push_back(static_cast<unsigned char>(value >> 24));
+    out.push_back(static_cast<unsigned char>(value >> 16));
+    out.push_back(static_cast<unsigned char>(value >> 8));
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+} // namespace
+
+std::vector<unsigned char> EncodePng(const unsigned char* pixels, int width, int height, int channels, PngLevel level,
+    ThreadPool& pool) {
+    static const uint8_t colorTypes[5] = { 0, 0, 4, 2, 6 }; // gray, gray alpha, rgb, rgba
+    if (width <= 0 || height <= 0 || channels < 1 || channels > 4) {
+        return {};
+    }
+    const size_t stride = static_cast<size_t>(width) * channels;
+    const size_t rows = static_cast<size_t>(height);
+    const size_t rowsPerBand = std::max<size_t>(1, BAND_BYTES / (stride + 1));
+    const size_t bands = (rows + rowsPerBand - 1) / rowsPerBand;
+
+    // all rows are filtered first, bands look back into the filtered data of the band before
+    std::vector<unsigned char> filtered(rows * (stride + 1));
+    pool.parallelFor(bands, [&](size_t band) {
+        FilterRows(pixels, stride, channels, band * rowsPerBand, std::min(rows, (band + 1) * rowsPerBand), level, filtered.data());
+    });
+    std::vector<std::vector<unsigned char>> deflated(bands);
+    std::vector<uint32_t> adlers(bands);
+    pool.parallelFor(bands, [&](size_t band) {
+        size_t begin = band * rowsPerBand * (stride + 1);
+        size_t end = std::min(rows, (band + 1) * rowsPerBand) * (stride + 1);
+        size_t windowBegin = begin > WINDOW ? begin - WINDOW : 0;
+        DeflateBand(filtered.data(), windowBegin, begin, end, level, band + 1 == bands, deflated[band]);
+        adlers[band] = Adler32(filtered.data() + begin, end - begin);
+    });
+    uint32_t adler = adlers[0];
+    for (size_t band = 1; band < bands; ++band) {
+        size_t size = (std::min(rows, (band + 1) * rowsPerBand) - band * rowsPerBand) * (stride + 1);
+        adler = Adler32Combine(adler, adlers[band], size);
+    }
+
+    // one IDAT chunk per band: the zlib header goes in front of the first, the checksum after the last
+    static const int levelFlags[5] = { 0, 0, 1, 2, 3 };
+    const unsigned char cmf = 0x78; // deflate, 32 KB window
+    unsigned flg = levelFlags[static_cast<int>(level)] << 6;
+    flg += 31 - (cmf * 256 + flg) % 31;
+    size_t total = 8 + 25 + 12;
+    for (const auto& band : deflated) {
+        total += 12 + band.size();
+    }
+    std::vector<unsigned char> png;
+    png.reserve(total + 6);
+    std::vector<size_t> chunks; // offsets of the chunk types, for the checksums
+    auto beginChunk = [&](const char* type, size_t size) {
+        PutBigEndian(png, static_cast<uint32_t>(size));
+        chunks.push_back(png.size());
+        png.insert(png.end(), type, type + 4);
+    };
+    auto endChunk = [&]() {
+        png.resize(png.size() + 4); // checksum, computed below
+    };
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    png.insert(png.end(), signature, signature + 8);
+    beginChunk("IHDR", 13);
+    PutBigEndian(png, static_cast<uint32_t>(width));
+    PutBigEndian(png, static_cast<uint32_t>(height));
+    png.push_back(8);
+    png.push_back(colorTypes[channels]);
+    png.push_back(0);
+    png.push_back(0);
+    png.push_back(0);
+    endChunk();
+    for (size_t band = 0; band < bands; ++band) {
+        bool first = band == 0;
+        bool last = band + 1 == bands;
+        beginChunk("IDAT", deflated[band].size() + (first ? 2 : 0) + (last ? 4 : 0));
+        if (first) {
+            png.push_back(cmf);
+            png.push_back(static_cast<unsigned char>(flg));
+        }
+        png.insert(png.end(), deflated[band].begin(), deflated[band].end());
+        if (last) {
+            PutBigEndian(png, adler);
+        }
+        endChunk();
+        std::vector<unsigned char>().swap(deflated[band]);
+    }
+    beginChunk("IEND", 0);
+    endChunk();
+
+    // checksum of type and data, in front of the next chunk or at the end
+    pool.parallelFor(chunks.size(), [&](size_t i) {
+        size_t begin = chunks[i];
+        size_t end = (i + 1 < chunks.size() ? chunks[i + 1] - 4 : png.size()) - 4;
+        uint32_t crc = Crc32(png.data() + begin, end - begin);
+        for (int k = 0; k < 4; ++k) {
+            png[end + k] = static_cast<unsigned char>(crc >> (24 - 8 * k));
+        }
+    });
+    return png;
+}
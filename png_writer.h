@@ -0,0 +1,19 @@
+#pragma once
+#include "thread_pool.h"
+#include <vector>
+
+// speed / size trade off of the png encoder
+enum class PngLevel {
+    Store,   // no filtering or compression, for iteration builds
+    Rle,     // adaptive row filters, runs of repeated bytes only
+    Fast,    // short hash chains, greedy matches
+    Default, // longer hash chains with lazy matching
+    Max      // long hash chains, for shipping builds
+};
+
+// Encode 8 bit pixels with 1 to 4 channels to a png. Rows are filtered and deflated in bands of about
+// 256 KB in parallel on the pool. Each band is a byte aligned part of one zlib stream in its own IDAT
+// chunk, and uses the end of the band before as match history. Safe to call from a pool task.
+// Returns an empty vector for invalid sizes or channel counts
+std::vector<unsigned char> EncodePng(const unsigned char* pixels, int width, int height, int channels, PngLevel level,
+    ThreadPool& pool);
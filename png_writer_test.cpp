@@ -0,0 +1,111 @@
+// Round trip check of EncodePng: every level, 1 to 4 channels and sizes from a single pixel to images of
+// many bands are encoded, decoded with stb_image and compared byte by byte. With zlib, chunk CRCs are
+// checked and the IDAT stream is inflated by zlib, which also checks the adler32 of the combined bands
+#include "png_writer.h"
+#include "stb_image.h"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#if defined(PNG_WRITER_TEST_ZLIB)
+#include <zlib.h>
+#endif
+
+namespace {
+
+const char* LEVEL_NAMES[] = { "store", "rle", "fast", "default", "max" };
+
+// pixels of a test pattern: constant, noise, gradient, or blocks with a little noise like terrain maps
+std::vector<unsigned char> Pattern(int kind, int width, int height, int channels, std::mt19937& random) {
+    std::vector<unsigned char> pixels(static_cast<size_t>(width) * height * channels);
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        size_t pixel = i / channels, x = pixel % width, y = pixel / width, c = i % channels;
+        switch (kind) {
+        case 0: pixels[i] = 77; break;
+        case 1: pixels[i] = static_cast<unsigned char>(random()); break;
+        case 2: pixels[i] = static_cast<unsigned char>(x * 3 + y + c * 50); break;
+        default: pixels[i] = static_cast<unsigned char>((x / 7 + y / 5) % 3 * 40 + random() % 4); break;
+        }
+    }
+    return pixels;
+}
+
+#if defined(PNG_WRITER_TEST_ZLIB)
+uint32_t BigEndian(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) << 24 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 8 | p[3];
+}
+
+// check the chunk CRCs and inflate the IDAT chunks, which have to hold height rows of 1 + width * channels bytes
+bool CheckWithZlib(const std::vector<unsigned char>& png, int width, int height, int channels, std::string& err) {
+    std::vector<unsigned char> stream;
+    for (size_t offset = 8; offset + 12 <= png.size();) {
+        uint32_t size = BigEndian(&png[offset]);
+        if (offset + 12 + size > png.size()) {
+            err = "chunk past the end";
+            return false;
+        }
+        const unsigned char* type = &png[offset + 4];
+        if (crc32(0, type, size + 4) != BigEndian(type + 4 + size)) {
+            err = "chunk crc mismatch";
+            return false;
+        }
+        if (std::memcmp(type, "IDAT", 4) == 0) {
+            stream.insert(stream.end(), type + 4, type + 4 + size);
+        }
+        offset += 12 + size;
+    }
+    uLongf expected = static_cast<uLongf>(height) * (1 + static_cast<uLongf>(width) * channels);
+    std::vector<unsigned char> filtered(expected + 1);
+    uLongf inflated = static_cast<uLongf>(filtered.size());
+    if (uncompress(filtered.data(), &inflated, stream.data(), static_cast<uLong>(stream.size())) != Z_OK || inflated != expected) {
+        err = "zlib cannot inflate the image data";
+        return false;
+    }
+    return true;
+}
+#endif
+
+} // namespace
+
+int main() {
+    ThreadPool pool(4);
+    std::mt19937 random(3);
+    // 700 x 4 channels gives about 90 rows per band, so several bands that refer back into the one before
+    const int sizes[][2] = { { 1, 1 }, { 3, 2 }, { 17, 5 }, { 300, 200 }, { 700, 700 }, { 5, 40000 } };
+    int failures = 0;
+    int checks = 0;
+    for (const auto& size : sizes) {
+        for (int channels = 1; channels <= 4; ++channels) {
+            for (int kind = 0; kind < 4; ++kind) {
+                int width = size[0], height = size[1];
+                std::vector<unsigned char> pixels = Pattern(kind, width, height, channels, random);
+                for (int level = 0; level < 5; ++level) {
+                    ++checks;
+                    std::vector<unsigned char> png = EncodePng(pixels.data(), width, height, channels, static_cast<PngLevel>(level), pool);
+                    std::string err;
+                    int w = 0, h = 0, c = 0;
+                    unsigned char* decoded = stbi_load_from_memory(png.data(), static_cast<int>(png.size()), &w, &h, &c, channels);
+                    if (!decoded) {
+                        err = "stb_image cannot decode it";
+                    } else if (w != width || h != height || c != channels || std::memcmp(decoded, pixels.data(), pixels.size()) != 0) {
+                        err = "decoded pixels differ";
+                    }
+                    stbi_image_free(decoded);
+#if defined(PNG_WRITER_TEST_ZLIB)
+                    if (err.empty()) {
+                        CheckWithZlib(png, width, height, channels, err);
+                    }
+#endif
+                    if (!err.empty()) {
+                        ++failures;
+                        std::fprintf(stderr, "%d x %d, %d channels, pattern %d, level %s: %s\n", width, height, channels, kind,
+                            LEVEL_NAMES[level], err.c_str());
+                    }
+                }
+            }
+        }
+    }
+    std::printf("%d of %d png round trips failed\n", failures, checks);
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,268 @@
+#include "synthetic_export.h"
+#include "glb_writer.h"
+#include "stb_image_write.h"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <vector>
+
+namespace {
+
+// rows per parallelFor task
+const size_t ROWS_PER_TASK = 32;
+
+// relief of the terrain relative to its extent
+const float HEIGHT_SCALE = 0.15f;
+
+// random value in [0, 1) for a lattice point, the same for the same arguments
+float LatticeValue(int32_t x, int32_t y, uint32_t octave, uint32_t seed) {
+    uint32_t h = static_cast<uint32_t>(x) * 0x8DA6B343u ^ static_cast<uint32_t>(y) * 0xD8163841u ^ octave * 0xCB1AB31Fu ^ seed * 0x9E3779B9u;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6Du;
+    h ^= h >> 12;
+    h *= 0x297A2D39u;
+    h ^= h >> 15;
+    return (h >> 8) * (1.0f / 16777216.0f);
+}
+
+// smoothly interpolated value noise of one octave
+float ValueNoise(float x, float y, uint32_t octave, uint32_t seed) {
+    float fx = std::floor(x);
+    float fy = std::floor(y);
+    int32_t ix = static_cast<int32_t>(fx);
+    int32_t iy = static_cast<int32_t>(fy);
+    float tx = x - fx;
+    float ty = y - fy;
+    tx = tx * tx * (3.0f - 2.0f * tx);
+    ty = ty * ty * (3.0f - 2.0f * ty);
+    float a = LatticeValue(ix, iy, octave, seed);
+    float b = LatticeValue(ix + 1, iy, octave, seed);
+    float c = LatticeValue(ix, iy + 1, octave, seed);
+    float d = LatticeValue(ix + 1, iy + 1, octave, seed);
+    return (a + (b - a) * tx) + ((c + (d - c) * tx) - (a + (b - a) * tx)) * ty;
+}
+
+// fractal height in [0, 1] at u, v in [0, 1]. low receives the first two octaves, the large shapes
+float Height(float u, float v, uint32_t seed, float& low) {
+    float height = 0.0f;
+    float amplitude = 0.5f;
+    float frequency = 4.0f;
+    for (uint32_t octave = 0; octave < 7; ++octave) {
+        height += amplitude * ValueNoise(u * frequency, v * frequency, octave, seed);
+        if (octave == 1) {
+            low = height;
+        }
+        amplitude *= 0.5f;
+        frequency *= 2.0f;
+    }
+    return height;
+}
+
+uint8_t ToByte(float value) {
+    return static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+bool WritePng(const std::filesystem::path& path, int size, int channels, const std::vector<uint8_t>& pixels, std::string& err) {
+    if (!stbi_write_png(path.string().c_str(), size, size, channels, pixels.data(), size * channels)) {
+        err = "cannot write " + path.string();
+        return false;
+    }
+    return true;
+}
+
+// mesh with one vertex per grid point, x/z in [0, extent], y up, triangles facing +y
+bool WriteMesh(const std::filesystem::path& path, const SyntheticOptions& options, ThreadPool& pool, std::string& err) {
+    size_t n = options.gridSize;
+    float extent = static_cast<float>(n - 1);
+    std::vector<float> heights(n * n);
+    size_t tasks = (n + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+    pool.parallelFor(tasks, [&](size_t task) {
+        for (size_t r = task * ROWS_PER_TASK; r < std::min(n, (task + 1) * ROWS_PER_TASK); ++r) {
+            for (size_t c = 0; c < n; ++c) {
+                float low;
+                heights[r * n + c] = Height(c / extent, r / extent, options.seed, low) * extent * HEIGHT_SCALE;
+            }
+        }
+    });
+
+    std::vector<float> positions(n * n * 3);
+    std::vector<float> normals(n * n * 3);
+    std::vector<float> texCoords(n * n * 2);
+    for (size_t r = 0; r < n; ++r) {
+        for (size_t c = 0; c < n; ++c) {
+            size_t i = r * n + c;
+            positions[i * 3 + 0] = static_cast<float>(c);
+            positions[i * 3 + 1] = heights[i];
+            positions[i * 3 + 2] = static_cast<float>(r);
+            // central differences, one sided at the border
+            size_t c0 = c > 0 ? c - 1 : c, c1 = c + 1 < n ? c + 1 : c;
+            size_t r0 = r > 0 ? r - 1 : r, r1 = r + 1 < n ? r + 1 : r;
+            float dx = (heights[r * n + c1] - heights[r * n + c0]) / static_cast<float>(c1 - c0);
+            float dz = (heights[r1 * n + c] - heights[r0 * n + c]) / static_cast<float>(r1 - r0);
+            float length = std::sqrt(dx * dx + 1.0f + dz * dz);
+            normals[i * 3 + 0] = -dx / length;
+            normals[i * 3 + 1] = 1.0f / length;
+            normals[i * 3 + 2] = -dz / length;
+            texCoords[i * 2 + 0] = c / extent;
+            texCoords[i * 2 + 1] = r / extent;
+        }
+    }
+    std::vector<uint32_t> indices;
+    indices.reserve((n - 1) * (n - 1) * 6);
+    for (size_t r = 0; r + 1 < n; ++r) {
+        for (size_t c = 0; c + 1 < n; ++c) {
+            uint32_t v00 = static_cast<uint32_t>(r * n + c);
+            uint32_t v01 = v00 + 1;
+            uint32_t v10 = v00 + static_cast<uint32_t>(n);
+            uint32_t v11 = v10 + 1;
+            indices.insert(indices.end(), { v00, v10, v01, v01, v10, v11 });
+        }
+    }
+    auto [minHeight, maxHeight] = std::minmax_element(heights.begin(), heights.end());
+    std::vector<double> positionMin = { 0.0, *minHeight, 0.0 };
+    std::vector<double> positionMax = { extent, *maxHeight, extent };
+    size_t vertexCount = n * n;
+    size_t indexCount = indices.size();
+
+    tinygltf::Model model;
+    GlbWriter writer;
+    auto addAccessor = [&](std::vector<unsigned char>&& bytes, int target, int componentType, int type, size_t count,
+                           const std::vector<double>& min, const std::vector<double>& max) {
+        tinygltf::Accessor accessor;
+        size_t byteLength = bytes.size();
+        accessor.bufferView = writer.addBufferView(model, byteLength, target, MemorySegment(std::move(bytes)));
+        accessor.componentType = componentType;
+        accessor.count = count;
+        accessor.type = type;
+        accessor.minValues = min;
+        accessor.maxValues = max;
+        model.accessors.push_back(accessor);
+        return static_cast<int>(model.accessors.size() - 1);
+    };
+    auto bytesOf = [](const auto& values) {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(values.data());
+        return std::vector<unsigned char>(p, p + values.size() * sizeof(values[0]));
+    };
+    tinygltf::Primitive primitive;
+    primitive.mode = TINYGLTF_MODE_TRIANGLES;
+    primitive.attributes["POSITION"] = addAccessor(bytesOf(positions), TINYGLTF_TARGET_ARRAY_BUFFER,
+        TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, vertexCount, positionMin, positionMax);
+    positions = std::vector<float>();
+    primitive.attributes["NORMAL"] = addAccessor(bytesOf(normals), TINYGLTF_TARGET_ARRAY_BUFFER,
+        TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC3, vertexCount, {}, {});
+    normals = std::vector<float>();
+    primitive.attributes["TEXCOORD_0"] = addAccessor(bytesOf(texCoords), TINYGLTF_TARGET_ARRAY_BUFFER,
+        TINYGLTF_COMPONENT_TYPE_FLOAT, TINYGLTF_TYPE_VEC2, vertexCount, {}, {});
+    texCoords = std::vector<float>();
+    primitive.indices = addAccessor(bytesOf(indices), TINYGLTF_TARGET_ELEMENT_ARRAY_BUFFER,
+        TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT, TINYGLTF_TYPE_SCALAR, indexCount, {}, {});
+    indices = std::vector<uint32_t>();
+
+    tinygltf::Mesh mesh;
+    mesh.primitives.push_back(primitive);
+    model.meshes.push_back(mesh);
+    tinygltf::Node node;
+    node.mesh = 0;
+    model.nodes.push_back(node);
+    tinygltf::Scene scene;
+    scene.nodes.push_back(0);
+    model.scenes.push_back(scene);
+    model.defaultScene = 0;
+    model.asset.version = "2.0";
+    model.asset.generator = "WorldCreatorToGLTF synthetic export";
+    return writer.write(model, path.string(), err);
+}
+
+} // namespace
+
+bool WriteSyntheticExport(const std::string& folder, const SyntheticOptions& requested, ThreadPool& pool, std::string& err) {
+    SyntheticOptions options = requested;
+    if (options.gridSize == 0) {
+        options.gridSize = options.textureSize / 4 + 1;
+    }
+    if (options.textureSize < 4 || options.gridSize < 2) {
+        err = "synthetic export needs a texture size of at least 4 and a grid of at least 2 x 2";
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(folder, ec);
+    std::filesystem::path base(folder);
+    if (!WriteMesh(base / (options.baseName + "Mesh.glb"), options, pool, err)) {
+        return false;
+    }
+
+    // height field at map resolution, the low octaves are kept for the occlusion map
+    size_t size = options.textureSize;
+    std::vector<float> height(size * size);
+    std::vector<float> low(size * size);
+    size_t tasks = (size + ROWS_PER_TASK - 1) / ROWS_PER_TASK;
+    pool.parallelFor(tasks, [&](size_t task) {
+        for (size_t y = task * ROWS_PER_TASK; y < std::min(size, (task + 1) * ROWS_PER_TASK); ++y) {
+            for (size_t x = 0; x < size; ++x) {
+                float u = (x + 0.5f) / size;
+                float v = (y + 0.5f) / size;
+                height[y * size + x] = Height(u, v, options.seed, low[y * size + x]);
+            }
+        }
+    });
+
+    std::vector<uint8_t> color(size * size * 3);
+    std::vector<uint8_t> normal(size * size * 3);
+    std::vector<uint8_t> roughness(size * size);
+    std::vector<uint8_t> metalness(size * size);
+    std::vector<uint8_t> occlusion(size * size);
+    // height difference of neighbouring pixels in units of the pixel size
+    float slopeScale = HEIGHT_SCALE * static_cast<float>(size);
+    pool.parallelFor(tasks, [&](size_t task) {
+        for (size_t y = task * ROWS_PER_TASK; y < std::min(size, (task + 1) * ROWS_PER_TASK); ++y) {
+            for (size_t x = 0; x < size; ++x) {
+                size_t i = y * size + x;
+                float h = height[i];
+                size_t x0 = x > 0 ? x - 1 : x, x1 = x + 1 < size ? x + 1 : x;
+                size_t y0 = y > 0 ? y - 1 : y, y1 = y + 1 < size ? y + 1 : y;
+                float dx = (height[y * size + x1] - height[y * size + x0]) * slopeScale / static_cast<float>(x1 - x0);
+                float dy = (height[y1 * size + x] - height[y0 * size + x]) * slopeScale / static_cast<float>(y1 - y0);
+                float length = std::sqrt(dx * dx + dy * dy + 1.0f);
+                float slope = 1.0f - 1.0f / length;
+                normal[i * 3 + 0] = ToByte(0.5f - 0.5f * dx / length);
+                normal[i * 3 + 1] = ToByte(0.5f - 0.5f * dy / length);
+                normal[i * 3 + 2] = ToByte(0.5f + 0.5f / length);
+                // grass in the valleys, rock on slopes, snow on the peaks
+                float snow = std::clamp((h - 0.62f) * 12.0f, 0.0f, 1.0f);
+                float rock = std::clamp(slope * 3.0f, 0.0f, 1.0f) * (1.0f - snow);
+                float grass = 1.0f - snow - rock;
+                float detail = 0.85f + 0.3f * (LatticeValue(static_cast<int32_t>(x), static_cast<int32_t>(y), 99, options.seed) - 0.5f);
+                color[i * 3 + 0] = ToByte((0.25f * grass + 0.45f * rock + 0.95f * snow) * detail);
+                color[i * 3 + 1] = ToByte((0.45f * grass + 0.40f * rock + 0.95f * snow) * detail);
+                color[i * 3 + 2] = ToByte((0.15f * grass + 0.35f * rock + 0.98f * snow) * detail);
+                roughness[i] = ToByte(0.9f - 0.5f * snow - 0.2f * rock + 0.1f * (detail - 0.85f));
+                // a few metallic ore veins in the rock
+                metalness[i] = ToByte(rock > 0.5f && (h - low[i]) > 0.06f ? (h - low[i]) * 8.0f : 0.0f);
+                occlusion[i] = ToByte(0.75f + (h - low[i]) * 4.0f);
+            }
+        }
+    });
+    height = std::vector<float>();
+    low = std::vector<float>();
+
+    // maps are compressed in parallel, stbi_write_png is single threaded
+    int s = static_cast<int>(size);
+    const std::string& name = options.baseName;
+    std::string errors[5];
+    pool.parallelFor(5, [&](size_t map) {
+        switch (map) {
+        case 0: WritePng(base / (name + " Color.png"), s, 3, color, errors[0]); break;
+        case 1: WritePng(base / (name + " Normal.png"), s, 3, normal, errors[1]); break;
+        case 2: WritePng(base / (name + " Roughness.png"), s, 1, roughness, errors[2]); break;
+        case 3: WritePng(base / (name + " Metalness.png"), s, 1, metalness, errors[3]); break;
+        case 4: WritePng(base / (name + " AmbientOcclusion.png"), s, 1, occlusion, errors[4]); break;
+        }
+    });
+    for (const auto& e : errors) {
+        if (!e.empty()) {
+            err = e;
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "thread_pool.h"
+#include <cstdint>
+#include <string>
+
+// what a synthetic WorldCreator export looks like
+struct SyntheticOptions {
+    std::string baseName = "Terrain";
+    size_t textureSize = 1024; // width and height of every map
+    size_t gridSize = 0;       // mesh vertices per side, 0: textureSize / 4 + 1
+    uint32_t seed = 1;
+};
+
+// Write a WorldCreator like export of a fractal terrain to folder: <baseName>Mesh.glb with a regular grid of
+// POSITION, NORMAL, TEXCOORD_0 and 32 bit indices, and the Color, Normal, Roughness, Metalness and
+// AmbientOcclusion maps as 8 bit pngs. Mesh and maps are sampled from the same height field and every map
+// has detail, so no stage is skipped as a constant map. Output only depends on the options
+bool WriteSyntheticExport(const std::string& folder, const SyntheticOptions& options, ThreadPool& pool, std::string& err);
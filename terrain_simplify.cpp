@@ -0,0 +1,203 @@
+#include "terrain_simplify.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// triangle of the hierarchy, a and b span the hypotenuse, c is the right angle
+struct RtinTriangle {
+    int ax, ay, bx, by, cx, cy;
+};
+
+class Rtin {
+public:
+    Rtin(const TerrainGrid& grid, size_t c0, size_t c1, size_t r0, size_t r1)
+        : grid(grid), c0(c0), r0(r0), width(static_cast<int>(c1 - c0)), height(static_cast<int>(r1 - r0)) {
+        // the hierarchy needs a square of 2^k cells, the rectangle is placed in its corner
+        size = 1;
+        levels = 0;
+        while (size < std::max(width, height)) {
+            size *= 2;
+            levels += 2;
+        }
+        errors.assign(static_cast<size_t>(size + 1) * (size + 1), 0.0f);
+        // every height is read once per level of the hierarchy, a dense copy saves the vertex lookup and strided read
+        const AttributeView& positions = grid.mesh->positions;
+        heights.resize(static_cast<size_t>(width + 1) * (height + 1));
+        for (int y = 0; y <= height; ++y) {
+            for (int x = 0; x <= width; ++x) {
+                uint32_t vertex = grid.at(c0 + x, r0 + y);
+                heights[static_cast<size_t>(y) * (width + 1) + x]
+                    = reinterpret_cast<const float*>(positions.data + static_cast<size_t>(vertex) * positions.byteStride)[1];
+            }
+        }
+    }
+
+    void computeErrors(ThreadPool& pool) {
+        const float forceSplit = std::numeric_limits<float>::infinity();
+        // one level of the hierarchy at a time, finest first, so the error of a midpoint includes all errors below it.
+        // Triangles of one level do not overlap and their own errors are computed in parallel. Two triangles of a
+        // level share each midpoint, so merging into errors is sequential
+        std::vector<float> own;
+        for (int level = levels; level-- > 0;) {
+            size_t count = size_t(2) << level;
+            own.resize(count);
+            size_t tasks = std::min(count, pool.size() * 4);
+            pool.parallelFor(tasks, [&](size_t task) {
+                forEachTriangle(level, count * task / tasks, count * (task + 1) / tasks, [&](size_t i, const RtinTriangle& t) {
+                    bool covered = inside(t.ax, t.ay) && inside(t.bx, t.by) && inside(t.cx, t.cy);
+                    own[i] = covered ? triangleError(t) : 0.0f;
+                });
+            });
+            forEachTriangle(level, 0, count, [&](size_t i, const RtinTriangle& t) {
+                float& error = errors[index((t.ax + t.bx) >> 1, (t.ay + t.by) >> 1)];
+                if (!inside(t.ax, t.ay) || !inside(t.bx, t.by) || !inside(t.cx, t.cy)) {
+                    // triangles crossing the rectangle border have to be split until they are inside or outside
+                    int minX = std::min({ t.ax, t.bx, t.cx });
+                    int minY = std::min({ t.ay, t.by, t.cy });
+                    if (minX < width && minY < height) {
+                        error = forceSplit;
+                    }
+                    return;
+                }
+                error = std::max(error, own[i]);
+                if (level + 1 < levels) {
+                    size_t left = index((t.ax + t.cx) >> 1, (t.ay + t.cy) >> 1);
+                    size_t right = index((t.bx + t.cx) >> 1, (t.by + t.cy) >> 1);
+                    error = std::max({ error, errors[left], errors[right] });
+                }
+            });
+        }
+    }
+
+    std::vector<uint32_t> triangulate(float maxError) {
+        std::vector<uint32_t> triangles;
+        process(0, 0, size, size, size, 0, maxError, triangles);
+        process(size, size, 0, 0, 0, size, maxError, triangles);
+        return triangles;
+    }
+
+private:
+    // Call f(i, triangle) for the triangles i in [first, last) of a level, numbered depth first from the two
+    // halves of the square. Neighbouring numbers are neighbours in the grid, so the heights and errors they
+    // touch stay in the cache
+    template <typename F>
+    void forEachTriangle(int level, size_t first, size_t last, F&& f) const {
+        size_t half = size_t(1) << level;
+        visit({ 0, 0, size, size, size, 0 }, level, 0, half, first, last, f);
+        visit({ size, size, 0, 0, 0, size }, level, half, half, first, last, f);
+    }
+
+    // the triangles [number, number + count) of the level lie below t, which is depth levels above them
+    template <typename F>
+    void visit(const RtinTriangle& t, int depth, size_t number, size_t count, size_t first, size_t last, F& f) const {
+        if (number >= last || number + count <= first) {
+            return;
+        }
+        if (depth == 0) {
+            f(number, t);
+            return;
+        }
+        int mx = (t.ax + t.bx) >> 1;
+        int my = (t.ay + t.by) >> 1;
+        visit({ t.cx, t.cy, t.ax, t.ay, mx, my }, depth - 1, number, count / 2, first, last, f);
+        visit({ t.bx, t.by, t.cx, t.cy, mx, my }, depth - 1, number + count / 2, count / 2, first, last, f);
+    }
+
+    size_t index(int x, int y) const { return static_cast<size_t>(y) * (size + 1) + x; }
+    bool inside(int x, int y) const { return x <= width && y <= height; }
+    float heightAt(int x, int y) const { return heights[static_cast<size_t>(y) * (width + 1) + x]; }
+    // largest height error of the grid points covered by the triangle against its plane.
+    // Only checking the midpoint, like the classic algorithm does, can exceed the bound slightly
+    float triangleError(const RtinTriangle& t) const {
+        float ha = heightAt(t.ax, t.ay);
+        float hb = heightAt(t.bx, t.by);
+        float hc = heightAt(t.cx, t.cy);
+        // edge functions, twice the signed area of the sub triangle opposite each corner
+        auto edge = [](int x0, int y0, int x1, int y1, int x, int y) { return (x1 - x0) * (y - y0) - (y1 - y0) * (x - x0); };
+        int area = edge(t.ax, t.ay, t.bx, t.by, t.cx, t.cy);
+        float scale = 1.0f / static_cast<float>(area);
+        float error = 0.0f;
+        // the edges are axis aligned or diagonal, so each edge crosses a row at a grid point, at a slope of -1, 0 or 1
+        const int corners[4][2] = { { t.ax, t.ay }, { t.bx, t.by }, { t.cx, t.cy }, { t.ax, t.ay } };
+        int slopes[3];
+        for (int e = 0; e < 3; ++e) {
+            int dx = corners[e + 1][0] - corners[e][0];
+            int dy = corners[e + 1][1] - corners[e][1];
+            slopes[e] = dx == 0 || dy == 0 ? 0 : (dx > 0) == (dy > 0) ? 1 : -1;
+        }
+        for (int y = std::min({ t.ay, t.by, t.cy }); y <= std::max({ t.ay, t.by, t.cy }); ++y) {
+            // the points inside are the span between the crossings of the edges with the row
+            int first = INT_MAX, last = INT_MIN;
+            for (int e = 0; e < 3; ++e) {
+                int x0 = corners[e][0], y0 = corners[e][1];
+                int x1 = corners[e + 1][0], y1 = corners[e + 1][1];
+                if (y < std::min(y0, y1) || y > std::max(y0, y1)) {
+                    continue;
+                }
+                if (y0 == y1) {
+                    first = std::min({ first, x0, x1 });
+                    last = std::max({ last, x0, x1 });
+                } else {
+                    int x = x0 + slopes[e] * (y - y0);
+                    first = std::min(first, x);
+                    last = std::max(last, x);
+                }
+            }
+            int wa0 = edge(t.bx, t.by, t.cx, t.cy, 0, y), da = t.by - t.cy;
+            int wb0 = edge(t.cx, t.cy, t.ax, t.ay, 0, y), db = t.cy - t.ay;
+            const float* row = &heights[static_cast<size_t>(y) * (width + 1)];
+            for (int x = first; x <= last; ++x) {
+                int wa = wa0 + da * x;
+                int wb = wb0 + db * x;
+                int wc = area - wa - wb;
+                float interpolated = (ha * wa + hb * wb + hc * wc) * scale;
+                error = std::max(error, std::fabs(interpolated - row[x]));
+            }
+        }
+        return error;
+    }
+
+    uint32_t gridPoint(int x, int y) const { return static_cast<uint32_t>((r0 + y) * grid.columns + c0 + x); }
+
+    void process(int ax, int ay, int bx, int by, int cx, int cy, float maxError, std::vector<uint32_t>& triangles) const {
+        int mx = (ax + bx) >> 1;
+        int my = (ay + by) >> 1;
+        if (std::abs(ax - cx) + std::abs(ay - cy) > 1 && errors[index(mx, my)] > maxError) {
+            process(cx, cy, ax, ay, mx, my, maxError, triangles);
+            process(bx, by, cx, cy, mx, my, maxError, triangles);
+        } else if (inside(ax, ay) && inside(bx, by) && inside(cx, cy)) {
+            triangles.insert(triangles.end(), { gridPoint(ax, ay), gridPoint(bx, by), gridPoint(cx, cy) });
+        }
+    }
+
+    const TerrainGrid& grid;
+    size_t c0, r0;
+    int width, height; // rectangle size in cells
+    int size; // hierarchy size in cells, power of 2
+    int levels; // of the hierarchy, 2 log2(size). Level k has 2^(k + 1) triangles
+    std::vector<float> errors; // largest error below each midpoint, row major over (size + 1)^2 points
+    std::vector<float> heights; // of the rectangle, row major over (width + 1) x (height + 1) points
+};
+
+} // namespace
+
+std::vector<uint32_t> SimplifyTerrain(const TerrainGrid& grid, size_t c0, size_t c1, size_t r0, size_t r1, float maxError,
+    ThreadPool& pool) {
+    Rtin rtin(grid, c0, c1, r0, r1);
+    rtin.computeErrors(pool);
+    return rtin.triangulate(maxError);
+}
+
+std::vector<std::vector<uint32_t>> SimplifyTerrainLevels(const TerrainGrid& grid, size_t c0, size_t c1, size_t r0, size_t r1,
+    const std::vector<float>& maxErrors, ThreadPool& pool) {
+    Rtin rtin(grid, c0, c1, r0, r1);
+    rtin.computeErrors(pool);
+    std::vector<std::vector<uint32_t>> levels;
+    for (float maxError : maxErrors) {
+        levels.push_back(rtin.triangulate(maxError));
+    }
+    return levels;
+}
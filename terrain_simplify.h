@@ -0,0 +1,16 @@
+#pragma once
+#include "terrain_tiles.h"
+#include <vector>
+
+// Adaptive triangulation of the grid rectangle [c0, c1] x [r0, r1] with a right triangle
+// irregular network (RTIN): triangles are split along their hypotenuse until every grid point
+// inside them is within maxError of the surface in height. Returns triangles as triples of
+// grid point indices (row * columns + column), winding is not normalized. The errors are computed on the pool,
+// which may be called from a pool task
+std::vector<uint32_t> SimplifyTerrain(const TerrainGrid& grid, size_t c0, size_t c1, size_t r0, size_t r1, float maxError,
+    ThreadPool& pool);
+
+// SimplifyTerrain for several error bounds, e.g. levels of detail. The errors of the hierarchy are
+// computed once and every bound only walks it, returns one triangle list per bound
+std::vector<std::vector<uint32_t>> SimplifyTerrainLevels(const TerrainGrid& grid, size_t c0, size_t c1, size_t r0, size_t r1,
+    const std::vector<float>& maxErrors, ThreadPool& pool);
@@ -0,0 +1,329 @@
+#include "terrain_tiles.h"
+#include "terrain_simplify.h"
+#include "tiny_gltf.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace {
+
+const float* Vec(const AttributeView& view, uint32_t i) {
+    return reinterpret_cast<const float*>(view.data + static_cast<size_t>(i) * view.byteStride);
+}
+
+// number of distinct values of one position component, values closer than epsilon are the same
+size_t CountDistinct(const AttributeView& positions, int component, double epsilon) {
+    std::vector<float> values(positions.count);
+    for (size_t i = 0; i < positions.count; ++i) {
+        values[i] = Vec(positions, static_cast<uint32_t>(i))[component];
+    }
+    std::sort(values.begin(), values.end());
+    size_t distinct = values.empty() ? 0 : 1;
+    float last = values.empty() ? 0.0f : values[0];
+    for (float v : values) {
+        if (v - last > epsilon) {
+            distinct++;
+            last = v;
+        }
+    }
+    return distinct;
+}
+
+// grid points used by a level: every step-th point, the last point of the tile is always included
+std::vector<size_t> Samples(size_t first, size_t last, size_t step) {
+    std::vector<size_t> samples;
+    for (size_t i = first; i < last; i += step) {
+        samples.push_back(i);
+    }
+    samples.push_back(last);
+    return samples;
+}
+
+// builds vertex and index arrays from triangles over the grid points of a rectangle
+class GridMeshBuilder {
+public:
+    GridMeshBuilder(const TerrainGrid& grid, size_t c0, size_t c1, size_t r0, size_t r1)
+        : grid(grid), mesh(*grid.mesh), c0(c0), c1(c1), r0(r0), r1(r1),
+          local((c1 - c0 + 1) * (r1 - r0 + 1), UINT32_MAX) {}
+
+    // triangles as triples of grid point indices, winding is made to match the source mesh
+    void addSurface(const std::vector<uint32_t>& gridTriangles) {
+        for (size_t t = 0; t + 2 < gridTriangles.size(); t += 3) {
+            uint32_t a = vertexOf(gridTriangles[t]);
+            uint32_t b = vertexOf(gridTriangles[t + 1]);
+            uint32_t c = vertexOf(gridTriangles[t + 2]);
+            const float* pa = &positions[a * 3];
+            const float* pb = &positions[b * 3];
+            const float* pc = &positions[c * 3];
+            float normalY = (pb[2] - pa[2]) * (pc[0] - pa[0]) - (pb[0] - pa[0]) * (pc[2] - pa[2]);
+            if ((normalY < 0.0f) != grid.flipWinding) {
+                std::swap(b, c);
+            }
+            indices.insert(indices.end(), { a, b, c });
+        }
+    }
+
+    // skirts: vertical strips hanging down from every border edge of the surface
+    void addSkirts(float depth) {
+        // rows grow along +z and columns along +x
+        const float outwards[4][3] = { { 0, 0, -1 }, { 0, 0, 1 }, { -1, 0, 0 }, { 1, 0, 0 } };
+        for (size_t e = 0; e < 4; ++e) {
+            bool alongColumns = e < 2;
+            size_t first = alongColumns ? c0 : r0;
+            size_t last = alongColumns ? c1 : r1;
+            size_t fixed = e == 0 ? r0 : e == 1 ? r1 : e == 2 ? c0 : c1;
+            // border vertices used by the surface, in order along the edge
+            std::vector<uint32_t> border, lowered;
+            for (size_t i = first; i <= last; ++i) {
+                size_t column = alongColumns ? i : fixed;
+                size_t row = alongColumns ? fixed : i;
+                uint32_t vertex = local[(row - r0) * (c1 - c0 + 1) + column - c0];
+                if (vertex != UINT32_MAX) {
+                    border.push_back(vertex);
+                    lowered.push_back(addVertex(grid.at(column, row), depth));
+                }
+            }
+            for (size_t i = 0; i + 1 < border.size(); ++i) {
+                addFacingTriangle(border[i], lowered[i], border[i + 1], outwards[e]);
+                addFacingTriangle(border[i + 1], lowered[i], lowered[i + 1], outwards[e]);
+            }
+        }
+    }
+
+    MeshPart finish() {
+        return MakeMeshPart(std::move(positions), std::move(normals), std::move(texCoords), indices);
+    }
+
+private:
+    uint32_t vertexOf(uint32_t gridPoint) {
+        size_t column = gridPoint % grid.columns;
+        size_t row = gridPoint / grid.columns;
+        uint32_t& vertex = local[(row - r0) * (c1 - c0 + 1) + column - c0];
+        if (vertex == UINT32_MAX) {
+            vertex = addVertex(grid.vertex[gridPoint]);
+        }
+        return vertex;
+    }
+
+    // kept vertices are grid points of the source, so their normal and texture coordinate are exact
+    uint32_t addVertex(uint32_t source, float lower = 0.0f) {
+        const float* p = Vec(mesh.positions, source);
+        const float* n = Vec(mesh.normals, source);
+        const float* t = Vec(mesh.texCoords, source);
+        positions.insert(positions.end(), { p[0], p[1] - lower, p[2] });
+        normals.insert(normals.end(), { n[0], n[1], n[2] });
+        texCoords.insert(texCoords.end(), { t[0], t[1] });
+        return static_cast<uint32_t>(positions.size() / 3 - 1);
+    }
+
+    // triangle that has to face along outward (inward for flipped exports), winding is chosen from the geometry
+    void addFacingTriangle(uint32_t a, uint32_t b, uint32_t c, const float outward[3]) {
+        const float* pa = &positions[a * 3];
+        const float* pb = &positions[b * 3];
+        const float* pc = &positions[c * 3];
+        float u[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+        float v[3] = { pc[0] - pa[0], pc[1] - pa[1], pc[2] - pa[2] };
+        float n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+        bool inward = n[0] * outward[0] + n[1] * outward[1] + n[2] * outward[2] < 0.0f;
+        if (inward != grid.flipWinding) {
+            std::swap(b, c);
+        }
+        indices.insert(indices.end(), { a, b, c });
+    }
+
+    const TerrainGrid& grid;
+    const SourceMesh& mesh;
+    size_t c0, c1, r0, r1;
+    std::vector<uint32_t> local; // vertex of every grid point in the rectangle, UINT32_MAX if unused
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> texCoords;
+    std::vector<uint32_t> indices;
+};
+
+// regular decimation: every step-th grid point of the rectangle, two triangles per cell
+std::vector<uint32_t> RegularTriangles(const TerrainGrid& grid, size_t c0, size_t c1, size_t r0, size_t r1, size_t step) {
+    std::vector<size_t> columns = Samples(c0, c1, step);
+    std::vector<size_t> rows = Samples(r0, r1, step);
+    std::vector<uint32_t> triangles;
+    for (size_t r = 0; r + 1 < rows.size(); ++r) {
+        for (size_t c = 0; c + 1 < columns.size(); ++c) {
+            uint32_t a = static_cast<uint32_t>(rows[r] * grid.columns + columns[c]);
+            uint32_t right = static_cast<uint32_t>(rows[r] * grid.columns + columns[c + 1]);
+            uint32_t below = static_cast<uint32_t>(rows[r + 1] * grid.columns + columns[c]);
+            uint32_t belowRight = static_cast<uint32_t>(rows[r + 1] * grid.columns + columns[c + 1]);
+            triangles.insert(triangles.end(), { a, below, right, right, below, belowRight });
+        }
+    }
+    return triangles;
+}
+
+float Height(const TerrainGrid& grid, size_t column, size_t row) {
+    return Vec(grid.mesh->positions, grid.at(column, row))[1];
+}
+
+// largest height difference between the full resolution border and the border of a decimated level
+float BorderError(const TerrainGrid& grid, size_t c0, size_t c1, size_t r0, size_t r1, size_t step) {
+    float error = 0.0f;
+    auto edge = [&](bool alongColumns, size_t fixed, size_t first, size_t last) {
+        std::vector<size_t> samples = Samples(first, last, step);
+        for (size_t s = 0; s + 1 < samples.size(); ++s) {
+            size_t a = samples[s], b = samples[s + 1];
+            float ha = alongColumns ? Height(grid, a, fixed) : Height(grid, fixed, a);
+            float hb = alongColumns ? Height(grid, b, fixed) : Height(grid, fixed, b);
+            for (size_t i = a + 1; i < b; ++i) {
+                float t = static_cast<float>(i - a) / static_cast<float>(b - a);
+                float h = alongColumns ? Height(grid, i, fixed) : Height(grid, fixed, i);
+                error = std::max(error, std::fabs(h - (ha + (hb - ha) * t)));
+            }
+        }
+    };
+    edge(true, r0, c0, c1);
+    edge(true, r1, c0, c1);
+    edge(false, c0, r0, r1);
+    edge(false, c1, r0, r1);
+    return error;
+}
+
+bool BuildTile(const TerrainGrid& grid, const TilingOptions& options, ThreadPool& pool, size_t x, size_t y, TerrainTile& tile,
+    std::string& err) {
+    tile.x = x;
+    tile.y = y;
+    size_t c0 = (grid.columns - 1) * x / options.tiles;
+    size_t c1 = (grid.columns - 1) * (x + 1) / options.tiles;
+    size_t r0 = (grid.rows - 1) * y / options.tiles;
+    size_t r1 = (grid.rows - 1) * (y + 1) / options.tiles;
+
+    // skirts have to cover the gap to a neighbour at the coarsest level, which can be off by the error on both sides.
+    // Simplified levels double the error bound with every level
+    size_t coarsestStep = size_t(1) << (options.lods - 1);
+    float cellSize = std::fabs(Vec(grid.mesh->positions, grid.at(1, 0))[0] - Vec(grid.mesh->positions, grid.at(0, 0))[0]);
+    float coarsestError = options.maxError > 0.0f ? options.maxError * coarsestStep : BorderError(grid, c0, c1, r0, r1, coarsestStep);
+    float skirtDepth = 2.0f * coarsestError + 0.1f * cellSize;
+
+    // the error pass of the simplification is shared by all levels, only the bound differs
+    std::vector<std::vector<uint32_t>> simplified;
+    if (options.maxError > 0.0f) {
+        std::vector<float> maxErrors;
+        for (size_t level = 0; level < options.lods; ++level) {
+            maxErrors.push_back(options.maxError * (size_t(1) << level));
+        }
+        simplified = SimplifyTerrainLevels(grid, c0, c1, r0, r1, maxErrors, pool);
+    }
+
+    for (size_t level = 0; level < options.lods; ++level) {
+        GridMeshBuilder builder(grid, c0, c1, r0, r1);
+        if (options.maxError > 0.0f) {
+            builder.addSurface(simplified[level]);
+        } else {
+            builder.addSurface(RegularTriangles(grid, c0, c1, r0, r1, size_t(1) << level));
+        }
+        builder.addSkirts(skirtDepth);
+        MeshPart part = builder.finish();
+        if (options.optimizeMesh) {
+            MeshOptimizeStats stats;
+            tile.lods.emplace_back();
+            if (!OptimizeMesh(part, tile.lods.back(), stats, err)) {
+                return false;
+            }
+        } else {
+            tile.lods.push_back({ std::move(part) });
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+bool BuildTerrainGrid(const SourceMesh& mesh, TerrainGrid& grid, std::string& err) {
+    const AttributeView& positions = mesh.positions;
+    std::vector<double> min, max;
+    ComputeBounds(positions, min, max);
+    double extentX = max[0] - min[0];
+    double extentZ = max[2] - min[2];
+    if (positions.count < 4 || extentX <= 0.0 || extentZ <= 0.0) {
+        err = "mesh is too small for tiling";
+        return false;
+    }
+    size_t columns = CountDistinct(positions, 0, extentX * 1e-6);
+    size_t rows = CountDistinct(positions, 2, extentZ * 1e-6);
+    if (columns < 2 || rows < 2 || columns * rows != positions.count) {
+        err = "mesh is not a regular grid (" + std::to_string(columns) + " x " + std::to_string(rows) +
+            " positions for " + std::to_string(positions.count) + " vertices)";
+        return false;
+    }
+
+    grid.mesh = &mesh;
+    grid.columns = columns;
+    grid.rows = rows;
+    grid.vertex.assign(columns * rows, UINT32_MAX);
+    double dx = extentX / (columns - 1);
+    double dz = extentZ / (rows - 1);
+    for (size_t i = 0; i < positions.count; ++i) {
+        const float* p = Vec(positions, static_cast<uint32_t>(i));
+        double fc = (p[0] - min[0]) / dx;
+        double fr = (p[2] - min[2]) / dz;
+        size_t column = static_cast<size_t>(std::lround(fc));
+        size_t row = static_cast<size_t>(std::lround(fr));
+        if (std::fabs(fc - column) > 0.25 || std::fabs(fr - row) > 0.25 || grid.vertex[row * columns + column] != UINT32_MAX) {
+            err = "mesh is not a regular grid, vertex " + std::to_string(i) + " is off grid";
+            return false;
+        }
+        grid.vertex[row * columns + column] = static_cast<uint32_t>(i);
+    }
+
+    // keep the facing of the export: compare its first triangle with our default winding, which faces +y
+    std::vector<uint32_t> indices = ReadIndices(mesh.indices);
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+        const float* a = Vec(positions, indices[t]);
+        const float* b = Vec(positions, indices[t + 1]);
+        const float* c = Vec(positions, indices[t + 2]);
+        float normalY = (b[2] - a[2]) * (c[0] - a[0]) - (b[0] - a[0]) * (c[2] - a[2]);
+        if (normalY != 0.0f) {
+            grid.flipWinding = normalY < 0.0f;
+            break;
+        }
+    }
+    return true;
+}
+
+TerrainGrid RowMajorGrid(const SourceMesh& mesh, size_t columns, size_t rows) {
+    TerrainGrid grid;
+    grid.mesh = &mesh;
+    grid.columns = columns;
+    grid.rows = rows;
+    grid.vertex.resize(columns * rows);
+    std::iota(grid.vertex.begin(), grid.vertex.end(), 0u);
+    return grid;
+}
+
+bool BuildTiles(const TerrainGrid& grid, const TilingOptions& options, ThreadPool& pool, std::vector<TerrainTile>& tiles,
+    std::string& err) {
+    // every job writes its own tile and error only
+    tiles.assign(options.tiles * options.tiles, TerrainTile());
+    std::vector<std::string> errors(tiles.size());
+    std::vector<std::future<bool>> jobs;
+    for (size_t y = 0; y < options.tiles; ++y) {
+        for (size_t x = 0; x < options.tiles; ++x) {
+            TerrainTile& tile = tiles[y * options.tiles + x];
+            std::string& error = errors[y * options.tiles + x];
+            jobs.push_back(pool.submit([&grid, &options, &pool, x, y, &tile, &error]() {
+                return BuildTile(grid, options, pool, x, y, tile, error);
+            }));
+        }
+    }
+    bool built = true;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (!jobs[i].get() && built) {
+            err = errors[i];
+            built = false;
+        }
+    }
+    return built;
+}
+
+MeshPart BuildTerrainMesh(const TerrainGrid& grid, float maxError, ThreadPool& pool) {
+    GridMeshBuilder builder(grid, 0, grid.columns - 1, 0, grid.rows - 1);
+    builder.addSurface(SimplifyTerrain(grid, 0, grid.columns - 1, 0, grid.rows - 1, maxError, pool));
+    return builder.finish();
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include "mesh_input.h"
+#include "mesh_optimize.h"
+#include "thread_pool.h"
+#include <string>
+#include <vector>
+
+// regular vertex grid recovered from the mesh export
+struct TerrainGrid {
+    const SourceMesh* mesh = nullptr;
+    size_t columns = 0;           // vertices along x
+    size_t rows = 0;              // vertices along z
+    std::vector<uint32_t> vertex; // source vertex of every grid point, row major
+    bool flipWinding = false;     // source triangles face -y for our default winding
+    uint32_t at(size_t column, size_t row) const { return vertex[row * columns + column]; }
+};
+
+// Sort the export vertices into a grid. Fails if the mesh is not a regular grid in the x/z plane
+bool BuildTerrainGrid(const SourceMesh& mesh, TerrainGrid& grid, std::string& err);
+
+// grid of a mesh whose vertices are already row major with triangles facing +y, e.g. generated from a heightmap
+TerrainGrid RowMajorGrid(const SourceMesh& mesh, size_t columns, size_t rows);
+
+// one terrain tile with all its levels of detail
+struct TerrainTile {
+    size_t x = 0;
+    size_t y = 0;
+    std::vector<std::vector<MeshPart>> lods; // lods[0] is full resolution, every further level halves it
+};
+
+struct TilingOptions {
+    size_t tiles = 1;          // tiles per side, power of 2
+    size_t lods = 1;           // levels of detail per tile
+    bool optimizeMesh = false; // run the index optimization for every tile level
+    float maxError = 0.0f;     // > 0: simplify levels to this height error, doubled for every level
+};
+
+// Cut the grid into tiles x tiles tiles and build the levels of detail of each tile in parallel.
+// Every level is decimated by taking every 2^level-th grid point or, with maxError, simplified
+// to maxError * 2^level. Tile borders get skirts that hide cracks to neighbours at a different
+// level. Tiles are returned in row major order. Fails if a level cannot be optimized
+bool BuildTiles(const TerrainGrid& grid, const TilingOptions& options, ThreadPool& pool, std::vector<TerrainTile>& tiles,
+    std::string& err);
+
+// whole grid as one mesh simplified to maxError height error, without skirts
+MeshPart BuildTerrainMesh(const TerrainGrid& grid, float maxError, ThreadPool& pool);
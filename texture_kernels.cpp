@@ -0,0 +1,331 @@
+#include "texture_kernels.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_KERNELS_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define TEXTURE_KERNELS_NEON 1
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// 48 bytes hold a whole number of pixels for 1, 2, 3 and 4 channels, so byte k of a chunk always has channel k % channels
+const size_t CHUNK_BYTES = 48;
+// chunks scanned between early exit checks
+const size_t CHUNKS_PER_CHECK = 4096;
+
+// per channel range of the lanes collected so far
+bool WithinTolerance(const uint8_t minLanes[CHUNK_BYTES], const uint8_t maxLanes[CHUNK_BYTES], int channels, int tolerance,
+    int minimum[4], int maximum[4]) {
+    for (size_t k = 0; k < CHUNK_BYTES; ++k) {
+        int c = static_cast<int>(k % channels);
+        minimum[c] = std::min(minimum[c], static_cast<int>(minLanes[k]));
+        maximum[c] = std::max(maximum[c], static_cast<int>(maxLanes[k]));
+    }
+    for (int c = 0; c < channels; ++c) {
+        if (maximum[c] - minimum[c] > tolerance) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// output bytes per band of rows that Downsample filters as one task
+const size_t DOWNSAMPLE_BAND_BYTES = 256 * 1024;
+
+// lookup tables for the sRGB conversions of the downsample filter
+struct SrgbTables {
+    float toLinear[256];
+    uint8_t fromLinear[4096];
+    SrgbTables() {
+        for (int i = 0; i < 256; ++i) {
+            toLinear[i] = SrgbToLinear(i / 255.0f);
+        }
+        for (int i = 0; i < 4096; ++i) {
+            fromLinear[i] = static_cast<uint8_t>(std::lround(LinearToSrgb(i / 4095.0f) * 255.0f));
+        }
+    }
+};
+
+uint8_t ToByte(float v) {
+    return static_cast<uint8_t>(std::min(std::max(static_cast<int>(v + 0.5f), 0), 255));
+}
+
+#ifdef TEXTURE_KERNELS_SSE2
+// sums of horizontal texel pairs: lo and hi hold 16 bytes of one row as 16 bit values. Result is one sum per output byte
+__m128i PairSums(__m128i lo, __m128i hi, int channels) {
+    const __m128i ones = _mm_set1_epi16(1);
+    switch (channels) {
+    case 1:
+        return _mm_packs_epi32(_mm_madd_epi16(lo, ones), _mm_madd_epi16(hi, ones));
+    case 2:
+        // c0 c1 c0' c1' -> c0 c0' c1 c1', then add neighbours
+        lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+        hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+        return _mm_packs_epi32(_mm_madd_epi16(lo, ones), _mm_madd_epi16(hi, ones));
+    default:
+        return _mm_unpacklo_epi64(_mm_add_epi16(lo, _mm_srli_si128(lo, 8)), _mm_add_epi16(hi, _mm_srli_si128(hi, 8)));
+    }
+}
+#endif
+
+// rounded average of every 2x2 box of a row pair, all channels as they are. Returns the first texel left to do
+int AverageRowVector(const uint8_t* row0, const uint8_t* row1, int channels, int outWidth, uint8_t* out) {
+    int x = 0;
+#if defined(TEXTURE_KERNELS_SSE2)
+    if (channels == 3) {
+        return 0;
+    }
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i two = _mm_set1_epi16(2);
+    const int step = 16 / channels;
+    for (; x + step <= outWidth; x += step) {
+        const uint8_t* a = row0 + static_cast<size_t>(x) * 2 * channels;
+        const uint8_t* b = row1 + static_cast<size_t>(x) * 2 * channels;
+        __m128i average[2];
+        for (int half = 0; half < 2; ++half) {
+            __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 16 * half));
+            __m128i q = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + 16 * half));
+            __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(p, zero), _mm_unpacklo_epi8(q, zero));
+            __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(p, zero), _mm_unpackhi_epi8(q, zero));
+            average[half] = _mm_srli_epi16(_mm_add_epi16(PairSums(lo, hi, channels), two), 2);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + static_cast<size_t>(x) * channels), _mm_packus_epi16(average[0], average[1]));
+    }
+#elif defined(TEXTURE_KERNELS_NEON)
+    // 16 source texels per channel plane, pairwise added, rounded and narrowed to 8 output texels
+    for (; x + 8 <= outWidth; x += 8) {
+        const uint8_t* a = row0 + static_cast<size_t>(x) * 2 * channels;
+        const uint8_t* b = row1 + static_cast<size_t>(x) * 2 * channels;
+        uint8_t* o = out + static_cast<size_t>(x) * channels;
+        switch (channels) {
+        case 1:
+            vst1_u8(o, vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(vld1q_u8(a)), vld1q_u8(b)), 2));
+            break;
+        case 2: {
+            uint8x16x2_t p = vld2q_u8(a), q = vld2q_u8(b);
+            uint8x8x2_t r;
+            for (int c = 0; c < 2; ++c) {
+                r.val[c] = vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(p.val[c]), q.val[c]), 2);
+            }
+            vst2_u8(o, r);
+            break;
+        }
+        case 3: {
+            uint8x16x3_t p = vld3q_u8(a), q = vld3q_u8(b);
+            uint8x8x3_t r;
+            for (int c = 0; c < 3; ++c) {
+                r.val[c] = vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(p.val[c]), q.val[c]), 2);
+            }
+            vst3_u8(o, r);
+            break;
+        }
+        default: {
+            uint8x16x4_t p = vld4q_u8(a), q = vld4q_u8(b);
+            uint8x8x4_t r;
+            for (int c = 0; c < 4; ++c) {
+                r.val[c] = vrshrn_n_u16(vpadalq_u8(vpaddlq_u8(p.val[c]), q.val[c]), 2);
+            }
+            vst4_u8(o, r);
+            break;
+        }
+        }
+    }
+#endif
+    return x;
+}
+
+// One output row of Downsample from 2 source rows, or 3 for the last row of an odd height. The last texel of an
+// odd width averages 3 columns, so no source texel is dropped
+void DownsampleRow(const uint8_t* const* rows, int rowCount, int width, int channels, MipFilter filter, int outWidth, uint8_t* out) {
+    static const SrgbTables tables;
+    if (filter == MipFilter::Normal && channels < 3) {
+        filter = MipFilter::Linear;
+    }
+    const int colorChannels = filter == MipFilter::Linear ? 0 : channels >= 3 ? 3 : 1;
+    const bool oddWidth = width > 1 && width % 2 == 1;
+    int x = filter == MipFilter::Linear && width > 1 && rowCount == 2
+        ? AverageRowVector(rows[0], rows[1], channels, outWidth - (oddWidth ? 1 : 0), out) : 0;
+    for (; x < outWidth; ++x) {
+        int columnCount = oddWidth && x == outWidth - 1 ? 3 : 2;
+        const uint8_t* texels[9];
+        int n = 0;
+        for (int r = 0; r < rowCount; ++r) {
+            for (int i = 0; i < columnCount; ++i) {
+                texels[n++] = rows[r] + static_cast<size_t>(std::min(2 * x + i, width - 1)) * channels;
+            }
+        }
+        uint8_t* o = out + static_cast<size_t>(x) * channels;
+        for (int c = colorChannels; c < channels; ++c) {
+            int sum = 0;
+            for (int t = 0; t < n; ++t) {
+                sum += texels[t][c];
+            }
+            o[c] = static_cast<uint8_t>((sum + n / 2) / n);
+        }
+        if (filter == MipFilter::Srgb) {
+            for (int c = 0; c < colorChannels; ++c) {
+                float sum = 0;
+                for (int t = 0; t < n; ++t) {
+                    sum += tables.toLinear[texels[t][c]];
+                }
+                o[c] = tables.fromLinear[static_cast<int>(sum * (1.0f / n) * 4095.0f + 0.5f)];
+            }
+        } else if (filter == MipFilter::Normal) {
+            // sums of the texels in units of 1 / 255, the direction is all that matters
+            int sum[3];
+            for (int c = 0; c < 3; ++c) {
+                sum[c] = -255 * n;
+                for (int t = 0; t < n; ++t) {
+                    sum[c] += 2 * texels[t][c];
+                }
+            }
+            float length2 = static_cast<float>(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+            if (length2 == 0.0f) {
+                o[0] = o[1] = 128;
+                o[2] = 255;
+                continue;
+            }
+            float scale = 127.5f / std::sqrt(length2);
+            for (int c = 0; c < 3; ++c) {
+                o[c] = ToByte(sum[c] * scale + 127.5f);
+            }
+        }
+    }
+}
+
+} // namespace
+
+bool IsNearUniform(const uint8_t* pixels, size_t pixelCount, int channels, int tolerance, uint8_t value[4]) {
+    int minimum[4] = { 255, 255, 255, 255 };
+    int maximum[4] = { 0, 0, 0, 0 };
+    const size_t byteCount = pixelCount * channels;
+    const size_t chunkCount = byteCount / CHUNK_BYTES;
+    uint8_t minLanes[CHUNK_BYTES], maxLanes[CHUNK_BYTES];
+
+    for (size_t first = 0; first < chunkCount; first += CHUNKS_PER_CHECK) {
+        size_t last = std::min(chunkCount, first + CHUNKS_PER_CHECK);
+#ifdef TEXTURE_KERNELS_SSE2
+        __m128i lo[3], hi[3];
+        for (int v = 0; v < 3; ++v) {
+            lo[v] = _mm_set1_epi8(static_cast<char>(0xFF));
+            hi[v] = _mm_setzero_si128();
+        }
+        for (size_t chunk = first; chunk < last; ++chunk) {
+            const __m128i* p = reinterpret_cast<const __m128i*>(pixels + chunk * CHUNK_BYTES);
+            for (int v = 0; v < 3; ++v) {
+                __m128i bytes = _mm_loadu_si128(p + v);
+                lo[v] = _mm_min_epu8(lo[v], bytes);
+                hi[v] = _mm_max_epu8(hi[v], bytes);
+            }
+        }
+        for (int v = 0; v < 3; ++v) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(minLanes + v * 16), lo[v]);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(maxLanes + v * 16), hi[v]);
+        }
+#else
+        std::fill(minLanes, minLanes + CHUNK_BYTES, static_cast<uint8_t>(255));
+        std::fill(maxLanes, maxLanes + CHUNK_BYTES, static_cast<uint8_t>(0));
+        for (size_t chunk = first; chunk < last; ++chunk) {
+            const uint8_t* p = pixels + chunk * CHUNK_BYTES;
+            for (size_t k = 0; k < CHUNK_BYTES; ++k) {
+                minLanes[k] = std::min(minLanes[k], p[k]);
+                maxLanes[k] = std::max(maxLanes[k], p[k]);
+            }
+        }
+#endif
+        if (!WithinTolerance(minLanes, maxLanes, channels, tolerance, minimum, maximum)) {
+            return false;
+        }
+    }
+
+    // bytes after the last whole chunk
+    for (size_t i = chunkCount * CHUNK_BYTES; i < byteCount; ++i) {
+        int c = static_cast<int>(i % channels);
+        minimum[c] = std::min(minimum[c], static_cast<int>(pixels[i]));
+        maximum[c] = std::max(maximum[c], static_cast<int>(pixels[i]));
+    }
+    for (int c = 0; c < 4; ++c) {
+        if (c < channels && maximum[c] - minimum[c] > tolerance) {
+            return false;
+        }
+        value[c] = c < channels ? static_cast<uint8_t>((minimum[c] + maximum[c] + 1) / 2) : 255;
+    }
+    return true;
+}
+
+void InterleaveChannels(const uint8_t* red, const uint8_t* green, const uint8_t* blue, size_t pixelCount, uint8_t* rgba) {
+    size_t i = 0;
+#if defined(TEXTURE_KERNELS_SSE2)
+    const __m128i opaque = _mm_set1_epi8(static_cast<char>(0xFF));
+    auto load = [&](const uint8_t* plane) {
+        return plane ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(plane + i)) : opaque;
+    };
+    for (; i + 16 <= pixelCount; i += 16) {
+        __m128i r = load(red), g = load(green), b = load(blue);
+        __m128i rg0 = _mm_unpacklo_epi8(r, g), rg1 = _mm_unpackhi_epi8(r, g);
+        __m128i ba0 = _mm_unpacklo_epi8(b, opaque), ba1 = _mm_unpackhi_epi8(b, opaque);
+        __m128i* out = reinterpret_cast<__m128i*>(rgba + i * 4);
+        _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(rg0, ba0));
+        _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(rg0, ba0));
+        _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(rg1, ba1));
+        _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(rg1, ba1));
+    }
+#elif defined(TEXTURE_KERNELS_NEON)
+    const uint8x16_t opaque = vdupq_n_u8(0xFF);
+    for (; i + 16 <= pixelCount; i += 16) {
+        uint8x16x4_t pixels;
+        pixels.val[0] = red ? vld1q_u8(red + i) : opaque;
+        pixels.val[1] = green ? vld1q_u8(green + i) : opaque;
+        pixels.val[2] = blue ? vld1q_u8(blue + i) : opaque;
+        pixels.val[3] = opaque;
+        vst4q_u8(rgba + i * 4, pixels);
+    }
+#endif
+    for (; i < pixelCount; ++i) {
+        rgba[i * 4 + 0] = red ? red[i] : 255;
+        rgba[i * 4 + 1] = green ? green[i] : 255;
+        rgba[i * 4 + 2] = blue ? blue[i] : 255;
+        rgba[i * 4 + 3] = 255;
+    }
+}
+
+float SrgbToLinear(float c) {
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+float LinearToSrgb(float c) {
+    return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+std::vector<uint8_t> Downsample(const uint8_t* src, int width, int height, int channels, MipFilter filter, ThreadPool& pool,
+    int& outWidth, int& outHeight) {
+    outWidth = std::max(1, width / 2);
+    outHeight = std::max(1, height / 2);
+    const size_t rowBytes = static_cast<size_t>(outWidth) * channels;
+    std::vector<uint8_t> dst(rowBytes * outHeight);
+    const int rowsPerBand = static_cast<int>(std::max<size_t>(1, DOWNSAMPLE_BAND_BYTES / rowBytes));
+    const int bands = (outHeight + rowsPerBand - 1) / rowsPerBand;
+    auto filterBand = [&](size_t band) {
+        int last = std::min(outHeight, static_cast<int>(band + 1) * rowsPerBand);
+        for (int y = static_cast<int>(band) * rowsPerBand; y < last; ++y) {
+            // the last row of an odd height takes the row left over as well
+            int rowCount = height > 1 && height % 2 == 1 && y == outHeight - 1 ? 3 : 2;
+            const uint8_t* rows[3];
+            for (int r = 0; r < rowCount; ++r) {
+                rows[r] = src + static_cast<size_t>(std::min(2 * y + r, height - 1)) * width * channels;
+            }
+            DownsampleRow(rows, rowCount, width, channels, filter, outWidth, &dst[y * rowBytes]);
+        }
+    };
+    if (bands == 1) {
+        filterBand(0);
+    } else {
+        pool.parallelFor(bands, filterBand);
+    }
+    return dst;
+}
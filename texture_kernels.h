@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class ThreadPool;
+
+// how texels are averaged when an image is downsampled
+enum class MipFilter {
+    Srgb,   // color in sRGB encoding, averaged in linear space. Stored with an sRGB format
+    Linear, // data channels, averaged as they are
+    Normal  // tangent space normals, averaged and normalized again
+};
+
+// Check if every channel of interleaved 8 bit pixels (1 to 4 channels) stays within tolerance
+// of a single value. On success value holds the middle of each channel's range.
+// Returns as soon as one channel spans more than tolerance, so detailed maps are rejected early
+bool IsNearUniform(const uint8_t* pixels, size_t pixelCount, int channels, int tolerance, uint8_t value[4]);
+
+// Interleave three 8 bit planes into rgba pixels with alpha 255. A null plane is filled with 255
+void InterleaveChannels(const uint8_t* red, const uint8_t* green, const uint8_t* blue, size_t pixelCount, uint8_t* rgba);
+
+// sRGB transfer functions for values in [0, 1]
+float SrgbToLinear(float c);
+float LinearToSrgb(float c);
+
+// Halve an image of interleaved 8 bit pixels (1 to 4 channels) to max(1, width / 2) x max(1, height / 2).
+// Every texel averages a 2x2 box, a side of 1 repeats its row / column. With an odd width or height the last
+// texels average 3 columns or rows instead, so the whole image is kept. Srgb averages the color channels
+// (the first, or the first three of 3 and 4 channel pixels) in linear space, Normal normalizes the first three
+// channels again. Alpha and all channels of Linear are averaged as they are, with vector instructions.
+// Bands of rows are filtered in parallel on the pool
+std::vector<uint8_t> Downsample(const uint8_t* src, int width, int height, int channels, MipFilter filter, ThreadPool& pool,
+    int& outWidth, int& outHeight);
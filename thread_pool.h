@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed size pool of worker threads with work stealing. Every worker has its own task deque:
+// tasks submitted from a worker go to its own deque and are taken newest first, idle workers
+// steal the oldest tasks of the others. Tasks from other threads are spread over the deques.
+// Results are collected through the returned futures.
+class ThreadPool {
+public:
+    // threadCount == 0 means one thread per hardware core
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return workers.size(); }
+
+    template <typename F>
+    auto submit(F&& f) -> std::future<std::invoke_result_t<F>> {
+        using R = std::invoke_result_t<F>;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        std::future<R> result = task->get_future();
+        push([task]() { (*task)(); });
+        return result;
+    }
+
+    // Run body(i) for every i in [0, count) on the pool and wait for all of them. The calling
+    // thread runs queued tasks while it waits, so this can be used from inside a pool task
+    template <typename F>
+    void parallelFor(size_t count, F&& body) {
+        std::vector<std::future<void>> parts;
+        parts.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            parts.push_back(submit([&body, i]() { body(i); }));
+        }
+        for (auto& part : parts) {
+            while (part.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                if (!runPendingTask()) {
+                    // everything left is already running on other threads
+                    part.wait();
+                }
+            }
+            part.get();
+        }
+    }
+
+    // number of threads to use if the user did not limit it
+    static size_t defaultThreadCount();
+
+private:
+    // task deque of one worker
+    struct TaskQueue {
+        std::deque<std::function<void()>> tasks;
+        std::mutex mutex;
+    };
+
+    void push(std::function<void()> task);
+    void workerLoop(size_t index);
+    // take a task: newest of the own deque first, then the oldest of the others. self is SIZE_MAX for non workers
+    bool takeTask(size_t self, std::function<void()>& task);
+    // run one queued task on the calling thread, false if all deques are empty
+    bool runPendingTask();
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::atomic<size_t> nextQueue{ 0 }; // round robin target for tasks from non worker threads
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    size_t pending = 0; // queued tasks, guarded by sleepMutex
+    bool stopping = false;
+};